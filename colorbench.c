@@ -0,0 +1,198 @@
+/*
+ * colorbench.c - Measures the effect of cache coloring (mm_set_coloring)
+ *     on large same-size buffers that are walked in lockstep.
+ *
+ * The benchmark allocates a number of equally sized buffers from the mm
+ * package and sums them element by element, one element of every buffer
+ * per step. Without coloring, the payloads of such buffers start at
+ * (nearly) the same offset within a page, so the lines touched in one step
+ * all map to the same cache set and evict each other. The walk is timed
+ * with coloring off and on and, where the kernel lets us read the hardware
+ * cache counters, the L1D read misses of one walk are reported as well.
+ * The defaults walk enough buffers for the conflicts to show (with fewer
+ * than about 24 there is little difference between off and on), often
+ * enough for a timing sample of several milliseconds.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "fsecs.h"
+
+#define MAXBUFS 64
+
+int verbose = 0;    /* needed by the timing package */
+
+/* Parameters of one walk, passed to fsecs */
+typedef struct {
+    long *bufs[MAXBUFS];
+    int nbufs;
+    size_t nelems;
+    int reps;
+    long sum;
+} walk_t;
+
+static void walk(void *ptr);
+static long l1d_misses(walk_t *w);
+static void run(walk_t *w, size_t size, int colors);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    walk_t w;
+    size_t size = (32 << 10) - 16;  /* bytes per buffer: blocks of exactly 32KB */
+    int colors = 16;                /* number of colors when coloring is on */
+    int c;
+
+    w.nbufs = 32;
+    w.reps = 100;
+    while ((c = getopt(argc, argv, "n:s:c:r:h")) != EOF) {
+        switch (c) {
+        case 'n':
+            w.nbufs = atoi(optarg);
+            break;
+        case 's':
+            size = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            colors = atoi(optarg);
+            break;
+        case 'r':
+            w.reps = atoi(optarg);
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (w.nbufs < 1 || w.nbufs > MAXBUFS || size < sizeof(long)) {
+        usage();
+        exit(1);
+    }
+    w.nelems = size / sizeof(long);
+
+    mem_init();
+    init_fsecs();
+
+    printf("%d buffers of %lu bytes, walked in lockstep %d times\n",
+           w.nbufs, (unsigned long)size, w.reps);
+    printf("%-10s %10s %12s %14s\n", "coloring", "secs", "MB/s", "L1D misses");
+    run(&w, size, 0);
+    run(&w, size, colors);
+
+    mem_deinit();
+    exit(0);
+}
+
+/*
+ * run - Allocate the buffers with the given number of colors (0 for no
+ *     coloring), then time the walk and print one line of results
+ */
+static void run(walk_t *w, size_t size, int colors)
+{
+    double secs;
+    long misses;
+    char label[32];
+    int i;
+
+    mem_reset_brk();
+    if (mm_init() < 0) {
+        fprintf(stderr, "mm_init failed\n");
+        exit(1);
+    }
+    mm_set_coloring(size, colors);
+    for (i = 0; i < w->nbufs; i++) {
+        if ((w->bufs[i] = mm_malloc(size)) == NULL) {
+            fprintf(stderr, "mm_malloc failed\n");
+            exit(1);
+        }
+        memset(w->bufs[i], i, size);
+    }
+
+    secs = fsecs(walk, w);
+    misses = l1d_misses(w);
+
+    if (colors > 1)
+        sprintf(label, "%d colors", colors);
+    else
+        strcpy(label, "off");
+    printf("%-10s %10.6f %12.0f ", label, secs,
+           (double)size * w->nbufs * w->reps / secs / 1e6);
+    if (misses >= 0)
+        printf("%14ld\n", misses);
+    else
+        printf("%14s\n", "n/a");
+
+    for (i = 0; i < w->nbufs; i++)
+        mm_free(w->bufs[i]);
+    mm_set_coloring(0, 0);
+}
+
+/*
+ * walk - Sum all buffers, one element of every buffer per step
+ */
+static void walk(void *ptr)
+{
+    walk_t *w = (walk_t *)ptr;
+    long sum = 0;
+    size_t j;
+    int i, r;
+
+    for (r = 0; r < w->reps; r++)
+        for (j = 0; j < w->nelems; j++)
+            for (i = 0; i < w->nbufs; i++)
+                sum += w->bufs[i][j];
+    w->sum = sum;
+}
+
+/*
+ * l1d_misses - Count the L1D read misses of one walk with perf_event_open.
+ *     Returns -1 if the counter is not available.
+ */
+static long l1d_misses(walk_t *w)
+{
+    struct perf_event_attr attr;
+    long long count;
+    int fd;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_L1D |
+        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    if ((fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0)) < 0)
+        return -1;
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    walk(w);
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &count, sizeof(count)) != sizeof(count))
+        count = -1;
+    close(fd);
+    return count;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: colorbench [-h] [-n <bufs>] [-s <size>] [-c <colors>] [-r <reps>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-n <bufs>    Number of buffers walked in lockstep (default 32).\n");
+    fprintf(stderr, "\t-s <size>    Size of each buffer in bytes (default 32752).\n");
+    fprintf(stderr, "\t-c <colors>  Number of colors when coloring is on (default 16).\n");
+    fprintf(stderr, "\t-r <reps>    Walks per timing sample (default 100).\n");
+    fprintf(stderr, "\t-h           Print this message.\n");
+}
@@ -0,0 +1,200 @@
+/*
+ * containerbench.cpp - Compares the mm package with the default memory
+ *     resource (operator new, so the C library's malloc) under the churn
+ *     of standard containers.
+ *
+ * Each workload runs a fixed, seeded sequence of operations on containers
+ * whose allocations all go through one memory resource:
+ *
+ *     map        inserts and erases random keys of a std::pmr::map
+ *     unordered  the same on a std::pmr::unordered_map
+ *     vector     grows, shrinks and replaces a set of std::pmr::vectors
+ *
+ * and is timed with the default resource, with mm::memory_resource, and
+ * with a short-lived hinted mm::memory_resource (see mm.hpp).
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <memory_resource>
+#include <unistd.h>
+
+#include "mm.hpp"
+#include "memlib.h"
+#include "fsecs.h"
+
+extern "C" {
+int verbose = 0;    /* needed by the timing package */
+}
+
+/* Parameters of one workload run, passed to fsecs */
+typedef struct {
+    std::pmr::memory_resource *resource;
+    long ops;           /* operations per run */
+    int keys;           /* size of the key space (map, unordered) or number of vectors */
+    long sum;           /* keeps the work from being optimized away */
+} run_t;
+
+static void map_churn(void *ptr);
+static void unordered_churn(void *ptr);
+static void vector_churn(void *ptr);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    static const struct {
+        const char *name;
+        fsecs_test_funct f;
+    } workloads[] = {
+        { "map", map_churn },
+        { "unordered", unordered_churn },
+        { "vector", vector_churn },
+    };
+    mm::memory_resource mm_any;
+    mm::memory_resource mm_short(MM_SHORT_LIVED);
+    struct {
+        const char *name;
+        std::pmr::memory_resource *resource;
+    } resources[] = {
+        { "default", std::pmr::new_delete_resource() },
+        { "mm", &mm_any },
+        { "mm-short", &mm_short },
+    };
+    run_t r;
+    double secs;
+    int c;
+    size_t i, j;
+
+    r.ops = 200000;
+    r.keys = 10000;
+    while ((c = getopt(argc, argv, "n:k:h")) != EOF) {
+        switch (c) {
+        case 'n':
+            r.ops = atol(optarg);
+            break;
+        case 'k':
+            r.keys = atoi(optarg);
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (r.ops < 1 || r.keys < 1) {
+        usage();
+        exit(1);
+    }
+
+    mem_init();
+    if (mm_init() < 0) {
+        fprintf(stderr, "mm_init failed\n");
+        exit(1);
+    }
+    init_fsecs();
+
+    printf("%ld operations per run, %d keys\n", r.ops, r.keys);
+    printf("%-10s %-10s %10s %12s\n", "workload", "resource", "secs", "Kops/s");
+    for (i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++) {
+        for (j = 0; j < sizeof(resources) / sizeof(resources[0]); j++) {
+            r.resource = resources[j].resource;
+            secs = fsecs(workloads[i].f, &r);
+            printf("%-10s %-10s %10.6f %12.0f\n", workloads[i].name,
+                   resources[j].name, secs, r.ops / secs / 1e3);
+        }
+    }
+
+    mem_deinit();
+    exit(0);
+}
+
+/*
+ * map_churn - Insert a random key if it's absent, erase it otherwise
+ */
+static void map_churn(void *ptr)
+{
+    run_t *r = (run_t *)ptr;
+    std::pmr::map<int, long> m(r->resource);
+    unsigned seed = 1;
+    long i;
+
+    for (i = 0; i < r->ops; i++) {
+        int key = rand_r(&seed) % r->keys;
+        auto it = m.find(key);
+
+        if (it == m.end())
+            m.emplace(key, i);
+        else
+            m.erase(it);
+    }
+    r->sum = m.size();
+}
+
+/*
+ * unordered_churn - map_churn on a hash table, which also rehashes
+ */
+static void unordered_churn(void *ptr)
+{
+    run_t *r = (run_t *)ptr;
+    std::pmr::unordered_map<int, long> m(r->resource);
+    unsigned seed = 1;
+    long i;
+
+    for (i = 0; i < r->ops; i++) {
+        int key = rand_r(&seed) % r->keys;
+        auto it = m.find(key);
+
+        if (it == m.end())
+            m.emplace(key, i);
+        else
+            m.erase(it);
+    }
+    r->sum = m.size();
+}
+
+/*
+ * vector_churn - Append to a random vector of a set, and now and then
+ *     shrink one to fit or replace it with an empty one
+ */
+static void vector_churn(void *ptr)
+{
+    run_t *r = (run_t *)ptr;
+    int n = r->keys < 1024 ? r->keys : 1024;
+    std::pmr::vector<std::pmr::vector<long>> v(r->resource);
+    unsigned seed = 1;
+    long i, sum = 0;
+
+    v.reserve(n);
+    for (i = 0; i < n; i++)
+        v.emplace_back();
+    for (i = 0; i < r->ops; i++) {
+        std::pmr::vector<long> &x = v[rand_r(&seed) % n];
+
+        switch (rand_r(&seed) % 16) {
+        case 0:
+            x.shrink_to_fit();
+            break;
+        case 1:
+            sum += x.size();
+            x = std::pmr::vector<long>(r->resource);
+            break;
+        default:
+            x.push_back(i);
+        }
+    }
+    r->sum = sum;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: containerbench [-h] [-n <ops>] [-k <keys>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-n <ops>   Operations per run (default 200000).\n");
+    fprintf(stderr, "\t-k <keys>  Key space of the maps, number of vectors up to 1024 (default 10000).\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+}
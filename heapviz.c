@@ -0,0 +1,338 @@
+/*
+ * heapviz.c - Renders the heap maps written by mm_dump_heap (mdriver -m)
+ *     as views of where the space of the heap goes:
+ *
+ *         ./mdriver -f traces/binary-bal.rep -m heap.map
+ *         ./heapviz [-n <map>] [-p <pagesize>] [-o <file.pgm>] heap.map
+ *
+ * The timeline has a line per map: the heap size split into allocated
+ * blocks, free blocks and the wilderness (the free block at the top,
+ * which the heap grows into), the largest free block other than the
+ * wilderness, and the fragmentation of the free blocks, 1 - largest/free:
+ * the share of the free bytes that a request as large as possible could
+ * not use.
+ *
+ * For one map (the last one, or the one picked with -n) it then shows
+ *
+ *     - the free blocks by size, in powers of two and in the buckets of
+ *       the free lists, with their count and bytes;
+ *     - a heatmap of the pages of the heap: the share of each page that
+ *       is covered by allocated blocks, one character per group of pages
+ *       and, with -o, one pixel per page in a PGM image (black: empty,
+ *       white: full).
+ *
+ * Headers and footers count as allocated, since they are part of the
+ * blocks; the padding inside a block can't be told from its payload.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mm.h"
+
+#define NUM_BUCKET      MM_NUM_BUCKETS
+#define SIZE_CLASSES    40          /* powers of two of the free block size histogram */
+#define BAR             40          /* width of the bars */
+#define HEAT_COLS       64          /* cells per line of the heatmap... */
+#define HEAT_ROWS       32          /* ...and lines at most */
+#define PGM_WIDTH       256         /* pages per line of the image */
+
+static const char shades[] = " .:-=+*#%@";     /* heatmap cells from empty to full */
+
+/* One map of the file */
+typedef struct {
+    mm_map_header_t *header;
+    uint64_t *words;
+    uint64_t alloc, free, wild;     /* bytes in allocated blocks, free blocks and the wilderness */
+    uint64_t largest;               /* largest free block but the wilderness */
+} map_t;
+
+static map_t *maps;
+static int num_maps;
+
+static void read_maps(const char *path);
+static void summarize(map_t *m);
+static void print_timeline(void);
+static void print_free_sizes(map_t *m);
+static void print_heatmap(map_t *m, size_t pagesize, const char *pgm);
+static void bar(uint64_t a, uint64_t b, uint64_t c, uint64_t scale);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    size_t pagesize = 4096;
+    char *pgm = NULL;
+    int c, n = -1;
+
+    while ((c = getopt(argc, argv, "hn:p:o:")) != EOF) {
+        switch (c) {
+        case 'n':
+            n = atoi(optarg);
+            break;
+        case 'p':
+            pagesize = strtoul(optarg, NULL, 0);
+            break;
+        case 'o':
+            pgm = optarg;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind != argc - 1 || pagesize == 0) {
+        usage();
+        exit(1);
+    }
+
+    read_maps(argv[optind]);
+    if (num_maps == 0) {
+        fprintf(stderr, "heapviz: %s has no heap maps\n", argv[optind]);
+        exit(1);
+    }
+    if (n < 0)
+        n = num_maps - 1;
+    if (n >= num_maps) {
+        fprintf(stderr, "heapviz: there are only %d maps\n", num_maps);
+        exit(1);
+    }
+
+    print_timeline();
+    printf("\nMap %d (tag %lu):\n", n, (unsigned long) maps[n].header->tag);
+    print_free_sizes(&maps[n]);
+    print_heatmap(&maps[n], pagesize, pgm);
+    exit(0);
+}
+
+/*
+ * read_maps - Read the file at path and index the maps in it
+ */
+static void read_maps(const char *path)
+{
+    FILE *fp;
+    char *data = NULL;
+    size_t len = 0, max = 0, n, off;
+    mm_map_header_t *h;
+    int max_maps = 0;
+
+    if ((fp = fopen(path, "rb")) == NULL) {
+        fprintf(stderr, "heapviz: could not open %s\n", path);
+        exit(1);
+    }
+    do {
+        if (len == max) {
+            max = max ? 2 * max : 1 << 20;
+            if ((data = realloc(data, max)) == NULL) {
+                fprintf(stderr, "heapviz: out of memory\n");
+                exit(1);
+            }
+        }
+        n = fread(data + len, 1, max - len, fp);
+        len += n;
+    } while (n > 0);
+    fclose(fp);
+
+    /* The words of a map follow its header, which is a multiple of 8 bytes long: both stay aligned in the buffer */
+    for (off = 0; off + sizeof(mm_map_header_t) <= len; ) {
+        h = (mm_map_header_t *) (data + off);
+        if (memcmp(h->magic, "MMHEAP01", 8) != 0 ||
+            h->num_blocks > (len - off - sizeof(mm_map_header_t)) / sizeof(uint64_t)) {
+            fprintf(stderr, "heapviz: %s: bad or truncated map at byte %lu\n", path, (unsigned long) off);
+            exit(1);
+        }
+        if (num_maps == max_maps) {
+            max_maps = max_maps ? 2 * max_maps : 64;
+            if ((maps = realloc(maps, max_maps * sizeof(map_t))) == NULL) {
+                fprintf(stderr, "heapviz: out of memory\n");
+                exit(1);
+            }
+        }
+        maps[num_maps].header = h;
+        maps[num_maps].words = (uint64_t *) (h + 1);
+        summarize(&maps[num_maps++]);
+        off += sizeof(mm_map_header_t) + h->num_blocks * sizeof(uint64_t);
+    }
+}
+
+/*
+ * summarize - Add up the blocks of the map m
+ */
+static void summarize(map_t *m)
+{
+    uint64_t i, size;
+
+    m->alloc = m->free = m->wild = m->largest = 0;
+    for (i = 0; i < m->header->num_blocks; i++) {
+        size = MM_MAP_SIZE(m->words[i]);
+        if (m->words[i] & MM_MAP_ALLOC)
+            m->alloc += size;
+        else if (i == m->header->num_blocks - 1)
+            m->wild = size;
+        else {
+            m->free += size;
+            if (size > m->largest)
+                m->largest = size;
+        }
+    }
+}
+
+/*
+ * print_timeline - One line per map, with a bar of the heap: '#' allocated, '.' free, '~' wilderness
+ */
+static void print_timeline(void)
+{
+    uint64_t scale = 1;
+    int i;
+
+    for (i = 0; i < num_maps; i++)
+        if (maps[i].header->heap_size > scale)
+            scale = maps[i].header->heap_size;
+
+    printf("%4s %10s %12s %12s %12s %12s %12s %6s\n", "map", "tag", "heap", "allocated", "free", "wilderness",
+           "largest free", "frag");
+    for (i = 0; i < num_maps; i++) {
+        printf("%4d %10lu %12lu %12lu %12lu %12lu %12lu %5.1f%% ", i, (unsigned long) maps[i].header->tag,
+               (unsigned long) maps[i].header->heap_size, (unsigned long) maps[i].alloc, (unsigned long) maps[i].free,
+               (unsigned long) maps[i].wild, (unsigned long) maps[i].largest,
+               maps[i].free ? 100.0 * (1 - (double) maps[i].largest / maps[i].free) : 0.0);
+        bar(maps[i].alloc, maps[i].free, maps[i].wild, scale);
+    }
+}
+
+/*
+ * print_free_sizes - Histograms of the free blocks of m (but the wilderness) by size: in powers of two and in buckets
+ */
+static void print_free_sizes(map_t *m)
+{
+    uint64_t count[SIZE_CLASSES] = { 0 }, bytes[SIZE_CLASSES] = { 0 };
+    uint64_t bcount[NUM_BUCKET] = { 0 }, bbytes[NUM_BUCKET] = { 0 };
+    uint64_t i, size, most = 1, blocks = 0;
+    int c, b, last = 0;
+
+    for (i = 0; i + 1 < m->header->num_blocks; i++) {
+        if (m->words[i] & MM_MAP_ALLOC)
+            continue;
+        size = MM_MAP_SIZE(m->words[i]);
+        for (c = 0; c < SIZE_CLASSES - 1 && (2UL << c) <= size; c++)
+            ;
+        count[c]++;
+        bytes[c] += size;
+        for (b = 0; b < NUM_BUCKET - 1 && size > m->header->bucket_limits[b]; b++)
+            ;
+        bcount[b]++;
+        bbytes[b] += size;
+        blocks++;
+    }
+    for (c = 0; c < SIZE_CLASSES; c++) {
+        if (bytes[c] > most)
+            most = bytes[c];
+        if (count[c] != 0)
+            last = c;
+    }
+
+    printf("\nFree blocks by size (%lu bytes in %lu blocks, and a wilderness of %lu):\n", (unsigned long) m->free,
+           (unsigned long) blocks, (unsigned long) m->wild);
+    printf("%21s %10s %12s %6s\n", "size", "blocks", "bytes", "share");
+    for (c = 0; c <= last; c++) {
+        if (count[c] == 0)
+            continue;
+        printf("%10lu-%-10lu %10lu %12lu %5.1f%% ", c ? 1UL << c : 0, (2UL << c) - 1, (unsigned long) count[c],
+               (unsigned long) bytes[c], 100.0 * bytes[c] / (m->free ? m->free : 1));
+        bar(0, bytes[c], 0, most);
+    }
+
+    printf("\nFree blocks by bucket:\n");
+    printf("%6s %10s %10s %12s\n", "bucket", "limit", "blocks", "bytes");
+    for (b = 0; b < NUM_BUCKET; b++) {
+        if (b < NUM_BUCKET - 1)
+            printf("%6d %10lu", b, (unsigned long) m->header->bucket_limits[b]);
+        else
+            printf("%6d %10s", b, "-");
+        printf(" %10lu %12lu\n", (unsigned long) bcount[b], (unsigned long) bbytes[b]);
+    }
+}
+
+/*
+ * print_heatmap - Share of every page of m covered by allocated blocks, as text (groups of pages per character) and in the image pgm
+ */
+static void print_heatmap(map_t *m, size_t pagesize, const char *pgm)
+{
+    uint64_t start = m->header->heap_start, addr, end, lo, hi, page, i;
+    uint64_t first_page = start / pagesize, num_pages, per_cell, cells, cell, p, used;
+    uint64_t *covered;      /* allocated bytes in each page */
+    FILE *fp;
+    int row;
+
+    num_pages = (start + m->header->heap_size + pagesize - 1) / pagesize - first_page;
+    if (num_pages == 0)
+        return;
+    if ((covered = calloc(num_pages, sizeof(uint64_t))) == NULL) {
+        fprintf(stderr, "heapviz: out of memory\n");
+        exit(1);
+    }
+    addr = start + m->header->first;
+    for (i = 0; i < m->header->num_blocks; i++, addr = end) {
+        end = addr + MM_MAP_SIZE(m->words[i]);
+        if (!(m->words[i] & MM_MAP_ALLOC))
+            continue;
+        for (page = addr / pagesize; page * pagesize < end; page++) {
+            lo = page * pagesize > addr ? page * pagesize : addr;
+            hi = (page + 1) * pagesize < end ? (page + 1) * pagesize : end;
+            covered[page - first_page] += hi - lo;
+        }
+    }
+
+    per_cell = (num_pages + HEAT_COLS * HEAT_ROWS - 1) / (HEAT_COLS * HEAT_ROWS);
+    cells = (num_pages + per_cell - 1) / per_cell;
+    printf("\nOccupancy of the %lu pages of %lu bytes, %lu per character ('%c' empty to '%c' full):\n",
+           (unsigned long) num_pages, (unsigned long) pagesize, (unsigned long) per_cell, shades[0], shades[sizeof(shades) - 2]);
+    for (row = 0, cell = 0; cell < cells; row++) {
+        printf("%#14lx |", (unsigned long) ((first_page + cell * per_cell) * pagesize));
+        for (i = 0; i < HEAT_COLS && cell < cells; i++, cell++) {
+            used = 0;
+            for (p = cell * per_cell; p < (cell + 1) * per_cell && p < num_pages; p++)
+                used += covered[p];
+            p -= cell * per_cell;       // pages in the cell
+            putchar(used == 0 ? shades[0] : shades[1 + (sizeof(shades) - 3) * used / (p * pagesize)]);
+        }
+        printf("|\n");
+    }
+
+    if (pgm != NULL) {
+        if ((fp = fopen(pgm, "wb")) == NULL) {
+            fprintf(stderr, "heapviz: could not open %s\n", pgm);
+            exit(1);
+        }
+        fprintf(fp, "P5\n%d %lu\n255\n", PGM_WIDTH, (unsigned long) ((num_pages + PGM_WIDTH - 1) / PGM_WIDTH));
+        for (p = 0; p < (num_pages + PGM_WIDTH - 1) / PGM_WIDTH * PGM_WIDTH; p++)
+            fputc(p < num_pages ? (int) (255 * covered[p] / pagesize) : 0, fp);
+        fclose(fp);
+    }
+    free(covered);
+}
+
+/*
+ * bar - Print a bar of a '#', b '.' and c '~' characters' worth, out of scale, and end the line
+ */
+static void bar(uint64_t a, uint64_t b, uint64_t c, uint64_t scale)
+{
+    int na = BAR * a / scale, nb = BAR * (a + b) / scale - na, nc = BAR * (a + b + c) / scale - na - nb;
+
+    printf("%.*s%.*s%.*s\n", na, "########################################", nb, "........................................",
+           nc, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~");
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: heapviz [-h] [-n <map>] [-p <pagesize>] [-o <file.pgm>] <heap map file>\n");
+    fprintf(stderr, "Shows where the space of the heap goes in maps written by mm_dump_heap (mdriver -m).\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-n <map>   Map to show the free blocks and pages of (default: the last one).\n");
+    fprintf(stderr, "\t-o <file>  Also write the page occupancy as a PGM image, a pixel per page.\n");
+    fprintf(stderr, "\t-p <size>  Page size (default 4096).\n");
+}
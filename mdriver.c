@@ -14,12 +14,21 @@
 #include <string.h>
 #include <assert.h>
 #include <float.h>
+#include <limits.h>
 #include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef MM_THREAD_SAFE
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
 #include "config.h"
+#include "trace.h"
 
 #ifdef USE_CALLGRIND
 #include <valgrind/callgrind.h>
@@ -34,6 +43,25 @@
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
 
+/* Lifetime hints (-L) */
+#define HINTS_NONE  0    /* plain mm_malloc */
+#define HINTS_TRACE 1    /* hint each block with its lifetime in the trace */
+#define HINTS_AUTO  2    /* let the mm package predict lifetimes */
+#define SHORT_LIVED_FRACTION 16 /* blocks freed within num_ops/this ops are short-lived */
+
+/* Tuning mode (-T): objectives and search */
+#define TUNE_PERF   1    /* maximize the perf index */
+#define TUNE_P99    2    /* minimize the 99th percentile latency of a request */
+#define TUNE_HEAP   3    /* minimize the peak heap size, summed over the traces */
+#define TUNE_ETA    3    /* successive halving keeps 1/TUNE_ETA of the candidates per round */
+
+/* Heap maps (-m) */
+#define HEAP_MAPS   64   /* maps written per trace, besides the one at its end */
+
+/* Multi-threaded replay (-P) */
+#define MAX_THREADS TRACE_MAX_THREADS /* max thread id in a trace + 1, and max threads of -P */
+#define PAR_RUNS     5   /* runs per thread count, of which the fastest is kept */
+
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((unsigned long)(p)) % ALIGNMENT) == 0)
 
@@ -48,20 +76,17 @@ typedef struct range_t {
     struct range_t *next;  /* next list element */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
-typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
-    int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
-} traceop_t;
-
 /* Holds the information for one trace file*/
 typedef struct {
-    int sugg_heapsize;   /* suggested heap size (unused) */
+    int sugg_heapsize;   /* suggested heap size (reserved up front by -r) */
     int num_ids;         /* number of alloc/realloc ids */
     int num_ops;         /* number of distinct requests */
     int weight;          /* weight for this trace (unused) */
-    traceop_t *ops;      /* array of requests */
+    int num_threads;     /* max thread id of the requests + 1 */
+    traceop_t *ops;      /* array of requests (traceop_t is in trace.h) */
+    char *hints;         /* lifetime hint of each request for mm_malloc_hint (NULL without -L) */
+    void *map;           /* a binary trace file is mapped here, ops pointing into it... */
+    size_t map_size;     /* ... and this long (NULL and 0 for a text trace) */
     char **blocks;       /* array of ptrs returned by malloc/realloc... */
     size_t *block_sizes; /* ... and a corresponding array of payload sizes */
 } trace_t;
@@ -74,6 +99,8 @@ typedef struct {
 typedef struct {
     trace_t *trace;
     range_t *ranges;
+    int start;           /* first request timed; those before it are in the heap snapshot (-w) */
+    char **warm_blocks;  /* trace->blocks as of the snapshot */
 } speed_t;
 
 /* Summarizes the important stats for some malloc function on some trace */
@@ -93,12 +120,61 @@ typedef struct {
  * Global variables
  *******************/
 int verbose = 0;        /* global flag for verbose output */
+static int reserve = 0; /* reserve the suggested heap size after mm_init (-r) */
+static int hints = HINTS_NONE; /* lifetime hints passed to the mm package (-L) */
+static int warm = 0;    /* percentage of each trace replayed before timing starts (-w) */
+static int stats_format = -1; /* print the mm counters after each trace in this format (-s) */
+static char *events_file = NULL; /* write the events traced by the mm package here (-e) */
+static FILE *map_fp = NULL; /* write maps of the heap during eval_mm_util here (-m) */
 static int errors = 0;  /* number of errs found when running student malloc */
 char msg[2*MAXLINE];    /* for whenever we need to compose an error message */
                         /* this needs to be larger than MAXLINE because some
 			   error messages contain paths that are only limited
 			   by MAXLINE. */
 
+/* Values the tuning mode (-T) tries for each parameter of the mm package (mm_params_t) */
+static const size_t grid_init_chunk[] = { 1<<6, 1<<12 };
+static const size_t grid_chunk[] = { 1<<10, 1<<12, 1<<14 };
+static const size_t grid_max_chunk[] = { 1<<18, 1<<20 };
+static const size_t grid_realloc_pad[] = { 0, 1<<6, 1<<7, 1<<8, 1<<9 };
+static const size_t grid_split_min[] = { 32, 64, 128 };
+#define GRID_LEN(a) (sizeof(a) / sizeof(a[0]))
+
+/* A point of the parameter space and what it scored */
+typedef struct {
+    mm_params_t params;
+    double cost;         /* objective on the traces of the last round, lower is better */
+} candidate_t;
+
+#ifdef MM_THREAD_SAFE
+/* A request of the multi-threaded replay (-P), in the order its worker issues them */
+typedef struct {
+    traceop_t *op;       /* the request in the trace */
+    int index;           /* its block in par_t.blocks (the copy of the trace it belongs to) */
+    int dep_worker;      /* the last request on that block came from this other worker (-1: none)... */
+    int dep_seq;         /* ... as its dep_seq-th request, and must be done first */
+} parop_t;
+
+/* A thread of the multi-threaded replay; done is polled by the others, so each gets its own cache line */
+typedef struct {
+    parop_t *ops;        /* its requests */
+    int num_ops;
+    int done;            /* number of them done so far */
+    pthread_t thread;
+    struct par_t *par;
+} __attribute__((aligned(64))) worker_t;
+
+/* A multi-threaded replay of a trace */
+typedef struct par_t {
+    trace_t *trace;
+    int num_workers;
+    worker_t *workers;
+    char **blocks;       /* the blocks of each copy of the trace */
+    int start;           /* set to let the workers go */
+    int failed;          /* set when a request fails, to stop them */
+} par_t;
+#endif
+
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
 
@@ -120,7 +196,9 @@ static void clear_ranges(range_t **ranges);
 
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(char *tracedir, char *filename);
+static int map_trace(trace_t *trace, char *path);
 static void free_trace(trace_t *trace);
+static void set_hints(trace_t *trace);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace, int tracenum);
@@ -135,9 +213,27 @@ double fsecs_callgrind(fsecs_test_funct f, void *argp);
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
 static void eval_mm_speed(void *ptr);
+static void warm_mm(speed_t *speed);
+static void replay_mm(trace_t *trace, int lo, int hi);
+static void print_mm_policy(void);
+static int init_mm(trace_t *trace);
+static void tune(char **tracefiles, int n, int objective, int halving, char *outfile);
+static double tune_cost(trace_t **traces, int n, int objective);
+static void latency_mm(trace_t *trace, double *lat);
+static int cmp_candidate(const void *a, const void *b);
+static int cmp_double(const void *a, const void *b);
+static void *mm_malloc_op(trace_t *trace, int i);
+#ifdef MM_THREAD_SAFE
+static void scale(char **tracefiles, int n, int max_threads);
+static void plan_par(par_t *par, trace_t *trace, int num_workers);
+static double run_par(par_t *par);
+static void *worker_main(void *arg);
+static void free_par(par_t *par);
+#endif
 
 /* Various helper routines */
 static double printresults(int n, stats_t *stats);
+static void perf_points(double util, double throughput, double *p1, double *p2);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -163,6 +259,12 @@ int main(int argc, char **argv)
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
     int use_cgrind = 0;  /* If set, support callgrind measurement (-c) */
+    int objective = 0;   /* If set, tune the mm parameters for this objective (-T) */
+    int halving = 1;     /* Tune by successive halving rather than the full grid (-S) */
+    char *params_out = "mm.conf"; /* where -T writes the best parameters (-o) */
+#ifdef MM_THREAD_SAFE
+    int max_threads = 0; /* If set, replay the traces on 1 to this many threads (-P) */
+#endif
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
@@ -172,7 +274,7 @@ int main(int argc, char **argv)
     /*
      * Read and interpret the command line arguments
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgacl")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:hvVgaclrL:w:C:T:S:o:s:e:m:P:")) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -208,6 +310,86 @@ int main(int argc, char **argv)
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 'r': /* Reserve the suggested heap size up front */
+            reserve = 1;
+            break;
+        case 'L': /* Pass lifetime hints to the mm package */
+            if (!strcmp(optarg, "trace"))
+                hints = HINTS_TRACE;
+            else if (!strcmp(optarg, "auto"))
+                hints = HINTS_AUTO;
+            else {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'w': /* Time the runs from a heap warmed up by a prefix of the trace */
+            warm = atoi(optarg);
+            if (warm < 0 || warm > 100) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'C': /* Load the parameters of the mm package from a file */
+            if (mm_load_params(optarg) < 0) {
+                printf("ERROR: could not load the parameters in %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'T': /* Tune the parameters of the mm package */
+            if (!strcmp(optarg, "perf"))
+                objective = TUNE_PERF;
+            else if (!strcmp(optarg, "p99"))
+                objective = TUNE_P99;
+            else if (!strcmp(optarg, "heap"))
+                objective = TUNE_HEAP;
+            else {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'S': /* Search strategy of -T */
+            if (!strcmp(optarg, "grid"))
+                halving = 0;
+            else if (!strcmp(optarg, "halving"))
+                halving = 1;
+            else {
+                usage();
+                exit(1);
+            }
+            break;
+        case 's': /* Print the counters of the mm package */
+            if (!strcmp(optarg, "text"))
+                stats_format = MM_STATS_TEXT;
+            else if (!strcmp(optarg, "json"))
+                stats_format = MM_STATS_JSON;
+            else {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'm': /* Write maps of the heap */
+            if ((map_fp = fopen(optarg, "w")) == NULL)
+                unix_error("Could not open the heap map file");
+            break;
+        case 'e': /* Write the events traced by the mm package */
+            events_file = optarg;
+            break;
+        case 'P': /* Replay the traces on more and more threads */
+#ifdef MM_THREAD_SAFE
+            max_threads = atoi(optarg);
+            if (max_threads < 1 || max_threads > MAX_THREADS) {
+                usage();
+                exit(1);
+            }
+#else
+            printf("ERROR: -P needs the thread-safe driver (make mdriver-mt)\n");
+            exit(1);
+#endif
+            break;
+        case 'o': /* Output file of -T */
+            params_out = optarg;
+            break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -263,6 +445,20 @@ int main(int argc, char **argv)
     if (!use_cgrind)
 	init_fsecs();
 
+    /* In tuning mode, search the parameter space instead */
+    if (objective) {
+	tune(tracefiles, num_tracefiles, objective, halving, params_out);
+	exit(0);
+    }
+
+#ifdef MM_THREAD_SAFE
+    /* In the multi-threaded mode, measure how the throughput scales instead */
+    if (max_threads) {
+	scale(tracefiles, num_tracefiles, max_threads);
+	exit(0);
+    }
+#endif
+
     /*
      * Optionally run and evaluate the libc malloc package
      */
@@ -324,8 +520,11 @@ int main(int argc, char **argv)
     if (mm_stats == NULL)
 	unix_error("mm_stats calloc in main failed");
 
-    /* Initialize the simulated memory system in memlib.c */
-    mem_init();
+    /* Initialize the simulated memory system in memlib.c; snapshots (-w) need a shared heap */
+    if (!warm)
+	mem_init();
+    else if (mem_init_shared() < 0)
+	unix_error("mem_init_shared failed in main");
 
     /* Evaluate student's mm malloc package using the K-best scheme */
     for (i=0; i < num_tracefiles; i++) {
@@ -346,9 +545,22 @@ int main(int argc, char **argv)
 		mm_stats[i].util = 1.0;
 	    } else {
 		mm_stats[i].util = eval_mm_util(trace, i, &ranges);
+		if (verbose > 1)
+		    print_mm_policy();
+		if (stats_format >= 0) {
+		    if (stats_format == MM_STATS_TEXT)
+			printf("\nCounters of the mm package after %s:\n", tracefiles[i]);
+		    fflush(stdout);
+		    mm_print_stats(stdout, stats_format);
+		}
 	    }
 	    speed_params.trace = trace;
 	    speed_params.ranges = ranges;
+	    speed_params.start = 0;
+	    if (warm) {
+		warm_mm(&speed_params);
+		mm_stats[i].ops = trace->num_ops - speed_params.start;
+	    }
 	    if (verbose > 1)
 		fl_puts("and performance");
 	    if (use_cgrind)
@@ -358,11 +570,25 @@ int main(int argc, char **argv)
 		mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
 	    if (verbose > 1)
 		fl_puts(".\n");
-
+	    if (warm)
+		free(speed_params.warm_blocks);
 	}
 	free_trace(trace);
     }
 
+    if (map_fp != NULL)
+	fclose(map_fp);
+
+    /* Write the last events of the mm package (built with -DMM_TRACE) as a Chrome trace */
+    if (events_file != NULL) {
+	FILE *fp = fopen(events_file, "w");
+
+	if (fp == NULL || mm_dump_trace(fp, MM_TRACE_JSON) < 0)
+	    printf("ERROR: could not write the events to %s (is mm.c built with -DMM_TRACE?)\n", events_file);
+	if (fp != NULL)
+	    fclose(fp);
+    }
+
     /* Display the mm results in a compact table */
     if (verbose) {
 	printf("\nResults for mm malloc:\n");
@@ -394,15 +620,7 @@ int main(int argc, char **argv)
 	    libc_kops*1000 <= 1.1*AVG_LIBC_THRUPUT) {
 	    avg_mm_throughput = ops/secs;
 
-	    p1 = UTIL_POINTS * avg_mm_util;
-	    if (avg_mm_throughput > AVG_LIBC_THRUPUT) {
-		p2 = THRU_POINTS;
-	    }
-	    else {
-		p2 = ((double)THRU_POINTS) *
-		    (avg_mm_throughput/AVG_LIBC_THRUPUT);
-	    }
-
+	    perf_points(avg_mm_util, avg_mm_throughput, &p1, &p2);
 	    perfindex = p1 + p2;
 	    printf("Estimated perf index = "
 		   "%.0f/%d (util) + %.0f/%d (thru) = %.0f/%d\n",
@@ -555,7 +773,9 @@ static void clear_ranges(range_t **ranges)
  *********************************************/
 
 /*
- * read_trace - read a trace file and store it in memory
+ * read_trace - read a trace file and store it in memory. A request line
+ *     may end with the id of the thread that issues it (-P), 0 if not.
+ *     A binary trace (trace.h) is mapped instead.
  */
 static trace_t *read_trace(char *tracedir, char *filename)
 {
@@ -563,9 +783,12 @@ static trace_t *read_trace(char *tracedir, char *filename)
     trace_t *trace;
     char type[MAXLINE];
     char path[MAXLINE];
+    char line[MAXLINE];
+    char magic[sizeof(TRACE_MAGIC) - 1];
     int num_read;
-    unsigned index, size;
+    unsigned index, size, thread;
     unsigned max_index = 0;
+    unsigned max_thread = 0;
     unsigned op_index;
 
     if (verbose > 1) {
@@ -584,7 +807,25 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	sprintf(msg, "Could not open %s in read_trace", path);
 	unix_error(msg);
     }
-    num_read = fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
+    trace->hints = NULL;
+    if (fread(magic, 1, sizeof(magic), tracefile) == sizeof(magic) &&
+	!memcmp(magic, TRACE_MAGIC, sizeof(magic))) {
+	fclose(tracefile);
+	if (map_trace(trace, path) < 0) {
+	    printf("Bad binary tracefile %s\n", path);
+	    exit(1);
+	}
+	if (hints != HINTS_NONE)
+	    set_hints(trace);
+	if (verbose > 1)
+	    printf("done\n");
+	return trace;
+    }
+    rewind(tracefile);
+    trace->map = NULL;
+    trace->map_size = 0;
+
+    num_read = fscanf(tracefile, "%d", &(trace->sugg_heapsize));
     assert(num_read == 1);
     num_read = fscanf(tracefile, "%d", &(trace->num_ids));
     assert(num_read == 1);
@@ -592,6 +833,10 @@ static trace_t *read_trace(char *tracedir, char *filename)
     assert(num_read == 1);
     num_read = fscanf(tracefile, "%d", &(trace->weight));        /* not used */
     assert(num_read == 1);
+    if (trace->num_ids > TRACE_MAX_IDS) {
+	printf("Too many ids (%d) in tracefile %s\n", trace->num_ids, path);
+	exit(1);
+    }
 
     /* We'll store each request line in the trace in this array */
     if ((trace->ops =
@@ -630,7 +875,7 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	    max_index = (index > max_index) ? index : max_index;
 	    break;
 	case 'f':
-	    num_read = fscanf(tracefile, "%ud", &index);
+	    num_read = fscanf(tracefile, "%u", &index);
 	    assert(num_read == 1);
 	    trace->ops[op_index].type = FREE;
 	    trace->ops[op_index].index = index;
@@ -640,12 +885,25 @@ static trace_t *read_trace(char *tracedir, char *filename)
 		   type[0], path);
 	    exit(1);
 	}
+	/* The rest of the line is the thread that issues the request, if any */
+	if (fgets(line, MAXLINE, tracefile) == NULL ||
+	    sscanf(line, "%u", &thread) != 1)
+	    thread = 0;
+	if (thread >= MAX_THREADS) {
+	    printf("Thread id %u out of range in tracefile %s\n", thread, path);
+	    exit(1);
+	}
+	trace->ops[op_index].thread = thread;
+	max_thread = (thread > max_thread) ? thread : max_thread;
 	op_index++;
 
     }
     fclose(tracefile);
     assert(max_index == trace->num_ids - 1);
     assert(trace->num_ops == op_index);
+    trace->num_threads = max_thread + 1;
+    if (hints != HINTS_NONE)
+	set_hints(trace);
     if (verbose > 1)
 	printf("done\n");
 
@@ -653,12 +911,121 @@ static trace_t *read_trace(char *tracedir, char *filename)
 }
 
 /*
- * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
+ * map_trace - Map the binary trace file at path (trace.h) and point the
+ *     requests of the trace into it, so that it's replayed in place
+ *     without being parsed or copied. The requests are checked once
+ *     (ids, types, threads, and that each block is allocated before it
+ *     is reallocated or freed), since the replay trusts them. Returns -1
+ *     if it's not a valid one.
+ */
+static int map_trace(trace_t *trace, char *path)
+{
+    trace_header_t *hdr;
+    traceop_t *op;
+    char *live;
+    struct stat st;
+    int fd, i, ok;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+	return -1;
+    if (fstat(fd, &st) < 0 || st.st_size < sizeof(trace_header_t) ||
+	(trace->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+	close(fd);
+	return -1;
+    }
+    close(fd);
+    trace->map_size = st.st_size;
+    hdr = (trace_header_t *)trace->map;
+    if (hdr->op_size != sizeof(traceop_t) || hdr->num_ids > TRACE_MAX_IDS ||
+	hdr->num_threads > TRACE_MAX_THREADS || hdr->num_ops > INT_MAX ||
+	hdr->sugg_heapsize > INT_MAX ||
+	hdr->num_ops > (trace->map_size - sizeof(trace_header_t)) / sizeof(traceop_t)) {
+	munmap(trace->map, trace->map_size);
+	return -1;
+    }
+    madvise(trace->map, trace->map_size, MADV_WILLNEED);
+
+    trace->sugg_heapsize = hdr->sugg_heapsize;
+    trace->num_ids = hdr->num_ids;
+    trace->num_ops = hdr->num_ops;
+    trace->weight = hdr->weight;
+    trace->num_threads = hdr->num_threads ? hdr->num_threads : 1;
+    trace->ops = (traceop_t *)(hdr + 1);
+
+    if ((live = (char *)calloc(trace->num_ids, 1)) == NULL)
+	unix_error("calloc failed in map_trace");
+    for (i = 0, ok = 1; ok && i < trace->num_ops; i++) {
+	op = &trace->ops[i];
+	if (op->index >= trace->num_ids || op->thread >= trace->num_threads ||
+	    op->type > REALLOC || live[op->index] != (op->type != ALLOC))
+	    ok = 0;
+	else if (op->type != REALLOC)
+	    live[op->index] = (op->type == ALLOC);
+    }
+    free(live);
+    if (!ok) {
+	printf("Bad request %d in binary tracefile %s\n", i - 1, path);
+	munmap(trace->map, trace->map_size);
+	return -1;
+    }
+
+    if ((trace->blocks = (char **)malloc(trace->num_ids * sizeof(char *))) == NULL ||
+	(trace->block_sizes = (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+	unix_error("malloc failed in map_trace");
+    return 0;
+}
+
+/*
+ * set_hints - Fill in the lifetime hints of the alloc requests: with
+ *     -L trace, a block freed within num_ops/SHORT_LIVED_FRACTION
+ *     requests of its allocation is short-lived, any other block
+ *     long-lived. With -L auto, the mm package predicts them.
+ */
+static void set_hints(trace_t *trace)
+{
+    int *birth;
+    int i, index;
+
+    if ((trace->hints = (char *)calloc(trace->num_ops, 1)) == NULL)
+	unix_error("calloc failed in set_hints");
+    if (hints == HINTS_AUTO) {
+	for (i = 0; i < trace->num_ops; i++)
+	    if (trace->ops[i].type == ALLOC)
+		trace->hints[i] = MM_LIFETIME_AUTO;
+	return;
+    }
+
+    if ((birth = (int *)calloc(trace->num_ids, sizeof(int))) == NULL)
+	unix_error("calloc failed in set_hints");
+    for (i = 0; i < trace->num_ops; i++) {
+	index = trace->ops[i].index;
+	switch (trace->ops[i].type) {
+	case ALLOC:
+	    birth[index] = i;
+	    trace->hints[i] = MM_LONG_LIVED;
+	    break;
+	case FREE:
+	    if (i - birth[index] < trace->num_ops / SHORT_LIVED_FRACTION)
+		trace->hints[birth[index]] = MM_SHORT_LIVED;
+	    break;
+	default:
+	    break;
+	}
+    }
+    free(birth);
+}
+
+/*
+ * free_trace - Free the trace record and the arrays it points to, all
+ *              of which were allocated (or mapped) in read_trace().
  */
 void free_trace(trace_t *trace)
 {
-    free(trace->ops);         /* free the three arrays... */
+    if (trace->map != NULL)   /* free the arrays... */
+	munmap(trace->map, trace->map_size);
+    else
+	free(trace->ops);
+    free(trace->hints);
     free(trace->blocks);
     free(trace->block_sizes);
     free(trace);              /* and the trace record itself... */
@@ -669,6 +1036,30 @@ void free_trace(trace_t *trace)
  * and throughput of the libc and mm malloc packages.
  **********************************************************************/
 
+/*
+ * init_mm - Call the mm package's init function and, with -r, reserve
+ *    (and prefault) the heap size suggested by the trace
+ */
+static int init_mm(trace_t *trace)
+{
+    if (mm_init() < 0)
+	return -1;
+    if (reserve && mm_reserve(trace->sugg_heapsize, MM_RESERVE_PREFAULT) < 0)
+	return -1;
+    return 0;
+}
+
+/*
+ * mm_malloc_op - Call mm_malloc for alloc request i of the trace, or
+ *    mm_malloc_hint if the request carries a lifetime hint (-L)
+ */
+static void *mm_malloc_op(trace_t *trace, int i)
+{
+    if (trace->hints != NULL && trace->hints[i])
+	return mm_malloc_hint(trace->ops[i].size, trace->hints[i]);
+    return mm_malloc(trace->ops[i].size);
+}
+
 /*
  * eval_mm_valid - Check the mm malloc package for correctness
  */
@@ -687,7 +1078,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
     clear_ranges(ranges);
 
     /* Call the mm package's init function */
-    if (mm_init() < 0) {
+    if (init_mm(trace) < 0) {
 	malloc_error(tracenum, 0, "mm_init failed.");
 	return 0;
     }
@@ -702,7 +1093,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
         case ALLOC: /* mm_malloc */
 
 	    /* Call the student's malloc */
-	    if ((p = mm_malloc(size)) == NULL) {
+	    if ((p = mm_malloc_op(trace, i)) == NULL) {
 		malloc_error(tracenum, i, "mm_malloc failed.");
 		return 0;
 	    }
@@ -805,17 +1196,19 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 
     /* initialize the heap and the mm malloc package */
     mem_reset_brk();
-    if (mm_init() < 0)
+    if (init_mm(trace) < 0)
 	app_error("mm_init failed in eval_mm_util");
 
     for (i = 0;  i < trace->num_ops;  i++) {
+	if (map_fp != NULL && i % (trace->num_ops / HEAP_MAPS + 1) == 0)
+	    mm_dump_heap(map_fp, i);
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_alloc */
 	    index = trace->ops[i].index;
 	    size = trace->ops[i].size;
 
-	    if ((p = mm_malloc(size)) == NULL)
+	    if ((p = mm_malloc_op(trace, i)) == NULL)
 		app_error("mm_malloc failed in eval_mm_util");
 
 	    /* Remember region and size */
@@ -871,6 +1264,8 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 
         }
     }
+    if (map_fp != NULL)
+	mm_dump_heap(map_fp, trace->num_ops);
 
     return ((double)max_total_size / (double)mem_heapsize());
 }
@@ -878,27 +1273,66 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 
 /*
  * eval_mm_speed - This is the function that is used by fcyc()
- *    to measure the running time of the mm malloc package.
+ *    to measure the running time of the mm malloc package. With -w,
+ *    the run starts from the snapshot taken by warm_mm.
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index, size, newsize;
-    char *p, *newp, *oldp, *block;
-    trace_t *trace = ((speed_t *)ptr)->trace;
+    speed_t *speed = (speed_t *)ptr;
+    trace_t *trace = speed->trace;
+
+    if (speed->start > 0) {
+	/* Go back to the warmed up heap, which the mm package picks up again */
+	if (mem_restore() < 0 || mm_init() < 0)
+	    app_error("mem_restore failed in eval_mm_speed");
+	memcpy(trace->blocks, speed->warm_blocks,
+	       trace->num_ids * sizeof(char *));
+    } else {
+	/* Reset the heap and initialize the mm package */
+	mem_reset_brk();
+	if (init_mm(trace) < 0)
+	    app_error("mm_init failed in eval_mm_speed");
+    }
+    replay_mm(trace, speed->start, trace->num_ops);
+}
+
+/*
+ * warm_mm - Replay the first warm percent of the trace (-w) and take a
+ *    snapshot of the heap, so that the timed runs start from a heap in a
+ *    steady state rather than an empty one and only the rest of the trace
+ *    is timed
+ */
+static void warm_mm(speed_t *speed)
+{
+    trace_t *trace = speed->trace;
 
-    /* Reset the heap and initialize the mm package */
+    speed->start = (int)((long)trace->num_ops * warm / 100);
     mem_reset_brk();
-    if (mm_init() < 0)
-	app_error("mm_init failed in eval_mm_speed");
+    if (init_mm(trace) < 0)
+	app_error("mm_init failed in warm_mm");
+    replay_mm(trace, 0, speed->start);
+    if (mem_snapshot() < 0)
+	unix_error("mem_snapshot failed in warm_mm");
+    if ((speed->warm_blocks = malloc(trace->num_ids * sizeof(char *))) == NULL)
+	unix_error("malloc failed in warm_mm");
+    memcpy(speed->warm_blocks, trace->blocks, trace->num_ids * sizeof(char *));
+}
+
+/*
+ * replay_mm - Run requests lo to hi-1 of the trace through the mm package
+ */
+static void replay_mm(trace_t *trace, int lo, int hi)
+{
+    int i, index, newsize;
+    char *p, *newp, *oldp, *block;
 
     /* Interpret each trace request */
-    for (i = 0;  i < trace->num_ops;  i++)
+    for (i = lo;  i < hi;  i++)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_malloc */
             index = trace->ops[i].index;
-            size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
+            if ((p = mm_malloc_op(trace, i)) == NULL)
 		app_error("mm_malloc error in eval_mm_speed");
             trace->blocks[index] = p;
             break;
@@ -923,6 +1357,433 @@ static void eval_mm_speed(void *ptr)
         }
 }
 
+/*
+ * print_mm_policy - Print the placement policy transitions that the
+ *    mm package went through during the last run
+ */
+static void print_mm_policy(void)
+{
+    mm_stats_t st;
+    int i;
+
+    mm_get_stats(&st);
+    printf("\n  policy %s, chunk %lu, frag %.2f, search %.1f, %lu transitions\n",
+	   st.policy == MM_POLICY_FAST ? "fast" : "dense",
+	   (unsigned long)st.chunksize, st.frag, st.avg_search,
+	   st.transitions);
+    for (i = 0; i < st.num_log; i++)
+	printf("    op %lu: %s -> %s (frag %.2f, search %.1f)\n",
+	       st.log[i].op,
+	       st.log[i].from == MM_POLICY_FAST ? "fast" : "dense",
+	       st.log[i].to == MM_POLICY_FAST ? "fast" : "dense",
+	       st.log[i].frag, st.log[i].avg_search);
+    fl_puts("  ");
+}
+
+/*
+ * tune - Search the parameters of the mm package (mm_params_t) for the
+ *    ones that do best on the traces by the objective (-T), and write
+ *    them to outfile for mm_load_params. Successive halving runs every
+ *    point of the grid on the first few traces, keeps the best
+ *    1/TUNE_ETA of them and runs those on TUNE_ETA times as many traces,
+ *    until the survivors have run on all of them; -S grid runs every
+ *    point on every trace.
+ */
+static void tune(char **tracefiles, int n, int objective, int halving, char *outfile)
+{
+    trace_t **traces;
+    candidate_t *cands;
+    range_t *ranges = NULL;
+    mm_params_t p, defaults;
+    double default_cost, sign = (objective == TUNE_PERF) ? -1 : 1;
+    int num_cands = 0, live, used, round, i, a, b, c, d, e;
+    char *unit = (objective == TUNE_PERF) ? "" :
+	(objective == TUNE_P99) ? " ns" : " bytes";
+
+    if ((traces = malloc(n * sizeof(trace_t *))) == NULL)
+	unix_error("malloc failed in tune");
+    for (i = 0; i < n; i++)
+	traces[i] = read_trace(tracedir, tracefiles[i]);
+    if ((cands = malloc(GRID_LEN(grid_init_chunk) * GRID_LEN(grid_chunk) *
+			GRID_LEN(grid_max_chunk) * GRID_LEN(grid_realloc_pad) *
+			GRID_LEN(grid_split_min) * sizeof(candidate_t))) == NULL)
+	unix_error("malloc failed in tune");
+
+    mem_init();
+    mm_get_params(&defaults);
+    p = defaults;
+    for (a = 0; a < GRID_LEN(grid_init_chunk); a++)
+	for (b = 0; b < GRID_LEN(grid_chunk); b++)
+	    for (c = 0; c < GRID_LEN(grid_max_chunk); c++)
+		for (d = 0; d < GRID_LEN(grid_realloc_pad); d++)
+		    for (e = 0; e < GRID_LEN(grid_split_min); e++) {
+			p.init_chunk = grid_init_chunk[a];
+			p.chunk = grid_chunk[b];
+			p.max_chunk = grid_max_chunk[c];
+			p.realloc_pad = grid_realloc_pad[d];
+			p.split_min = grid_split_min[e];
+			if (mm_set_params(&p) == 0)
+			    cands[num_cands++].params = p;
+		    }
+    if (num_cands == 0)
+	app_error("ERROR: no valid parameters in the grid");
+
+    used = halving ? (n + TUNE_ETA*TUNE_ETA - 1) / (TUNE_ETA*TUNE_ETA) : n;
+    live = num_cands;
+    for (round = 1; ; round++) {
+	if (verbose)
+	    printf("Round %d: %d candidates on %d traces\n", round, live, used);
+	for (i = 0; i < live; i++) {
+	    mm_set_params(&cands[i].params);
+	    cands[i].cost = tune_cost(traces, used, objective);
+	}
+	qsort(cands, live, sizeof(candidate_t), cmp_candidate);
+	if (used == n)
+	    break;
+	live = (live + TUNE_ETA - 1) / TUNE_ETA;
+	used = (used * TUNE_ETA < n) ? used * TUNE_ETA : n;
+    }
+
+    /* Measure the defaults for comparison, now that the heap is warm too */
+    mm_set_params(&defaults);
+    default_cost = tune_cost(traces, n, objective);
+
+    /* Make sure the winner is correct before handing it out */
+    mm_set_params(&cands[0].params);
+    for (i = 0; i < n; i++)
+	if (!eval_mm_valid(traces[i], i, &ranges))
+	    app_error("ERROR: the best parameters fail a trace");
+    if (mm_save_params(outfile) < 0)
+	unix_error("ERROR: could not write the parameters");
+
+    p = cands[0].params;
+    printf("Best of %d candidates: init_chunk %lu, chunk %lu, max_chunk %lu, "
+	   "realloc_pad %lu, split_min %lu\n", num_cands,
+	   (unsigned long)p.init_chunk, (unsigned long)p.chunk,
+	   (unsigned long)p.max_chunk, (unsigned long)p.realloc_pad,
+	   (unsigned long)p.split_min);
+    printf("Objective: %.0f%s (defaults: %.0f%s), written to %s\n",
+	   sign * cands[0].cost, unit, sign * default_cost, unit, outfile);
+
+    clear_ranges(&ranges);
+    for (i = 0; i < n; i++)
+	free_trace(traces[i]);
+    free(traces);
+    free(cands);
+}
+
+/*
+ * tune_cost - Run the first n traces with the current parameters and
+ *    return the objective of -T, negated if it is to be maximized
+ */
+static double tune_cost(trace_t **traces, int n, int objective)
+{
+    speed_t speed;
+    double util = 0, ops = 0, secs = 0, heap = 0, p1, p2, cost, *lat = NULL;
+    long num_lat = 0;
+    int i;
+
+    if (objective == TUNE_P99) {
+	for (i = 0; i < n; i++)
+	    num_lat += traces[i]->num_ops;
+	if ((lat = malloc(num_lat * sizeof(double))) == NULL)
+	    unix_error("malloc failed in tune_cost");
+	num_lat = 0;
+    }
+    for (i = 0; i < n; i++) {
+	switch (objective) {
+	case TUNE_PERF:
+	    util += eval_mm_util(traces[i], i, NULL);
+	    speed.trace = traces[i];
+	    speed.ranges = NULL;
+	    speed.start = 0;
+	    secs += fsecs(eval_mm_speed, &speed);
+	    ops += traces[i]->num_ops;
+	    break;
+	case TUNE_P99:
+	    latency_mm(traces[i], lat + num_lat);
+	    num_lat += traces[i]->num_ops;
+	    break;
+	default:
+	    eval_mm_util(traces[i], i, NULL);
+	    heap += mem_heapsize();
+	}
+    }
+
+    switch (objective) {
+    case TUNE_PERF:
+	perf_points(util / n, ops / secs, &p1, &p2);
+	cost = -(p1 + p2);
+	break;
+    case TUNE_P99:
+	qsort(lat, num_lat, sizeof(double), cmp_double);
+	cost = num_lat ? lat[(long)(0.99 * (num_lat - 1))] : 0;
+	free(lat);
+	break;
+    default:
+	cost = heap;
+    }
+    return cost;
+}
+
+/*
+ * latency_mm - Run the trace through the mm package, timing each
+ *    request on its own, and store the times (ns) in lat
+ */
+static void latency_mm(trace_t *trace, double *lat)
+{
+    struct timespec t0, t1;
+    int i;
+
+    mem_reset_brk();
+    if (init_mm(trace) < 0)
+	app_error("mm_init failed in latency_mm");
+    for (i = 0; i < trace->num_ops; i++) {
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	replay_mm(trace, i, i + 1);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	lat[i] = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+    }
+}
+
+static int cmp_candidate(const void *a, const void *b)
+{
+    double x = ((const candidate_t *)a)->cost, y = ((const candidate_t *)b)->cost;
+
+    return (x > y) - (x < y);
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+#ifdef MM_THREAD_SAFE
+/*
+ * scale - Replay each trace on 1 to max_threads threads (-P) and print
+ *    the aggregate throughput, and the speedup over a single thread, for
+ *    each number of threads (with -v, for each trace as well). The
+ *    requests of a trace with thread ids go to thread (id modulo the
+ *    number of threads); a trace without them is run as one copy per
+ *    thread, each copy with blocks of its own.
+ */
+static void scale(char **tracefiles, int n, int max_threads)
+{
+    trace_t *trace;
+    par_t par;
+    stats_t *stats, run;
+    double base;
+    int i, k;
+
+    if ((stats = (stats_t *)calloc(max_threads + 1, sizeof(stats_t))) == NULL)
+	unix_error("calloc failed in scale");
+    for (k = 1; k <= max_threads; k++)
+	stats[k].valid = 1;
+
+    mem_init();
+    for (i = 0; i < n; i++) {
+	trace = read_trace(tracedir, tracefiles[i]);
+	if (verbose) {
+	    printf("\n%s: %d thread%s%s\n", tracefiles[i], trace->num_threads,
+		   trace->num_threads > 1 ? "s" : "",
+		   trace->num_threads > 1 ? "" : ", one copy per thread");
+	    printf("%7s%10s%10s%8s%8s\n", "threads", "ops", "secs", "Kops", "speedup");
+	}
+	base = 0;
+	for (k = 1; k <= max_threads; k++) {
+	    plan_par(&par, trace, k);
+	    run.ops = (double)trace->num_ops * (trace->num_threads > 1 ? 1 : k);
+	    run.secs = run_par(&par);
+	    run.valid = run.secs > 0;
+	    free_par(&par);
+	    if (!run.valid) {
+		stats[k].valid = 0;
+		if (verbose)
+		    printf("%7d%10s%10s%8s%8s\n", k, "-", "-", "-", "-");
+		continue;
+	    }
+	    stats[k].ops += run.ops;
+	    stats[k].secs += run.secs;
+	    if (k == 1)
+		base = run.ops / run.secs;
+	    if (verbose)
+		printf("%7d%10.0f%10.6f%8.0f%8.2f\n", k, run.ops, run.secs,
+		       (run.ops/1e3)/run.secs, base ? run.ops/run.secs/base : 0);
+	}
+	free_trace(trace);
+    }
+
+    /* Print the aggregate results for the set of traces */
+    printf("\nMulti-threaded replay of %d trace%s:\n", n, n > 1 ? "s" : "");
+    printf("%7s%10s%10s%8s%8s\n", "threads", "ops", "secs", "Kops", "speedup");
+    for (k = 1; k <= max_threads; k++) {
+	if (!stats[k].valid) {
+	    printf("%7d%10s%10s%8s%8s\n", k, "-", "-", "-", "-");
+	    continue;
+	}
+	printf("%7d%10.0f%10.6f%8.0f", k, stats[k].ops, stats[k].secs,
+	       (stats[k].ops/1e3)/stats[k].secs);
+	if (stats[1].valid)
+	    printf("%8.2f\n", (stats[k].ops/stats[k].secs) /
+		   (stats[1].ops/stats[1].secs));
+	else
+	    printf("%8s\n", "-");
+    }
+    free(stats);
+}
+
+/*
+ * plan_par - Hand the requests of the trace out to num_workers threads.
+ *    A request on a block that another thread touched last depends on
+ *    that thread's request, and waits for it to be done: a block freed
+ *    or reallocated by a thread other than the one that allocated it is
+ *    only ever freed after it was allocated.
+ */
+static void plan_par(par_t *par, trace_t *trace, int num_workers)
+{
+    int copies = (trace->num_threads > 1) ? 1 : num_workers;
+    int num_blocks = copies * trace->num_ids;
+    int *last_worker, *last_seq;
+    worker_t *w;
+    parop_t *op;
+    int c, i, index;
+
+    par->trace = trace;
+    par->num_workers = num_workers;
+    par->failed = 0;
+    if ((par->workers = aligned_alloc(64, num_workers * sizeof(worker_t))) == NULL ||
+	(par->blocks = (char **)calloc(num_blocks, sizeof(char *))) == NULL ||
+	(last_worker = (int *)malloc(num_blocks * sizeof(int))) == NULL ||
+	(last_seq = (int *)malloc(num_blocks * sizeof(int))) == NULL)
+	unix_error("malloc failed in plan_par");
+    memset(par->workers, 0, num_workers * sizeof(worker_t));
+    for (i = 0; i < num_blocks; i++)
+	last_worker[i] = -1;
+
+    /* Count the requests of each thread... */
+    for (c = 0; c < copies; c++)
+	for (i = 0; i < trace->num_ops; i++)
+	    par->workers[copies > 1 ? c : trace->ops[i].thread % num_workers].num_ops++;
+    for (i = 0; i < num_workers; i++) {
+	w = &par->workers[i];
+	w->par = par;
+	if ((w->ops = (parop_t *)malloc(w->num_ops * sizeof(parop_t))) == NULL)
+	    unix_error("malloc failed in plan_par");
+	w->num_ops = 0;
+    }
+
+    /* ... and hand them out in the order of the trace */
+    for (c = 0; c < copies; c++)
+	for (i = 0; i < trace->num_ops; i++) {
+	    w = &par->workers[copies > 1 ? c : trace->ops[i].thread % num_workers];
+	    index = c * trace->num_ids + trace->ops[i].index;
+	    op = &w->ops[w->num_ops];
+	    op->op = &trace->ops[i];
+	    op->index = index;
+	    op->dep_worker = (last_worker[index] >= 0 &&
+			      &par->workers[last_worker[index]] != w) ? last_worker[index] : -1;
+	    op->dep_seq = last_seq[index];
+	    last_worker[index] = w - par->workers;
+	    last_seq[index] = w->num_ops++;
+	}
+    free(last_worker);
+    free(last_seq);
+}
+
+/*
+ * run_par - Replay the trace on the threads planned by plan_par,
+ *    PAR_RUNS times from an empty heap, and return the secs of the
+ *    fastest run (-1 if a request failed)
+ */
+static double run_par(par_t *par)
+{
+    struct timespec t0, t1;
+    double secs, best = DBL_MAX;
+    int r, i;
+
+    for (r = 0; r < PAR_RUNS; r++) {
+	mem_reset_brk();
+	if (init_mm(par->trace) < 0)
+	    app_error("mm_init failed in run_par");
+	par->start = 0;
+	for (i = 0; i < par->num_workers; i++) {
+	    par->workers[i].done = 0;
+	    if (pthread_create(&par->workers[i].thread, NULL, worker_main, &par->workers[i]) != 0)
+		unix_error("pthread_create failed in run_par");
+	}
+
+	/* Time from letting the threads go until the last one is done */
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	__atomic_store_n(&par->start, 1, __ATOMIC_RELEASE);
+	for (i = 0; i < par->num_workers; i++)
+	    pthread_join(par->workers[i].thread, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	if (par->failed)
+	    return -1;
+	secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	best = (secs < best) ? secs : best;
+    }
+    return best;
+}
+
+/*
+ * worker_main - Issue the requests of a thread of the multi-threaded
+ *    replay, each once the request of another thread it depends on is done
+ */
+static void *worker_main(void *arg)
+{
+    worker_t *w = (worker_t *)arg;
+    par_t *par = w->par;
+    parop_t *op;
+    char *p;
+    int i;
+
+    while (!__atomic_load_n(&par->start, __ATOMIC_ACQUIRE))
+	sched_yield();
+
+    for (i = 0; i < w->num_ops; i++) {
+	op = &w->ops[i];
+
+	/* Wait for the request of another thread that this one depends on */
+	if (op->dep_worker >= 0)
+	    while (__atomic_load_n(&par->workers[op->dep_worker].done, __ATOMIC_ACQUIRE) <= op->dep_seq) {
+		if (__atomic_load_n(&par->failed, __ATOMIC_RELAXED))
+		    return NULL;
+		sched_yield();
+	    }
+
+	if (op->op->type == FREE) {
+	    mm_free(par->blocks[op->index]);
+	} else {
+	    p = (op->op->type == ALLOC) ? mm_malloc_op(par->trace, op->op - par->trace->ops) :
+		mm_realloc(par->blocks[op->index], op->op->size);
+	    if (p == NULL) {
+		__atomic_store_n(&par->failed, 1, __ATOMIC_RELAXED);
+		return NULL;
+	    }
+	    par->blocks[op->index] = p;
+	}
+	__atomic_store_n(&w->done, i + 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/*
+ * free_par - Free the plan made by plan_par
+ */
+static void free_par(par_t *par)
+{
+    int i;
+
+    for (i = 0; i < par->num_workers; i++)
+	free(par->workers[i].ops);
+    free(par->workers);
+    free(par->blocks);
+}
+#endif
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -1071,6 +1932,19 @@ static double printresults(int n, stats_t *stats)
     return (ops/1e3)/secs;
 }
 
+/*
+ * perf_points - Split the performance index for an average utilization
+ *    and throughput (ops/sec) into its utilization and throughput points
+ */
+static void perf_points(double util, double throughput, double *p1, double *p2)
+{
+    *p1 = UTIL_POINTS * util;
+    if (throughput > AVG_LIBC_THRUPUT)
+	*p2 = THRU_POINTS;
+    else
+	*p2 = ((double)THRU_POINTS) * (throughput/AVG_LIBC_THRUPUT);
+}
+
 /*
  * fl_puts - Print a message immediately to standard output
  */
@@ -1111,17 +1985,30 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void)
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValr] [-f <file>] [-t <dir>] [-L trace|auto] [-w <pct>] [-C <file>] [-s text|json] [-e <file>] [-m <file>]\n");
+    fprintf(stderr, "       mdriver -T perf|p99|heap [-S grid|halving] [-o <file>] [-v] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "       mdriver-mt -P <n> [-vr] [-L trace|auto] [-f <file>] [-t <dir>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
+    fprintf(stderr, "\t-C <file>  Load the parameters of the mm package from <file>.\n");
 #ifdef USE_CALLGRIND
     fprintf(stderr, "\t-c         Mode for running under Callgrind.\n");
 #endif
+    fprintf(stderr, "\t-e <file>  Write the last events traced by the mm package to <file> (Chrome trace JSON).\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-L <mode>  Pass lifetime hints: \"trace\" (actual lifetimes) or \"auto\".\n");
+    fprintf(stderr, "\t-m <file>  Write maps of the heap during each trace to <file> (see heapviz).\n");
+    fprintf(stderr, "\t-o <file>  Where -T writes the best parameters (default mm.conf).\n");
+    fprintf(stderr, "\t-P <n>     Replay the traces on 1 to <n> threads and print how the throughput scales.\n");
+    fprintf(stderr, "\t-r         Reserve the suggested heap size up front.\n");
+    fprintf(stderr, "\t-s <fmt>   Print the counters of the mm package after each trace, as \"text\" or \"json\".\n");
+    fprintf(stderr, "\t-S <how>   Search of -T: \"halving\" (successive halving, default) or \"grid\".\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T <obj>   Tune the mm parameters for \"perf\" (index), \"p99\" (latency) or \"heap\" (peak size).\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
+    fprintf(stderr, "\t-w <pct>   Time the runs from a snapshot of the heap after <pct>%% of the trace.\n");
 }
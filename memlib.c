@@ -2,7 +2,27 @@
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
+ *
+ *            With mem_init_shared, the heap is a memfd that other processes
+ *            can map as well (mem_attach). The brk then lives in the first
+ *            page of the mapping, so that all of them see the same heap,
+ *            and the rest of that page is left to the malloc package
+ *            (mem_shared). Each process may map the heap at another address.
+ *
+ *            With mem_init_vm, the heap is real memory rather than a
+ *            simulation: a range of address space reserved up front, whose
+ *            pages are only backed as the heap touches them.
+ *
+ *            With mem_init_file, the heap is a file instead, so that it
+ *            outlives the process: opening the file again brings back the
+ *            heap as it was. The file can be much larger than MAX_HEAP; it
+ *            is sparse, so only the pages the heap writes take up disk.
+ *
+ *            mem_snapshot takes a copy-on-write snapshot of a shared heap,
+ *            and mem_restore goes back to it, at the cost of the pages
+ *            written since rather than of the whole heap.
  */
+#define _GNU_SOURCE          /* memfd_create */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -10,14 +30,38 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
 
 #include "memlib.h"
 #include "config.h"
 
+#define MEM_MAGIC 0x6d656d6c69620001UL    /* marks the header of a shared heap */
+#define MEM_RESIDENT_PAGES 4096           /* pages mem_resident asks mincore about at once */
+
+/* State of the brk, kept in the header page of a shared heap. Offsets are from mem_start_brk. */
+typedef struct {
+    size_t magic;            /* MEM_MAGIC once the header is set up */
+    size_t brk;              /* end of the heap */
+    size_t faulted;          /* pages below this may be faulted in */
+    size_t reserve;          /* bytes above the brk kept faulted in (mem_headroom) */
+} mem_state_t;
+
 /* private variables */
 static char *mem_start_brk;  /* points to first byte of heap */
-static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
+static mem_state_t mem_private;        /* the state of a heap of our own... */
+static mem_state_t *mem = &mem_private; /* ...or of the shared heap */
+static char *mem_map;        /* mapping of the shared heap (header page first), NULL if not shared */
+static size_t mem_map_size;  /* its size, the header page included */
+static int mem_fd = -1;      /* its memfd or file */
+static int mem_file;         /* the heap is a file (mem_init_file) */
+static int mem_snap_fd = -1; /* memfd holding the snapshot the heap is a private mapping of, -1 if none */
+static size_t mem_vm_size;   /* size of the address space reserved by mem_init_vm, 0 if the heap was malloc'd */
+
+#define mem_brk     (mem_start_brk + mem->brk)
+#define mem_faulted (mem_start_brk + mem->faulted)
 
 /* 
  * mem_init - initialize the memory system model
@@ -31,7 +75,210 @@ void mem_init(void)
     }
 
     mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
-    mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem = &mem_private;
+    mem->brk = 0;                             /* heap is empty initially */
+    mem->faulted = 0;
+    mem->reserve = 0;
+}
+
+/*
+ * mem_init_vm - like mem_init, but reserve size bytes of address space for
+ *    the heap with mmap instead of taking it from the C library's malloc, so
+ *    that a malloc package built on memlib can replace that one. The pages
+ *    only take up memory once the heap is grown into them. Returns 0, or -1
+ *    on error.
+ */
+int mem_init_vm(size_t size)
+{
+    char *map;
+
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE,
+	       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map == MAP_FAILED)
+	return -1;
+    mem_start_brk = map;
+    mem_max_addr = mem_start_brk + size;
+    mem_vm_size = size;
+    mem = &mem_private;
+    mem->brk = 0;
+    mem->faulted = 0;
+    mem->reserve = 0;
+    return 0;
+}
+
+/*
+ * mem_init_shared - like mem_init, but the heap is a memfd that other
+ *    processes can map with mem_attach (pass them the descriptor through
+ *    fork or a unix socket). Returns the descriptor, or -1 on error.
+ */
+int mem_init_shared(void)
+{
+    size_t pagesize = mem_pagesize();
+    int fd;
+
+    if ((fd = memfd_create("mm-heap", 0)) < 0)
+	return -1;
+    if (ftruncate(fd, pagesize + MAX_HEAP) < 0 || mem_attach(fd) < 0) {
+	close(fd);
+	return -1;
+    }
+    mem->brk = 0;
+    mem->faulted = 0;
+    mem->reserve = 0;
+    mem->magic = MEM_MAGIC;
+    return fd;
+}
+
+/*
+ * mem_init_file - like mem_init_shared, but the heap is the file at path,
+ *    which is created if it doesn't exist, and may grow to size bytes (0
+ *    for MAX_HEAP). A file that holds a heap already is opened as it was
+ *    left, brk and all, and so is the state the malloc package keeps in
+ *    the header page; it keeps its own size, or grows to size if that is
+ *    larger. Only one process at a time can have the file open. Returns 0,
+ *    or -1 on error.
+ */
+int mem_init_file(const char *path, size_t size)
+{
+    size_t pagesize = mem_pagesize();
+    struct stat st;
+    int fd;
+
+    if (size == 0)
+	size = MAX_HEAP;
+    size = (size + pagesize - 1) & ~(pagesize - 1);
+    if ((fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) < 0)
+	return -1;
+    if (flock(fd, LOCK_EX | LOCK_NB) < 0 || fstat(fd, &st) < 0 ||
+	((size_t)st.st_size < pagesize + size && ftruncate(fd, pagesize + size) < 0) ||
+	mem_attach(fd) < 0) {
+	close(fd);
+	return -1;
+    }
+    mem_file = 1;
+    if (mem->magic != MEM_MAGIC) {
+	mem->brk = 0;
+	mem->reserve = 0;
+	mem->magic = MEM_MAGIC;
+    }
+    mem->faulted = mem->brk;  /* nothing above the brk is faulted in yet */
+    return 0;
+}
+
+/*
+ * mem_persistent - return 1 if the heap is a file (mem_init_file)
+ */
+int mem_persistent(void)
+{
+    return mem_file;
+}
+
+/*
+ * mem_sync - write the header page and the heap of a file back to disk.
+ *    Returns 0, or -1 if the heap isn't a file or writing failed.
+ */
+int mem_sync(void)
+{
+    if (!mem_file) {
+	errno = EINVAL;
+	return -1;
+    }
+    return msync(mem_map, mem_pagesize() + mem->brk, MS_SYNC);
+}
+
+/*
+ * mem_snapshot - take a snapshot of a shared heap (mem_init_shared), header
+ *    page and all, that mem_restore can go back to. The heap is copied into
+ *    a memfd once, and mapped privately from it: pages are copied again only
+ *    as they are written. From now on, the heap is no longer shared with
+ *    other processes, but a process forked off keeps the snapshot, so that
+ *    it can go back to it as well. A snapshot replaces the previous one.
+ *    Returns 0, or -1 on error (or if the heap isn't shared, or is a file).
+ */
+int mem_snapshot(void)
+{
+    size_t pagesize = mem_pagesize();
+    size_t len, done;
+    ssize_t n;
+    int fd;
+
+    if (mem_map == NULL || mem_file) {
+	errno = EINVAL;
+	return -1;
+    }
+    if ((fd = memfd_create("mm-snapshot", 0)) < 0)
+	return -1;
+    mem->faulted = mem->brk;  /* the pages above the brk are left behind */
+    len = pagesize + mem->brk;
+    n = ftruncate(fd, mem_map_size);
+    for (done = 0; n >= 0 && done < len; done += n)
+	n = pwrite(fd, mem_map + done, len - done, done);
+    if (n < 0 || mmap(mem_map, mem_map_size, PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+	close(fd);
+	return -1;
+    }
+    if (mem_snap_fd >= 0)
+	close(mem_snap_fd);
+    mem_snap_fd = fd;
+    return 0;
+}
+
+/*
+ * mem_restore - put the heap back as it was at the last mem_snapshot, by
+ *    dropping the pages written since. The malloc package has to pick up
+ *    the heap again (mm_init) afterwards. Returns 0, or -1 if there is no
+ *    snapshot.
+ */
+int mem_restore(void)
+{
+    if (mem_snap_fd < 0) {
+	errno = EINVAL;
+	return -1;
+    }
+    return madvise(mem_map, mem_map_size, MADV_DONTNEED);
+}
+
+/*
+ * mem_attach - map the shared heap of descriptor fd (see mem_init_shared),
+ *    which takes the place of the heap of this process. The heap is as
+ *    large as the memfd or file is. Returns 0, or -1 on error.
+ */
+int mem_attach(int fd)
+{
+    size_t pagesize = mem_pagesize();
+    struct stat st;
+    char *map;
+
+    if (fstat(fd, &st) < 0)
+	return -1;
+    if ((size_t)st.st_size <= pagesize) {
+	errno = EINVAL;
+	return -1;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+	return -1;
+    mem_map = map;
+    mem_map_size = st.st_size;
+    mem_fd = fd;
+    mem = (mem_state_t *)map;
+    mem_start_brk = map + pagesize;
+    mem_max_addr = map + mem_map_size;
+    return 0;
+}
+
+/*
+ * mem_shared - return the part of the header page of a shared heap that
+ *    is left to the malloc package and store its size in *size, or return
+ *    NULL if the heap is not shared
+ */
+void *mem_shared(size_t *size)
+{
+    if (mem_map == NULL)
+	return NULL;
+    *size = mem_pagesize() - sizeof(mem_state_t);
+    return mem_map + sizeof(mem_state_t);
 }
 
 /* 
@@ -39,21 +286,47 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
+    if (mem_map != NULL) {
+	munmap(mem_map, mem_map_size);
+	if (mem_file)
+	    close(mem_fd);
+	if (mem_snap_fd >= 0)
+	    close(mem_snap_fd);
+	mem_snap_fd = -1;
+	mem_map = NULL;
+	mem_file = 0;
+	mem = &mem_private;
+	return;
+    }
+    if (mem_vm_size != 0) {
+	munmap(mem_start_brk, mem_vm_size);
+	mem_vm_size = 0;
+	return;
+    }
     free(mem_start_brk);
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap.
+ *    The state of the malloc package in the header page of a shared heap
+ *    is cleared too, since it describes the old heap.
  */
 void mem_reset_brk()
 {
-    mem_brk = mem_start_brk;
+    size_t size;
+    void *state;
+
+    mem->brk = 0;
+    if ((state = mem_shared(&size)) != NULL)
+	memset(state, 0, size);
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
  *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    this model, the heap cannot be shrunk. Like sbrk, it fails quietly
+ *    (errno ENOMEM): running out is something the caller handles, by
+ *    giving memory back under a limit or by returning NULL.
  */
 void *mem_sbrk(int incr) 
 {
@@ -61,10 +334,11 @@ void *mem_sbrk(int incr)
 
     if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
 	errno = ENOMEM;
-	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 	return (void *)-1;
     }
-    mem_brk += incr;
+    mem->brk += incr;
+    if (mem->brk > mem->faulted)
+	mem->faulted = mem->brk;
     return (void *)old_brk;
 }
 
@@ -92,6 +366,14 @@ size_t mem_heapsize()
     return (size_t)(mem_brk - mem_start_brk);
 }
 
+/*
+ * mem_heapleft() - returns the bytes the heap can still grow by
+ */
+size_t mem_heapleft()
+{
+    return (size_t)(mem_max_addr - mem_brk);
+}
+
 /*
  * mem_pagesize() - returns the page size of the system
  */
@@ -99,3 +381,124 @@ size_t mem_pagesize()
 {
     return (size_t)getpagesize();
 }
+
+/*
+ * mem_prefault - fault in the pages of [addr, addr+len) ahead of use, so
+ *    that the allocator doesn't take the page faults later on. The contents
+ *    of the range are preserved.
+ */
+void mem_prefault(void *addr, size_t len)
+{
+    size_t pagesize = mem_pagesize();
+    char *lo = (char *)((unsigned long)addr & ~(pagesize - 1));
+    char *hi = (char *)addr + len;
+    volatile char *p;
+
+    if (len == 0)
+	return;
+#ifdef MADV_POPULATE_WRITE
+    /* Populate the pages writable in one call, where the kernel supports it */
+    if (madvise(lo, hi - lo, MADV_POPULATE_WRITE) == 0)
+	return;
+#endif
+    madvise(lo, hi - lo, MADV_WILLNEED);
+
+    /* Otherwise write every page once (with the value it already holds) */
+    for (p = addr; p < (volatile char *)hi; p = (char *)(((unsigned long)p + pagesize) & ~(pagesize - 1)))
+	*p = *p;
+}
+
+/*
+ * mem_decommit - give the whole pages of [addr, addr+len) back to the
+ *    system. Their contents are lost: they read as zeros when touched again.
+ *    The pages of a shared heap are punched out of the memfd, as dropping
+ *    them from our mapping wouldn't free them. Those of a heap that has a
+ *    snapshot read as they were in the snapshot instead.
+ */
+void mem_decommit(void *addr, size_t len)
+{
+    size_t pagesize = mem_pagesize();
+    char *lo = (char *)(((unsigned long)addr + pagesize - 1) & ~(pagesize - 1));
+    char *hi = (char *)(((unsigned long)addr + len) & ~(pagesize - 1));
+
+    if (lo < hi)
+	madvise(lo, hi - lo, mem_map != NULL && mem_snap_fd < 0 ? MADV_REMOVE : MADV_DONTNEED);
+}
+
+/*
+ * mem_trim - give the last bytes bytes of the heap back by moving the
+ *    brk pointer down. The whole pages among them are returned to the
+ *    system, so their contents are lost, except for the headroom kept
+ *    by mem_headroom. Returns 0, or -1 if the heap is smaller than that.
+ */
+int mem_trim(size_t bytes)
+{
+    char *lo;
+
+    if (bytes > (size_t)(mem_brk - mem_start_brk)) {
+	errno = EINVAL;
+	return -1;
+    }
+    mem->brk -= bytes;
+    lo = mem_brk + mem->reserve;
+    if (lo < mem_faulted) {
+	mem_decommit(lo, mem_faulted - lo);
+	mem->faulted = lo - mem_start_brk;
+    }
+    return 0;
+}
+
+/*
+ * mem_headroom - keep the bytes bytes above the brk faulted in, so that
+ *    the heap can grow into them without page faults, and give back any
+ *    faulted in pages beyond them. Also sets the headroom that mem_trim
+ *    keeps. Meant to be called periodically, off the allocation path.
+ */
+void mem_headroom(size_t bytes)
+{
+    char *hi = mem_brk + bytes;
+
+    if (hi > mem_max_addr)
+	hi = mem_max_addr;
+    mem->reserve = bytes;
+    if (hi > mem_faulted)
+	mem_prefault(mem_faulted, hi - mem_faulted);
+    else if (hi < mem_faulted)
+	mem_decommit(hi, mem_faulted - hi);
+    mem->faulted = hi - mem_start_brk;
+}
+
+/*
+ * mem_committed - bytes of the heap and of the pages above it that may
+ *    be faulted in (the headroom, or memory the heap gave back but that
+ *    was not returned to the system)
+ */
+size_t mem_committed(void)
+{
+    return (size_t)(mem_faulted - mem_start_brk);
+}
+
+/*
+ * mem_resident - bytes of the pages of the heap and of the headroom that
+ *    are actually in memory. Unlike mem_committed this takes a system call
+ *    per MEM_RESIDENT_PAGES pages, so it is for the occasional exact count.
+ */
+size_t mem_resident(void)
+{
+    size_t pagesize = mem_pagesize();
+    char *lo = (char *)((unsigned long)mem_start_brk & ~(pagesize - 1));
+    char *hi = mem_faulted;
+    unsigned char vec[MEM_RESIDENT_PAGES];
+    size_t n, i, resident = 0;
+
+    for (; lo < hi; lo += n * pagesize) {
+	n = (hi - lo + pagesize - 1) / pagesize;
+	if (n > MEM_RESIDENT_PAGES)
+	    n = MEM_RESIDENT_PAGES;
+	if (mincore(lo, n * pagesize, vec) < 0)
+	    return mem_committed();
+	for (i = 0; i < n; i++)
+	    resident += vec[i] & 1;
+    }
+    return resident * pagesize;
+}
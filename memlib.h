@@ -1,11 +1,34 @@
 #include <unistd.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 void mem_init(void);               
+int mem_init_vm(size_t size);
+int mem_init_shared(void);
+int mem_init_file(const char *path, size_t size);
+int mem_attach(int fd);
+int mem_persistent(void);
+int mem_sync(void);
+int mem_snapshot(void);
+int mem_restore(void);
+void *mem_shared(size_t *size);
 void mem_deinit(void);
 void *mem_sbrk(int incr);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_heapleft(void);
 size_t mem_pagesize(void);
+void mem_prefault(void *addr, size_t len);
+void mem_decommit(void *addr, size_t len);
+int mem_trim(size_t bytes);
+void mem_headroom(size_t bytes);
+size_t mem_committed(void);
+size_t mem_resident(void);
 
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,361 @@
+/*
+ * mkbuckets.c - Generates the size-class boundaries of the free lists of
+ *     mm.c (mm_buckets.h) from the size and lifetime distribution of a set
+ *     of traces in the format of mdriver (.rep):
+ *
+ *         ./mkbuckets traces/amptjp-bal.rep traces/cccp-bal.rep ... > mm_buckets.h
+ *         make
+ *
+ * Every request is turned into the block size mm_malloc would give it
+ * (mm_realloc adds its padding), and every block is followed from its
+ * allocation to its free. A size is weighted by the number of times a
+ * block of that size is searched for (allocated) plus the number of times
+ * one enters the free lists (freed before the end of its trace), each
+ * trace counting as much as the others.
+ *
+ * The boundaries are chosen in three steps:
+ *
+ *     1. Every size with at least 1/HOT_SHARE of the total weight gets a
+ *        bucket of its own, so that its blocks never have to be searched
+ *        past blocks of other sizes.
+ *     2. The remaining boundaries split the rest of the weight into equal
+ *        parts (quantiles), snapped to sizes that occur.
+ *     3. Boundaries left over (the traces have fewer distinct sizes than
+ *        there are buckets) halve the widest gaps, by ratio; any still
+ *        left double past the largest.
+ *
+ * Bucket 0 stays empty, as with the default limits: the head of its list
+ * is at offset 0 of the heap, which the offset links of mm.c can't tell
+ * from NULL. That leaves 15 limits to fit.
+ *
+ * The header lists the weight share and the median lifetime (in requests)
+ * of every bucket as a comment.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NUM_BUCKET      17          /* as in mm.c */
+#define EMPTY_LIMIT     8           /* limit of bucket 0, which no block fits in (see below) */
+#define NUM_LIMITS      (NUM_BUCKET - 2)    /* limits fitted to the traces: those of buckets 1 to 15 */
+#define DSIZE           16
+#define OVERHEAD        16
+#define REALLOC_PADDING (1<<7)
+#define MIN_BLOCK       (DSIZE + OVERHEAD)
+#define HOT_SHARE       12          /* a size with 1/HOT_SHARE of the weight gets its own bucket */
+#define MAXLINE         1024
+
+/* One block size seen in the traces */
+typedef struct {
+    size_t asize;
+    double weight;          /* allocations plus frees, each trace normalized to 1 */
+    unsigned long *lifetimes;   /* lifetimes of the freed blocks, in requests */
+    size_t num_lifetimes, max_lifetimes;
+} size_stat_t;
+
+static size_stat_t *sizes;
+static size_t num_sizes, max_sizes;
+
+static size_t block_size(size_t size, int realloc);
+static size_stat_t *find_size(size_t asize);
+static void read_trace(const char *path);
+static int cmp_size(const void *a, const void *b);
+static int cmp_ulong(const void *a, const void *b);
+static int choose_limits(size_t *limits);
+static int add_limit(size_t *limits, int n, size_t limit);
+static void print_header(size_t *limits, int n, int argc, char **argv);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    size_t limits[NUM_LIMITS];
+    int c, i, n;
+
+    while ((c = getopt(argc, argv, "h")) != EOF) {
+        switch (c) {
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind == argc) {
+        usage();
+        exit(1);
+    }
+
+    for (i = optind; i < argc; i++)
+        read_trace(argv[i]);
+    if (num_sizes == 0) {
+        fprintf(stderr, "mkbuckets: the traces have no allocations\n");
+        exit(1);
+    }
+    qsort(sizes, num_sizes, sizeof(size_stat_t), cmp_size);
+
+    n = choose_limits(limits);
+    print_header(limits, n, argc - optind, argv + optind);
+    exit(0);
+}
+
+/*
+ * block_size - Size of the block mm_malloc (or mm_realloc) gives a request of size bytes
+ */
+static size_t block_size(size_t size, int realloc)
+{
+    size_t asize;
+
+    if (size <= DSIZE)
+        asize = realloc ? 2 * DSIZE : MIN_BLOCK;
+    else
+        asize = DSIZE * ((size + OVERHEAD + DSIZE - 1) / DSIZE);
+    return realloc ? asize + REALLOC_PADDING : asize;
+}
+
+/*
+ * find_size - The entry of block size asize, created if it's new
+ */
+static size_stat_t *find_size(size_t asize)
+{
+    size_t i;
+
+    for (i = 0; i < num_sizes; i++)
+        if (sizes[i].asize == asize)
+            return &sizes[i];
+    if (num_sizes == max_sizes) {
+        max_sizes = max_sizes ? 2 * max_sizes : 256;
+        if ((sizes = realloc(sizes, max_sizes * sizeof(size_stat_t))) == NULL) {
+            fprintf(stderr, "mkbuckets: out of memory\n");
+            exit(1);
+        }
+    }
+    memset(&sizes[num_sizes], 0, sizeof(size_stat_t));
+    sizes[num_sizes].asize = asize;
+    return &sizes[num_sizes++];
+}
+
+/*
+ * read_trace - Add the blocks of the trace at path to the statistics
+ */
+static void read_trace(const char *path)
+{
+    FILE *fp;
+    char type[MAXLINE];
+    int heapsize, num_ids, num_ops, weight;
+    unsigned index, size;
+    size_t *asizes;             /* block size of every id, 0 while it's not allocated */
+    unsigned long *births;      /* request that allocated it */
+    unsigned long op;
+    double w;
+    size_stat_t *st;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+        fprintf(stderr, "mkbuckets: could not open %s\n", path);
+        exit(1);
+    }
+    if (fscanf(fp, "%d %d %d %d", &heapsize, &num_ids, &num_ops, &weight) != 4 ||
+        num_ids < 0 || num_ops <= 0) {
+        fprintf(stderr, "mkbuckets: %s is not a trace\n", path);
+        exit(1);
+    }
+    asizes = calloc(num_ids + 1, sizeof(size_t));
+    births = calloc(num_ids + 1, sizeof(unsigned long));
+    if (asizes == NULL || births == NULL) {
+        fprintf(stderr, "mkbuckets: out of memory\n");
+        exit(1);
+    }
+    w = 1.0 / num_ops;
+
+    for (op = 0; fscanf(fp, "%s", type) != EOF; op++) {
+        if (type[0] == 'f' ? fscanf(fp, "%u", &index) != 1 : fscanf(fp, "%u %u", &index, &size) != 2) {
+            fprintf(stderr, "mkbuckets: bad request %lu in %s\n", op, path);
+            exit(1);
+        }
+        fscanf(fp, "%*[^\n]");   /* the thread id, if any */
+        if (index >= (unsigned)num_ids || (type[0] != 'a' && type[0] != 'r' && type[0] != 'f')) {
+            fprintf(stderr, "mkbuckets: bad request %lu in %s\n", op, path);
+            exit(1);
+        }
+        if (type[0] != 'a' && asizes[index] != 0) {
+            /* The old block of a free or realloc enters the free lists */
+            st = find_size(asizes[index]);
+            st->weight += w;
+            if (st->num_lifetimes == st->max_lifetimes) {
+                st->max_lifetimes = st->max_lifetimes ? 2 * st->max_lifetimes : 64;
+                if ((st->lifetimes = realloc(st->lifetimes, st->max_lifetimes * sizeof(unsigned long))) == NULL) {
+                    fprintf(stderr, "mkbuckets: out of memory\n");
+                    exit(1);
+                }
+            }
+            st->lifetimes[st->num_lifetimes++] = op - births[index];
+            asizes[index] = 0;
+        }
+        if (type[0] != 'f' && size > 0) {
+            asizes[index] = block_size(size, type[0] == 'r');
+            births[index] = op;
+            find_size(asizes[index])->weight += w;
+        }
+    }
+    fclose(fp);
+    free(asizes);
+    free(births);
+}
+
+static int cmp_size(const void *a, const void *b)
+{
+    size_t x = ((const size_stat_t *)a)->asize, y = ((const size_stat_t *)b)->asize;
+
+    return (x > y) - (x < y);
+}
+
+static int cmp_ulong(const void *a, const void *b)
+{
+    unsigned long x = *(const unsigned long *)a, y = *(const unsigned long *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * add_limit - Insert limit into the sorted limits[0..n-1] unless it's there
+ *     already or there is no room left. Returns the new count.
+ */
+static int add_limit(size_t *limits, int n, size_t limit)
+{
+    int i, j;
+
+    if (n == NUM_LIMITS)
+        return n;
+    for (i = 0; i < n && limits[i] < limit; i++)
+        ;
+    if (i < n && limits[i] == limit)
+        return n;
+    for (j = n; j > i; j--)
+        limits[j] = limits[j - 1];
+    limits[i] = limit;
+    return n + 1;
+}
+
+/*
+ * choose_limits - Choose the bucket limits from the statistics (sorted by
+ *     size). Returns the number of limits, which is less than NUM_LIMITS
+ *     if the sizes are too few and too close to tell more buckets apart.
+ */
+static int choose_limits(size_t *limits)
+{
+    double total = 0, rest = 0, acc, step, ratio;
+    size_t i, lo, hi;
+    int n = 0, k, best, quantiles;
+
+    for (i = 0; i < num_sizes; i++)
+        total += sizes[i].weight;
+
+    /* 1. Buckets of their own for the hot sizes */
+    for (i = 0; i < num_sizes; i++) {
+        if (sizes[i].weight * HOT_SHARE < total)
+            rest += sizes[i].weight;
+        else if (n < NUM_LIMITS - 1) {
+            if (sizes[i].asize > MIN_BLOCK)
+                n = add_limit(limits, n, sizes[i].asize - DSIZE);
+            n = add_limit(limits, n, sizes[i].asize);
+        }
+    }
+
+    /* 2. Equal shares of the rest of the weight */
+    quantiles = NUM_LIMITS - n;
+    step = rest / (quantiles + 1);
+    acc = 0;
+    for (i = 0, k = 1; i < num_sizes && k <= quantiles && rest > 0; i++) {
+        if (sizes[i].weight * HOT_SHARE >= total)
+            continue;
+        acc += sizes[i].weight;
+        if (acc >= k * step) {
+            n = add_limit(limits, n, sizes[i].asize);
+            while (k <= quantiles && acc >= k * step)
+                k++;
+        }
+    }
+
+    /* 3. Halve the widest gaps (by ratio) with the limits that are left */
+    while (n < NUM_LIMITS) {
+        best = -1;
+        ratio = 0;
+        for (k = 0; k < n; k++) {
+            lo = k == 0 ? MIN_BLOCK : limits[k - 1];
+            if (limits[k] >= lo + 2 * DSIZE && (double)limits[k] / lo > ratio) {
+                ratio = (double)limits[k] / lo;
+                best = k;
+            }
+        }
+        if (best < 0)
+            break;
+        lo = best == 0 ? MIN_BLOCK : limits[best - 1];
+        hi = limits[best];
+        n = add_limit(limits, n, lo + (hi - lo) / 2 / DSIZE * DSIZE);
+    }
+    return n;
+}
+
+/*
+ * print_header - Write mm_buckets.h to stdout
+ */
+static void print_header(size_t *limits, int n, int num_traces, char **traces)
+{
+    double total = 0, weight;
+    size_t i, j, lo;
+    unsigned long *all, count;
+    int b;
+
+    for (i = 0; i < num_sizes; i++)
+        total += sizes[i].weight;
+
+    printf("/*\n");
+    printf(" * mm_buckets.h - Size-class boundaries of the free lists of mm.c: the\n");
+    printf(" *     largest block size of each bucket but the last. Generated by\n");
+    printf(" *     mkbuckets from:\n *\n");
+    for (b = 0; b < num_traces; b++)
+        printf(" *         %s\n", traces[b]);
+    printf(" *\n");
+    printf(" *     bucket       sizes   weight   median lifetime\n");
+    printf(" *     %6d %5d-%-7d  (empty)\n", 0, 1, EMPTY_LIMIT);
+    for (b = 0, i = 0, lo = EMPTY_LIMIT; b <= n; b++) {
+        weight = 0;
+        count = 0;
+        for (j = i; j < num_sizes && (b == n || sizes[j].asize <= limits[b]); j++) {
+            weight += sizes[j].weight;
+            count += sizes[j].num_lifetimes;
+        }
+        all = malloc((count + 1) * sizeof(unsigned long));
+        count = 0;
+        for (; i < j; i++) {
+            memcpy(all + count, sizes[i].lifetimes, sizes[i].num_lifetimes * sizeof(unsigned long));
+            count += sizes[i].num_lifetimes;
+        }
+        qsort(all, count, sizeof(unsigned long), cmp_ulong);
+        if (b < n)
+            printf(" *     %6d %5lu-%-7lu %6.1f%%", b + 1, (unsigned long)lo + 1, (unsigned long)limits[b], 100 * weight / total);
+        else
+            printf(" *     %6d %5lu-        %6.1f%%", b + 1, (unsigned long)lo + 1, 100 * weight / total);
+        if (count)
+            printf("   %lu\n", all[count / 2]);
+        else
+            printf("   -\n");
+        free(all);
+        if (b < n)
+            lo = limits[b];
+    }
+    printf(" */\n");
+    printf("#define MM_BUCKET_LIMITS \\\n    %d,", EMPTY_LIMIT);
+    for (b = 0; b < NUM_LIMITS; b++)
+        printf(" %lu%s", (unsigned long)(b < n ? limits[b] : limits[n - 1] << (b - n + 1)),
+               b < NUM_LIMITS - 1 ? "," : "\n");
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mkbuckets [-h] <trace>...\n");
+    fprintf(stderr, "Writes the bucket limits fitted to the traces (mm_buckets.h) to stdout.\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+}
@@ -0,0 +1,183 @@
+/*
+ * mktrace.c - Converts a trace in the text format of mdriver (.rep) to the
+ *     binary format that mdriver maps and replays in place (trace.h):
+ *
+ *         ./mktrace traces/amptjp-bal.rep amptjp-bal.bin
+ *         ./mdriver -f amptjp-bal.bin
+ *
+ * The requests are streamed through, so a trace of any length converts in
+ * memory proportional to its number of ids. The ids are made dense on the
+ * way: an alloc request gets the id of the block its thread freed last,
+ * if there is one, else the next unused id, so the blocks array of the
+ * replay is small and the ids in use are the ones mdriver touched last.
+ * Ids are not passed between threads, which would make the alloc wait for
+ * the free of another thread in a multi-threaded replay (mdriver -P).
+ * A thread id at the end of a request line is kept.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+#define MAXLINE 1024
+
+#define NOT_LIVE 0xffffffffu    /* dense id of a text id whose block isn't allocated */
+
+static void convert(FILE *in, FILE *out, const char *path);
+static void bad_request(unsigned long op, const char *path);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    FILE *in, *out;
+    int c;
+
+    while ((c = getopt(argc, argv, "h")) != EOF) {
+        switch (c) {
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (argc - optind != 2) {
+        usage();
+        exit(1);
+    }
+
+    if ((in = fopen(argv[optind], "r")) == NULL) {
+        fprintf(stderr, "mktrace: could not open %s\n", argv[optind]);
+        exit(1);
+    }
+    if ((out = fopen(argv[optind + 1], "w")) == NULL) {
+        fprintf(stderr, "mktrace: could not create %s\n", argv[optind + 1]);
+        exit(1);
+    }
+    convert(in, out, argv[optind]);
+    fclose(in);
+    if (fclose(out) != 0) {
+        fprintf(stderr, "mktrace: could not write %s\n", argv[optind + 1]);
+        exit(1);
+    }
+    exit(0);
+}
+
+/*
+ * convert - Write the requests of the text trace in to out, after a header
+ *     that is filled in once they have all been seen
+ */
+static void convert(FILE *in, FILE *out, const char *path)
+{
+    trace_header_t hdr;
+    traceop_t op;
+    char line[MAXLINE], type[8];
+    unsigned *dense, *next_freed;  /* dense id of each text id, and the links of the stacks below */
+    unsigned freed[TRACE_MAX_THREADS];  /* dense id each thread freed last, and so on down next_freed */
+    unsigned long num_ops = 0, next_id = 0;
+    unsigned id, arg, thread, max_thread = 0;
+    int heapsize, num_ids, ops, weight, n, fields;
+
+    if (fscanf(in, "%d %d %d %d", &heapsize, &num_ids, &ops, &weight) != 4 ||
+        heapsize < 0 || num_ids < 0 || ops < 0) {
+        fprintf(stderr, "mktrace: %s is not a trace\n", path);
+        exit(1);
+    }
+    if ((dense = malloc((num_ids + 1) * sizeof(unsigned))) == NULL ||
+        (next_freed = malloc((num_ids + 1) * sizeof(unsigned))) == NULL) {
+        fprintf(stderr, "mktrace: out of memory\n");
+        exit(1);
+    }
+    memset(dense, 0xff, num_ids * sizeof(unsigned));
+    memset(freed, 0xff, sizeof(freed));
+
+    memset(&hdr, 0, sizeof(hdr));
+    fwrite(&hdr, sizeof(hdr), 1, out);
+
+    while (fgets(line, MAXLINE, in) != NULL) {
+        if ((n = sscanf(line, "%7s %u %u %u", type, &id, &arg, &thread)) <= 0)
+            continue;                   /* blank line */
+        fields = (type[0] == 'f') ? 2 : 3;  /* before the thread id */
+        if (n < fields)
+            bad_request(num_ops, path);
+        if (n == fields)
+            thread = 0;
+        else if (type[0] == 'f')
+            thread = arg;
+        if (id >= (unsigned)num_ids || thread >= TRACE_MAX_THREADS)
+            bad_request(num_ops, path);
+
+        memset(&op, 0, sizeof(op));
+        switch (type[0]) {
+        case 'a':
+            if (dense[id] != NOT_LIVE)
+                bad_request(num_ops, path);
+            if (freed[thread] != NOT_LIVE) {
+                dense[id] = freed[thread];
+                freed[thread] = next_freed[dense[id]];
+            } else if (next_id < TRACE_MAX_IDS)
+                dense[id] = next_id++;
+            else {
+                fprintf(stderr, "mktrace: %s needs more than %d ids\n", path, TRACE_MAX_IDS);
+                exit(1);
+            }
+            op.type = ALLOC;
+            op.size = arg;
+            break;
+        case 'r':
+            if (dense[id] == NOT_LIVE)
+                bad_request(num_ops, path);
+            op.type = REALLOC;
+            op.size = arg;
+            break;
+        case 'f':
+            if (dense[id] == NOT_LIVE)
+                bad_request(num_ops, path);
+            op.type = FREE;
+            break;
+        default:
+            bad_request(num_ops, path);
+        }
+        op.index = dense[id];
+        op.thread = thread;
+        if (type[0] == 'f') {
+            next_freed[dense[id]] = freed[thread];
+            freed[thread] = dense[id];
+            dense[id] = NOT_LIVE;
+        }
+        max_thread = (thread > max_thread) ? thread : max_thread;
+        fwrite(&op, sizeof(op), 1, out);
+        num_ops++;
+    }
+    if (num_ops != (unsigned long)ops)
+        fprintf(stderr, "mktrace: %s has %lu requests, not %d as its header says\n", path, num_ops, ops);
+
+    memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.op_size = sizeof(traceop_t);
+    hdr.weight = weight;
+    hdr.sugg_heapsize = heapsize;
+    hdr.num_ids = next_id;
+    hdr.num_ops = num_ops;
+    hdr.num_threads = max_thread + 1;
+    rewind(out);
+    fwrite(&hdr, sizeof(hdr), 1, out);
+    free(dense);
+    free(next_freed);
+}
+
+static void bad_request(unsigned long op, const char *path)
+{
+    fprintf(stderr, "mktrace: bad request %lu in %s\n", op, path);
+    exit(1);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mktrace [-h] <trace.rep> <trace.bin>\n");
+    fprintf(stderr, "Converts a text trace to the binary format that mdriver replays in place.\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+}
@@ -0,0 +1,172 @@
+/*
+ * mm-new.cpp - Replaces the global operator new and delete of a C++
+ *     program with the mm package: link it (with mm.o built with
+ *     MM_THREAD_SAFE, and memlib.o) into the program.
+ *
+ * As in mm-preload.c, the heap is a range of address space reserved with
+ * mem_init_vm and set up on the first allocation, which may come from a
+ * static constructor; the program must not set the heap up itself. All
+ * forms are replaced: plain and array, nothrow, sized and aligned. Sizes
+ * and alignments go through mm::allocate and mm::deallocate (mm.hpp).
+ */
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <pthread.h>
+
+#include "mm.hpp"
+#include "memlib.h"
+
+#ifndef MM_THREAD_SAFE
+#error "mm-new.cpp must be built with -DMM_THREAD_SAFE"
+#endif
+
+#define NEW_HEAP    (1UL << 36)     /* address space reserved for the heap (bytes) */
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static bool initialized;            /* the heap is set up and ready */
+
+/*
+ * init - Set up the heap, with the parameters in the file named by
+ *     $MM_CONFIG if there is one (as in mm-preload.c). If that fails,
+ *     every allocation fails.
+ */
+static void init()
+{
+    const char *config = std::getenv("MM_CONFIG");
+
+    if (config != nullptr)
+        mm_load_params(config);
+    if (mem_init_vm(NEW_HEAP) < 0 || mm_init() < 0)
+        return;
+    initialized = true;
+}
+
+/*
+ * new_block - Allocate for operator new, calling the new handler until it
+ *     gives up. Returns nullptr if the allocation fails for good.
+ */
+static void *new_block(std::size_t size, std::size_t alignment)
+{
+    void *p = nullptr;
+
+    if (!initialized)
+        pthread_once(&init_once, init);
+    while (initialized && (p = mm::allocate(size, alignment)) == nullptr) {
+        std::new_handler handler = std::get_new_handler();
+
+        if (handler == nullptr)
+            return nullptr;
+        handler();
+    }
+    return initialized ? p : nullptr;
+}
+
+static void *new_or_throw(std::size_t size, std::size_t alignment)
+{
+    void *p = new_block(size, alignment);
+
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new(std::size_t size)
+{
+    return new_or_throw(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void *operator new[](std::size_t size)
+{
+    return new_or_throw(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void *operator new(std::size_t size, std::align_val_t al)
+{
+    return new_or_throw(size, static_cast<std::size_t>(al));
+}
+
+void *operator new[](std::size_t size, std::align_val_t al)
+{
+    return new_or_throw(size, static_cast<std::size_t>(al));
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    return new_block(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    return new_block(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void *operator new(std::size_t size, std::align_val_t al, const std::nothrow_t &) noexcept
+{
+    return new_block(size, static_cast<std::size_t>(al));
+}
+
+void *operator new[](std::size_t size, std::align_val_t al, const std::nothrow_t &) noexcept
+{
+    return new_block(size, static_cast<std::size_t>(al));
+}
+
+void operator delete(void *p) noexcept
+{
+    mm::deallocate(p, 0, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void operator delete[](void *p) noexcept
+{
+    mm::deallocate(p, 0, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void operator delete(void *p, std::size_t size) noexcept
+{
+    mm::deallocate(p, size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void operator delete[](void *p, std::size_t size) noexcept
+{
+    mm::deallocate(p, size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void operator delete(void *p, std::align_val_t al) noexcept
+{
+    mm::deallocate(p, 0, static_cast<std::size_t>(al));
+}
+
+void operator delete[](void *p, std::align_val_t al) noexcept
+{
+    mm::deallocate(p, 0, static_cast<std::size_t>(al));
+}
+
+void operator delete(void *p, std::size_t size, std::align_val_t al) noexcept
+{
+    mm::deallocate(p, size, static_cast<std::size_t>(al));
+}
+
+void operator delete[](void *p, std::size_t size, std::align_val_t al) noexcept
+{
+    mm::deallocate(p, size, static_cast<std::size_t>(al));
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+    mm::deallocate(p, 0, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+    mm::deallocate(p, 0, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void operator delete(void *p, std::align_val_t al, const std::nothrow_t &) noexcept
+{
+    mm::deallocate(p, 0, static_cast<std::size_t>(al));
+}
+
+void operator delete[](void *p, std::align_val_t al, const std::nothrow_t &) noexcept
+{
+    mm::deallocate(p, 0, static_cast<std::size_t>(al));
+}
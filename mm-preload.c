@@ -0,0 +1,232 @@
+/*
+ * mm-preload.c - Exports the standard malloc family on top of the mm
+ *     package, so that it can take the place of the C library's malloc
+ *     in any program:
+ *
+ *         make libmm.so
+ *         LD_PRELOAD=./libmm.so <program>
+ *
+ * The heap is a range of address space reserved with mem_init_vm rather
+ * than memlib's simulated one. It is set up on the first call, whichever
+ * comes first (the dynamic linker and other libraries allocate before any
+ * constructor of ours runs). The library is built with MM_THREAD_SAFE and
+ * registers the fork handlers of the mm package, so that a child forked
+ * while another thread was in the allocator can allocate. The parameters
+ * of the mm package can be set with a file written by mdriver -T:
+ *
+ *         MM_CONFIG=mm.conf LD_PRELOAD=./libmm.so <program>
+ *
+ * and the heap profiler of the mm package turned on with a sample rate
+ * in bytes, the profile being written to $MM_PROFILE when the program
+ * exits (as a pprof heap profile, or with MM_PROFILE_FORMAT=live or
+ * alloc as folded stacks of the live or allocated bytes):
+ *
+ *         MM_SAMPLE_RATE=524288 MM_PROFILE=heap.prof LD_PRELOAD=./libmm.so <program>
+ *
+ * Everything that glibc would otherwise serve from its own heap is
+ * replaced, since a block of one heap must never reach the other's free.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#ifndef MM_THREAD_SAFE
+#error "mm-preload.c must be built with -DMM_THREAD_SAFE"
+#endif
+
+#define PRELOAD_HEAP    (1UL << 36)     /* address space reserved for the heap (bytes) */
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static int initialized;                 /* the heap is set up and ready */
+
+static void init(void);
+static void dump_profile(void);
+static int ours(void *ptr);
+
+/*
+ * init - Set up the heap, with the parameters in the file named by
+ *     $MM_CONFIG if there is one (if it can't be loaded, the defaults
+ *     stay). If that fails, every allocation fails.
+ */
+static void init(void)
+{
+    char *config = getenv("MM_CONFIG");
+
+    if (config != NULL)
+        mm_load_params(config);
+    if (mem_init_vm(PRELOAD_HEAP) < 0 || mm_init() < 0)
+        return;
+    initialized = 1;
+}
+
+#define INIT()  (initialized || (pthread_once(&init_once, init), initialized))
+
+/*
+ * register_fork - Install the fork handlers once the program is loaded,
+ *     outside of any allocation (pthread_atfork may allocate itself), and
+ *     start the heap profiler if $MM_SAMPLE_RATE is set (for the same
+ *     reason: the first backtrace allocates)
+ */
+__attribute__((constructor))
+static void register_fork(void)
+{
+    char *rate = getenv("MM_SAMPLE_RATE");
+
+    if (!INIT())
+        return;
+    pthread_atfork(mm_fork_prepare, mm_fork_parent, mm_fork_child);
+    if (rate != NULL && mm_set_sample_rate(strtoul(rate, NULL, 0)) == 0 && getenv("MM_PROFILE") != NULL)
+        atexit(dump_profile);
+}
+
+/*
+ * dump_profile - Write the heap profile to $MM_PROFILE at exit
+ */
+static void dump_profile(void)
+{
+    char *format = getenv("MM_PROFILE_FORMAT");
+    FILE *fp;
+
+    if ((fp = fopen(getenv("MM_PROFILE"), "w")) == NULL)
+        return;
+    if (format != NULL && !strcmp(format, "live"))
+        mm_dump_profile(fp, MM_PROF_LIVE);
+    else if (format != NULL && !strcmp(format, "alloc"))
+        mm_dump_profile(fp, MM_PROF_ALLOC);
+    else
+        mm_dump_profile(fp, MM_PROF_PPROF);
+    fclose(fp);
+}
+
+/*
+ * ours - Return 1 if ptr is in our heap. free leaves other pointers alone,
+ *     such as those to the few blocks the dynamic linker hands out before
+ *     it calls malloc, and realloc fails on them: nothing tells how large
+ *     they are, so they can't be copied into a block of ours.
+ */
+static int ours(void *ptr)
+{
+    return initialized && (char *)ptr >= (char *)mem_heap_lo() &&
+        (char *)ptr <= (char *)mem_heap_hi();
+}
+
+void *malloc(size_t size)
+{
+    void *p;
+
+    if (!INIT()) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if ((p = mm_malloc(size ? size : 1)) == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+void free(void *ptr)
+{
+    if (ours(ptr))
+        mm_free(ptr);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *p;
+
+    if (size != 0 && nmemb > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (!INIT()) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    /* Not malloc: the compiler would turn malloc and memset into a call to calloc */
+    if ((p = mm_malloc(nmemb && size ? nmemb * size : 1)) == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    memset(p, 0, nmemb * size);
+    return p;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    void *p;
+
+    if (ptr == NULL)
+        return malloc(size);
+    if (!ours(ptr)) {
+        if (size != 0)
+            errno = ENOMEM;
+        return NULL;
+    }
+    if ((p = mm_realloc(ptr, size)) == NULL && size != 0)
+        errno = ENOMEM;
+    return p;
+}
+
+void *reallocarray(void *ptr, size_t nmemb, size_t size)
+{
+    if (size != 0 && nmemb > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return realloc(ptr, nmemb * size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    void *p;
+
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!INIT()) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if ((p = mm_memalign(alignment, size ? size : 1)) == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *p;
+
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+    if ((p = memalign(alignment, size)) == NULL)
+        return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+void *valloc(size_t size)
+{
+    return memalign(mem_pagesize(), size);
+}
+
+void *pvalloc(size_t size)
+{
+    size_t pagesize = mem_pagesize();
+
+    return memalign(pagesize, (size + pagesize - 1) & ~(pagesize - 1));
+}
+
+size_t malloc_usable_size(void *ptr)
+{
+    return ours(ptr) ? mm_usable_size(ptr) : 0;
+}
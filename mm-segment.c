@@ -0,0 +1,663 @@
+/*
+ * mm-segment.c - Segregated-fit allocator with out-of-band block metadata.
+ *
+ * An alternative layout engine to mm.c: no block carries an inline header,
+ * footer or free list links. Instead, the heap is split into SEG_SIZE (2MB)
+ * segments aligned to SEG_SIZE, and each segment starts with a dense table
+ * that describes its data area:
+ *
+ *  segment base (aligned to SEG_SIZE)
+ *  +----------+-----------------------+-------------------------+---------------------------------+
+ *  | seg_t    | tag[NUM_GRANULES]     | link[NUM_GRANULES]      | data: NUM_GRANULES granules     |
+ *  | (64 B)   | 4 B per granule       | 8 B per granule         | of GRANULE (32) bytes each      |
+ *  +----------+-----------------------+-------------------------+---------------------------------+
+ *
+ * A block is a run of granules. tag[] holds (size in granules << 1 | alloc)
+ * at the first and at the last granule of every block, which plays the role
+ * of the boundary tags. link[] holds the next/prev free list links at the
+ * first granule of a free block. Links are 32-bit references: the segment
+ * number in the upper 16 bits and the granule in the lower 16.
+ *
+ * The metadata of a payload pointer is found by masking it with SEG_SIZE-1,
+ * so mm_free reads and writes at most a few words of one table, and free
+ * list walks in find_fit never leave the tables: the payloads (and their
+ * cache lines) are never touched by the allocator.
+ *
+ * The price is the table, about 27% of each segment, which memlib counts
+ * as heap. Requests too large for a segment get a huge segment of their
+ * own, whose payload starts right after its seg_t; free huge segments are
+ * kept on a list and reused first-fit.
+ *
+ * Build mdriver with this engine with "make MM=mm-segment".
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+team_t team = {
+    "segment metadata",
+    "Khiem Vuong", "vuong067@umn.edu",
+    "", ""
+};
+
+/* Basic constants and macros */
+#define SEG_SIZE        (1UL<<21)   /* size and alignment of a segment (bytes) */
+#define GRANULE         32          /* allocation unit (bytes) */
+#define SEG_HDR_SIZE    64          /* room for the seg_t at the segment base */
+#define CHUNK_GRANULES  128         /* grow the top segment by at least this many granules */
+#define NUM_BUCKET      17
+#define NIL             0xffffffffU /* null free list reference */
+
+#define SEG_SMALL       0           /* segment of granules described by its tables */
+#define SEG_HUGE        1           /* segment holding a single large block */
+
+#define MAX(x, y) ((x) > (y)? (x) : (y))
+#define MIN(x, y) ((x) > (y)? (y) : (x))
+
+#define ALIGN_UP(x, a)  (((x) + ((a) - 1)) & ~((size_t)(a) - 1))
+
+/* Free list links of a free block, stored at its first granule */
+typedef struct {
+    uint32_t next;
+    uint32_t prev;
+} link_t;
+
+/* Segment header, at the segment base */
+typedef struct seg {
+    uint32_t kind;          /* SEG_SMALL or SEG_HUGE */
+    uint32_t index;         /* segment number, (base - first_seg) / SEG_SIZE */
+    uint32_t used;          /* SEG_SMALL: granules of the data area backed by the heap */
+    uint32_t spare;
+    size_t huge_size;       /* SEG_HUGE: payload capacity (bytes) */
+    struct seg *next_huge;  /* SEG_HUGE: next free huge segment */
+} seg_t;
+
+/* Table layout; one granule of slack keeps the data area inside the segment after aligning it */
+#define NUM_GRANULES    ((SEG_SIZE - SEG_HDR_SIZE - 64) / (GRANULE + sizeof(uint32_t) + sizeof(link_t)))
+#define TAG_OFFSET      SEG_HDR_SIZE
+#define LINK_OFFSET     (TAG_OFFSET + NUM_GRANULES * sizeof(uint32_t))
+#define DATA_OFFSET     ALIGN_UP(LINK_OFFSET + NUM_GRANULES * sizeof(link_t), 64)
+
+_Static_assert(DATA_OFFSET + NUM_GRANULES * GRANULE <= SEG_SIZE, "segment tables too large");
+_Static_assert(NUM_GRANULES <= 0xffff, "granule number must fit in 16 bits");
+_Static_assert(sizeof(seg_t) <= SEG_HDR_SIZE, "seg_t too large");
+
+/* Given a pointer into a segment's first SEG_SIZE bytes, get the segment */
+#define SEG_OF(p)       ((seg_t *)((uintptr_t)(p) & ~(SEG_SIZE - 1)))
+#define TAGS(s)         ((uint32_t *)((char *)(s) + TAG_OFFSET))
+#define LINKS(s)        ((link_t *)((char *)(s) + LINK_OFFSET))
+#define DATA(s)         ((char *)(s) + DATA_OFFSET)
+#define GRAN_OF(s, p)   ((uint32_t)(((char *)(p) - DATA(s)) / GRANULE))
+#define PAYLOAD(s, g)   (DATA(s) + (size_t)(g) * GRANULE)
+#define HUGE_PAYLOAD(s) ((char *)(s) + SEG_HDR_SIZE)
+
+/* Tags: size in granules and allocated bit */
+#define PACK(n, alloc)  (((uint32_t)(n) << 1) | (alloc))
+#define TAG_SIZE(t)     ((t) >> 1)
+#define TAG_ALLOC(t)    ((t) & 1)
+
+/* Free list references */
+#define REF(s, g)       (((s)->index << 16) | (g))
+#define REF_SEG(r)      ((seg_t *)(first_seg + (size_t)((r) >> 16) * SEG_SIZE))
+#define REF_GRAN(r)     ((r) & 0xffff)
+
+/* Global variables */
+static char *first_seg;                 /* first segment */
+static seg_t *top_seg;                  /* last segment if it's a small one (the only one that can grow), else NULL */
+static uint32_t free_head[NUM_BUCKET];  /* heads of the segregated free lists */
+static seg_t *huge_free;                /* free huge segments */
+static size_t free_bytes;               /* bytes in the free lists */
+
+/* Upper bounds (bytes) of the buckets; the last one takes everything else */
+static const size_t bucket_limit[NUM_BUCKET - 1] = {
+    32, 64, 96, 128, 256, 512, 1024, 2048, 4096, 8192,
+    16384, 32768, 65536, 131072, 262144, 524288
+};
+
+/* Internal helper functions */
+static int bucket_of(uint32_t n);
+static void set_block(seg_t *s, uint32_t g, uint32_t n, int alloc);
+static void insert(seg_t *s, uint32_t g, uint32_t n);
+static void delete(seg_t *s, uint32_t g, uint32_t n);
+static void release(seg_t *s, uint32_t g, uint32_t n);
+static uint32_t find_fit(uint32_t n);
+static void place(seg_t *s, uint32_t g, uint32_t n);
+static int extend_top(uint32_t n);
+static int close_top(void);
+static seg_t *new_segment(size_t bytes, uint32_t kind);
+static void *huge_malloc(size_t size);
+static uint32_t granules(size_t size);
+static char *next_segment(seg_t *s);
+
+/*
+ * mm_init - Align the break to SEG_SIZE and forget about all segments; the
+ *     first one is created by the first mm_malloc
+ */
+int mm_init(void)
+{
+    char *brk = (char *)mem_heap_hi() + 1;
+    size_t pad = ALIGN_UP((uintptr_t)brk, SEG_SIZE) - (uintptr_t)brk;
+
+    if (pad && mem_sbrk(pad) == (void *)-1)
+        return -1;
+    first_seg = brk + pad;
+    top_seg = NULL;
+    huge_free = NULL;
+    free_bytes = 0;
+    memset(free_head, 0xff, sizeof(free_head));
+    return 0;
+}
+
+/*
+ * mm_malloc - Search the free lists for a fit; if there is none, grow the
+ *     top segment (or start a new one) and try again
+ */
+void *mm_malloc(size_t size)
+{
+    uint32_t n, ref;
+
+    if (size == 0)
+        return NULL;
+    if (size > (size_t)NUM_GRANULES * GRANULE)
+        return huge_malloc(size);
+
+    n = granules(size);
+    if ((ref = find_fit(n)) == NIL) {
+        if (extend_top(MAX(n, CHUNK_GRANULES)) < 0)
+            return NULL;
+        ref = find_fit(n);
+    }
+    place(REF_SEG(ref), REF_GRAN(ref), n);
+    return PAYLOAD(REF_SEG(ref), REF_GRAN(ref));
+}
+
+/*
+ * mm_malloc_hint - This engine has no lifetime regions; hints are ignored
+ */
+void *mm_malloc_hint(size_t size, int hint)
+{
+    return mm_malloc(size);
+}
+
+/*
+ * mm_free - Free a block: only the segment table is touched
+ */
+void mm_free(void *ptr)
+{
+    seg_t *s;
+    uint32_t g;
+
+    if (ptr == NULL)
+        return;
+    s = SEG_OF(ptr);
+    if (s->kind == SEG_HUGE) {
+        s->next_huge = huge_free;
+        huge_free = s;
+        return;
+    }
+    g = GRAN_OF(s, ptr);
+    release(s, g, TAG_SIZE(TAGS(s)[g]));
+}
+
+/*
+ * mm_realloc - Shrink in place, or grow in place into a free next block
+ *     (growing the top segment under the block if it's the last one).
+ *     Otherwise allocate a new block, copy and free the old one.
+ */
+void *mm_realloc(void *ptr, size_t size)
+{
+    seg_t *s;
+    uint32_t g, n, want, next, nn;
+    size_t oldsize;
+    void *newptr;
+
+    if (ptr == NULL)
+        return mm_malloc(size);
+    if (size == 0) {
+        mm_free(ptr);
+        return NULL;
+    }
+
+    s = SEG_OF(ptr);
+    if (s->kind == SEG_HUGE) {
+        if (size <= s->huge_size)
+            return ptr;
+        oldsize = s->huge_size;
+    }
+    else {
+        g = GRAN_OF(s, ptr);
+        n = TAG_SIZE(TAGS(s)[g]);
+        oldsize = (size_t)n * GRANULE;
+
+        if (size <= (size_t)NUM_GRANULES * GRANULE) {
+            want = granules(size);
+            next = g + n;
+            if (want > n && s == top_seg && next == s->used &&
+                s->used + (want - n) <= NUM_GRANULES) {     /* last block: grow the segment under it */
+                if (extend_top(MAX(want - n, CHUNK_GRANULES)) < 0)
+                    return NULL;
+            }
+            nn = (next < s->used && !TAG_ALLOC(TAGS(s)[next])) ? TAG_SIZE(TAGS(s)[next]) : 0;
+
+            if (want <= n + nn) {
+                if (want > n) {                             /* absorb the free next block */
+                    delete(s, next, nn);
+                    n += nn;
+                }
+                if (n > want) {                             /* give back what's not needed */
+                    set_block(s, g, want, 1);
+                    release(s, g + want, n - want);
+                }
+                else
+                    set_block(s, g, n, 1);
+                return ptr;
+            }
+        }
+    }
+
+    if ((newptr = mm_malloc(size)) == NULL)
+        return NULL;
+    memcpy(newptr, ptr, MIN(size, oldsize));
+    mm_free(ptr);
+    return newptr;
+}
+
+/*
+ * mm_check - Walk every segment and the free lists, and print what is
+ *     inconsistent. Returns 1.
+ */
+int mm_check(int verbose)
+{
+    char *brk = (char *)mem_heap_hi() + 1;
+    size_t inlists = 0, inheap = 0, freebytes = 0;
+    seg_t *s;
+    uint32_t g, t, ref;
+    int i;
+
+    for (s = (seg_t *)first_seg; (char *)s < brk; s = (seg_t *)next_segment(s)) {
+        if (verbose)
+            printf("segment %u at %p: %s\n", s->index, (void *)s,
+                   s->kind == SEG_HUGE ? "huge" : "small");
+        if (s->index != ((char *)s - first_seg) / SEG_SIZE)
+            printf("Error: segment %p has a wrong index\n", (void *)s);
+        if (s->kind == SEG_HUGE)
+            continue;
+
+        for (g = 0; g < s->used; g += TAG_SIZE(t)) {
+            t = TAGS(s)[g];
+            if (TAG_SIZE(t) == 0 || g + TAG_SIZE(t) > s->used) {
+                printf("Error: bad block size at granule %u of segment %u\n", g, s->index);
+                break;
+            }
+            if (TAGS(s)[g + TAG_SIZE(t) - 1] != t)
+                printf("Error: tags of block %p do not match\n", PAYLOAD(s, g));
+            if (verbose)
+                printf("  %p: %u granules, %s\n", PAYLOAD(s, g), TAG_SIZE(t),
+                       TAG_ALLOC(t) ? "allocated" : "free");
+            if (!TAG_ALLOC(t)) {
+                inheap++;
+                freebytes += (size_t)TAG_SIZE(t) * GRANULE;
+                if (g + TAG_SIZE(t) < s->used && !TAG_ALLOC(TAGS(s)[g + TAG_SIZE(t)]))
+                    printf("Error: free block %p escaped coalescing\n", PAYLOAD(s, g));
+            }
+        }
+    }
+
+    for (i = 0; i < NUM_BUCKET; i++) {
+        for (ref = free_head[i]; ref != NIL; ref = LINKS(REF_SEG(ref))[REF_GRAN(ref)].next) {
+            t = TAGS(REF_SEG(ref))[REF_GRAN(ref)];
+            inlists++;
+            if (TAG_ALLOC(t))
+                printf("Error: allocated block %p in a free list\n", PAYLOAD(REF_SEG(ref), REF_GRAN(ref)));
+            if (bucket_of(TAG_SIZE(t)) != i)
+                printf("Error: block %p in the wrong bucket\n", PAYLOAD(REF_SEG(ref), REF_GRAN(ref)));
+        }
+    }
+    if (inlists != inheap || freebytes != free_bytes)
+        printf("Error: free lists hold %lu blocks, the heap %lu\n",
+               (unsigned long)inlists, (unsigned long)inheap);
+    return 1;
+}
+
+/*
+ * mm_reserve - Make sure the top segment ends in a free block of at least
+ *     bytes bytes (as far as one segment can hold), optionally prefaulted
+ */
+int mm_reserve(size_t bytes, int flags)
+{
+    uint32_t n = MIN(granules(bytes), NUM_GRANULES), have = 0;
+    seg_t *s = top_seg;
+    uint32_t last;
+
+    if (bytes == 0)
+        return 0;
+    if (s && s->used > 0) {
+        last = TAGS(s)[s->used - 1];
+        if (!TAG_ALLOC(last))
+            have = TAG_SIZE(last);
+    }
+    if (have < n && extend_top(n - have) < 0)
+        return -1;
+
+    s = top_seg;
+    last = TAGS(s)[s->used - 1];
+    if (flags & MM_RESERVE_PREFAULT)
+        mem_prefault(PAYLOAD(s, s->used - TAG_SIZE(last)), (size_t)TAG_SIZE(last) * GRANULE);
+    return 0;
+}
+
+/*
+ * mm_get_stats - This engine has a single (first-fit) policy; only the
+ *     free byte count is meaningful
+ */
+void mm_get_stats(mm_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->policy = MM_POLICY_FAST;
+    stats->chunksize = CHUNK_GRANULES * GRANULE;
+    stats->free_bytes = free_bytes;
+}
+
+/*
+ * mm_get_counters - Only the heap size and the free byte count are kept
+ *     by this engine; everything else is 0
+ */
+int mm_get_counters(mm_counters_t *counters)
+{
+    memset(counters, 0, sizeof(*counters));
+    counters->heap_bytes = mem_heapsize();
+    counters->free_bytes = free_bytes;
+    counters->live_bytes = counters->heap_bytes - free_bytes;
+    return -1;
+}
+
+/*
+ * mm_print_stats - Write what mm_get_counters knows
+ */
+int mm_print_stats(FILE *fp, int format)
+{
+    mm_counters_t c;
+
+    mm_get_counters(&c);
+    if (format == MM_STATS_JSON)
+        fprintf(fp, "{\"heap_bytes\": %lu, \"live_bytes\": %lu, \"free_bytes\": %lu, \"counted\": false}\n",
+                (unsigned long)c.heap_bytes, (unsigned long)c.live_bytes, (unsigned long)c.free_bytes);
+    else
+        fprintf(fp, "heap %lu bytes: %lu live, %lu free\n", (unsigned long)c.heap_bytes,
+                (unsigned long)c.live_bytes, (unsigned long)c.free_bytes);
+    return ferror(fp) ? -1 : 0;
+}
+
+/*
+ * mm_dump_heap - Not available: this engine has no header words to write
+ */
+int mm_dump_heap(FILE *fp, uint64_t tag)
+{
+    return -1;
+}
+
+/*
+ * mm_dump_trace - This engine has no trace points
+ */
+int mm_dump_trace(FILE *fp, int format)
+{
+    return -1;
+}
+
+/*
+ * mm_set_params, mm_get_params, mm_load_params, mm_save_params - This
+ *     engine has none of the tunable parameters of mm.c: setting them
+ *     fails, and the ones reported are all 0
+ */
+int mm_set_params(const mm_params_t *params)
+{
+    return -1;
+}
+
+void mm_get_params(mm_params_t *params)
+{
+    memset(params, 0, sizeof(*params));
+}
+
+int mm_load_params(const char *path)
+{
+    return -1;
+}
+
+int mm_save_params(const char *path)
+{
+    return -1;
+}
+
+/* =============================================================================================================
+ * =============================== HELPER FUNCTIONS ============================================================
+ *==============================================================================================================
+ */
+
+/*
+ * granules - Number of granules needed for a payload of size bytes
+ */
+static uint32_t granules(size_t size)
+{
+    return (uint32_t)((size + GRANULE - 1) / GRANULE);
+}
+
+/*
+ * bucket_of - Bucket of a free block of n granules
+ */
+static int bucket_of(uint32_t n)
+{
+    size_t bytes = (size_t)n * GRANULE;
+    int i = 0;
+
+    while (i < NUM_BUCKET - 1 && bytes > bucket_limit[i])
+        i++;
+    return i;
+}
+
+/*
+ * set_block - Write the tags of the block of n granules at granule g
+ */
+static void set_block(seg_t *s, uint32_t g, uint32_t n, int alloc)
+{
+    uint32_t *tags = TAGS(s);
+
+    tags[g] = PACK(n, alloc);
+    tags[g + n - 1] = PACK(n, alloc);
+}
+
+/*
+ * insert - Push the free block of n granules at granule g onto its free list
+ */
+static void insert(seg_t *s, uint32_t g, uint32_t n)
+{
+    int b = bucket_of(n);
+    uint32_t ref = REF(s, g), head = free_head[b];
+    link_t *l = &LINKS(s)[g];
+
+    l->prev = NIL;
+    l->next = head;
+    if (head != NIL)
+        LINKS(REF_SEG(head))[REF_GRAN(head)].prev = ref;
+    free_head[b] = ref;
+    free_bytes += (size_t)n * GRANULE;
+}
+
+/*
+ * delete - Unlink the free block of n granules at granule g from its free list
+ */
+static void delete(seg_t *s, uint32_t g, uint32_t n)
+{
+    link_t *l = &LINKS(s)[g];
+
+    if (l->prev != NIL)
+        LINKS(REF_SEG(l->prev))[REF_GRAN(l->prev)].next = l->next;
+    else
+        free_head[bucket_of(n)] = l->next;
+    if (l->next != NIL)
+        LINKS(REF_SEG(l->next))[REF_GRAN(l->next)].prev = l->prev;
+    free_bytes -= (size_t)n * GRANULE;
+}
+
+/*
+ * release - Mark the n granules at granule g free, coalesce them with free
+ *     neighbors in the same segment and insert the result
+ */
+static void release(seg_t *s, uint32_t g, uint32_t n)
+{
+    uint32_t *tags = TAGS(s);
+    uint32_t t;
+
+    if (g > 0 && !TAG_ALLOC(t = tags[g - 1])) {                 /* previous block is free */
+        delete(s, g - TAG_SIZE(t), TAG_SIZE(t));
+        g -= TAG_SIZE(t);
+        n += TAG_SIZE(t);
+    }
+    if (g + n < s->used && !TAG_ALLOC(t = tags[g + n])) {       /* next block is free */
+        delete(s, g + n, TAG_SIZE(t));
+        n += TAG_SIZE(t);
+    }
+    set_block(s, g, n, 0);
+    insert(s, g, n);
+}
+
+/*
+ * find_fit - First fit over the free lists, starting at the bucket of n.
+ *     Returns a reference to the block, or NIL.
+ */
+static uint32_t find_fit(uint32_t n)
+{
+    uint32_t ref;
+    seg_t *s;
+    int b;
+
+    for (b = bucket_of(n); b < NUM_BUCKET; b++) {
+        for (ref = free_head[b]; ref != NIL; ref = LINKS(s)[REF_GRAN(ref)].next) {
+            s = REF_SEG(ref);
+            if (TAG_SIZE(TAGS(s)[REF_GRAN(ref)]) >= n)
+                return ref;
+        }
+    }
+    return NIL;
+}
+
+/*
+ * place - Allocate n granules at the start of the free block at granule g,
+ *     splitting off the rest. The block after a free block is never free,
+ *     so the rest needs no coalescing.
+ */
+static void place(seg_t *s, uint32_t g, uint32_t n)
+{
+    uint32_t size = TAG_SIZE(TAGS(s)[g]);
+
+    delete(s, g, size);
+    set_block(s, g, n, 1);
+    if (size > n) {
+        set_block(s, g + n, size - n, 0);
+        insert(s, g + n, size - n);
+    }
+}
+
+/*
+ * extend_top - Back n more granules at the end of the top segment with
+ *     heap memory and release them as a free block. If the top segment
+ *     can't hold them, it is closed and a new one is started.
+ */
+static int extend_top(uint32_t n)
+{
+    seg_t *s = top_seg;
+    uint32_t g;
+
+    if (s == NULL || s->used + n > NUM_GRANULES) {
+        if (close_top() < 0 || (s = new_segment(DATA_OFFSET, SEG_SMALL)) == NULL)
+            return -1;
+        top_seg = s;
+        n = MIN(n, NUM_GRANULES);
+    }
+    if (mem_sbrk(n * GRANULE) == (void *)-1)
+        return -1;
+    g = s->used;
+    s->used += n;
+    release(s, g, n);
+    return 0;
+}
+
+/*
+ * close_top - Hand the rest of the top segment out as a free block and
+ *     move the break to the end of the segment, so that the next segment
+ *     starts aligned
+ */
+static int close_top(void)
+{
+    seg_t *s = top_seg;
+    uint32_t n;
+
+    if (s == NULL)
+        return 0;
+    if ((n = NUM_GRANULES - s->used) > 0) {
+        if (mem_sbrk(n * GRANULE) == (void *)-1)
+            return -1;
+        s->used += n;
+        release(s, s->used - n, n);
+    }
+    top_seg = NULL;
+    return 0;
+}
+
+/*
+ * new_segment - Start a segment of the given kind at the next SEG_SIZE
+ *     boundary, with bytes bytes (header and tables included) backed by
+ *     the heap
+ */
+static seg_t *new_segment(size_t bytes, uint32_t kind)
+{
+    char *brk = (char *)mem_heap_hi() + 1;
+    size_t pad = ALIGN_UP((uintptr_t)brk, SEG_SIZE) - (uintptr_t)brk;
+    seg_t *s;
+
+    if (mem_sbrk(pad + bytes) == (void *)-1)
+        return NULL;
+    s = (seg_t *)(brk + pad);
+    s->kind = kind;
+    s->index = ((char *)s - first_seg) / SEG_SIZE;
+    s->used = 0;
+    s->huge_size = 0;
+    s->next_huge = NULL;
+    return s;
+}
+
+/*
+ * huge_malloc - Allocate a request too large for a segment: reuse a free
+ *     huge segment that is large enough, or start a new one
+ */
+static void *huge_malloc(size_t size)
+{
+    seg_t **sp, *s;
+
+    for (sp = &huge_free; (s = *sp) != NULL; sp = &s->next_huge) {
+        if (s->huge_size >= size) {
+            *sp = s->next_huge;
+            return HUGE_PAYLOAD(s);
+        }
+    }
+
+    size = ALIGN_UP(size, GRANULE);
+    if (close_top() < 0 || (s = new_segment(SEG_HDR_SIZE + size, SEG_HUGE)) == NULL)
+        return NULL;
+    s->huge_size = size;
+    return HUGE_PAYLOAD(s);
+}
+
+/*
+ * next_segment - Address of the segment following s
+ */
+static char *next_segment(seg_t *s)
+{
+    if (s->kind == SEG_HUGE)
+        return (char *)s + ALIGN_UP(SEG_HDR_SIZE + s->huge_size, SEG_SIZE);
+    return (char *)s + SEG_SIZE;
+}
@@ -62,9 +62,71 @@ bp+WSIZE--> +--+--+--+--+--+--+--+--+--+--+--+--+--+--+--+--+--+--+--+--+--+--+-
  * 
  * About insertion policy, I adopt LIFO, which is simple and constant time but causes worse fragmentation (trade-off again).
  * 
+ * The first-fit policy above is only the "fast" policy. The allocator keeps an online estimate of external fragmentation (the share of
+ * free bytes sitting in blocks smaller than the typical request) and of the average find_fit search length. Every POLICY_WINDOW mallocs
+ * it re-evaluates them and switches to a "dense" policy (near best-fit, heap grows by params.chunk) when the free lists look fragmented,
+ * and back to the fast policy (first-fit, heap grows geometrically up to params.max_chunk) once they recover. The dense policy also has
+ * to earn its longer searches: when the blocks it looks at past the first fit stop saving space, it is dropped and held off for a while.
+ * Switches are recorded in mm_get_stats.
+ * 
  * About coalescing, immediate coalescing is chosen: when a block is freed, it's immediately coalesced, and the new freed, coalesced block is put into
  * the appropriate class size (bucket) of segregated free lists. 
  *
+ * The one exception is the wilderness, the free block right before the epilogue. It is never put into a free list: it's only used when no other
+ * fit exists, and then the request is carved off its start by bumping the wilderness pointer. This keeps the only region that can serve a large
+ * request without growing the heap in one piece, and makes allocation from a fresh heap (empty free lists) a short, branch-light path.
+ *
+ * Optionally (mm_set_coloring), large blocks are cache-colored: the start of each one is pushed back by a rotating number of cache lines,
+ * and the skipped lines are split off as a small free block. Otherwise same-size large buffers all start at the same offset within a
+ * page and alias into the same cache sets when they are walked in lockstep.
+ *
+ * Blocks allocated with a lifetime hint (mm_malloc_hint) live in their own region: short-lived, long-lived or unhinted blocks each have
+ * their own set of segregated lists, the region is kept in two spare bits of the header and footer, and free blocks of different regions
+ * are not coalesced (anything still merges into the wilderness). Hinted regions take memory off the wilderness REGION_CHUNK bytes at a
+ * time, so a long-lived block doesn't end up pinned between short-lived ones. In auto mode the region is predicted per size class from
+ * a sample of earlier blocks whose lifetime (in mallocs) was observed on free.
+ *
+ * Blocks allocated through a handle (mm_halloc) are movable: they are marked by a bit in the header and footer and keep the number of
+ * their handle in the first word of the block. The handle table is an ordinary block in the heap. mm_compact slides unpinned movable
+ * blocks down over the free block in front of them, a bounded amount of work per call, resuming at a cursor that always points at a
+ * block; once a pass reaches the wilderness, the wilderness is given back with mem_trim.
+ *
+ * Blocks that lock-free readers may still be looking at are retired with mm_free_deferred instead of freed. Readers bracket their
+ * accesses with mm_enter/mm_exit, which publishes the global epoch they saw in a per-thread record. A block retired in epoch e is
+ * safe to free once the global epoch has reached e+2; the epoch only advances when every active reader has seen the current one.
+ * Safe blocks are freed in batches sorted by address, so that runs of retired neighbors are merged into one free block before
+ * coalescing and go through the free lists only once.
+ *
+ * Built with -DMM_THREAD_SAFE (and -pthread), every public function takes a global mutex (MM_LOCK/MM_UNLOCK). mm_init and mm_check
+ * don't; they are meant to be called while no other thread uses the allocator.
+ *
+ * Such a build can also run on a heap that memlib shares between processes (mem_init_shared). With -DMM_SHARED_HEAP, all the links
+ * kept in the heap are offsets from its start, so each process may map it anywhere; without it they are plain pointers, which spares
+ * the heaps of a single process the arithmetic, and the heap may only be used where it was set up. The mutex is then a robust, process-shared one in the header page of
+ * the heap, next to the globals that describe the heap; a process loads those into its own globals when it takes the lock and writes
+ * them back before it lets go. The first mm_init sets the heap up, later ones (in other processes) attach to it.
+ *
+ * The same goes for a heap kept in a file (mem_init_file), which is how it survives a restart: mm_init finds the state it left in the
+ * header page and attaches to the heap instead of formatting it, and mm_checkpoint has it written to disk. A heap put back to a
+ * snapshot (mem_restore) is picked up the same way.
+ *
+ * Returning idle memory to the system and faulting in fresh memory both cost system calls, so they are left to a maintenance pass
+ * (mm_maintain, run every interval by a thread of its own with MM_THREAD_SAFE) instead of mm_free and extend_heap. Free blocks of at
+ * least purge_min bytes carry an age stamp, the pass number they were inserted in, in their third payload word, and the number of
+ * bytes of them decommitted so far in the fourth. Each pass decommits a growing share of every such block, following a smoothstep
+ * of its age over the decay time, and does the same for the wilderness by trimming it from the top. memlib keeps the headroom
+ * above the break faulted in, so the heap grows into pages that are already there.
+ *
+ * The heap can be given a soft and a hard limit on its committed memory (mm_set_limits), checked whenever it grows. A growth past
+ * either limit fails and flags the calling thread as under pressure; the public function then runs the pressure callbacks without
+ * the lock, gives back all the idle memory it can and retries once, this time allowed past the soft limit but not the hard one.
+ *
+ * The heap profiler (mm_set_sample_rate) follows the byte count of each thread's allocations down to a randomly drawn sampling point,
+ * so that the gaps between samples are exponentially distributed with the sample rate as mean. Past the point, the public function
+ * records the call stack of its block with backtrace, without the lock, and then files the block under its stack in an address-hashed
+ * table that free_block checks whenever it's not empty, as with the lifetime samples. Each sample stands for 1 / P(sampled) blocks of
+ * its size, which is what the profile reports. With the profiler off, the cost is one thread-local subtraction per allocation.
+ *
  * A place for optimizing is mm_realloc. More detailed comments will be at the actual mm_realloc function, but basically I need to avoid copying
  * data over and over by trying to extend the current block whenever possible. A useful trick I adopt is to insert a small padding bytes (realloc_padding)
  * to the size of each block when mm_realloc is called, which increases the size of the block to make space for future realloc.
@@ -72,14 +134,34 @@ bp+WSIZE--> +--+--+--+--+--+--+--+--+--+--+--+--+--+--+--+--+--+--+--+--+--+--+-
  * 
  * -------------------------------------- END -------------------------------------------
  */
+#define _GNU_SOURCE                         /* dladdr */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <math.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <sys/mman.h>
+
+#include <pthread.h>
+
+#ifdef MM_THREAD_SAFE
+#include <time.h>
+#include <errno.h>
+#endif
+#ifdef MM_TRACE
+#include <time.h>
+#endif
 
 #include "mm.h"
 #include "memlib.h"
+#include "mm_buckets.h"
 
 /*********************************************************
  * NOTE TO STUDENTS: Before you do anything else, please
@@ -98,6 +180,35 @@ team_t team = {
     ""
 };
 
+/* Serialize the public functions if built with MM_THREAD_SAFE */
+#ifdef MM_THREAD_SAFE
+static pthread_mutex_t mm_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t *mm_lockp = &mm_lock;   /* the lock in use: mm_lock, or the one of a shared heap */
+#define MM_LOCK()       lock_heap()
+#define MM_UNLOCK()     unlock_heap()
+#else
+#define MM_LOCK()
+#define MM_UNLOCK()     do { if (shared != NULL) save_shared(); } while (0)    /* keep the header of a file heap current */
+#endif
+
+/* Event counters (mm_get_counters), kept with -DMM_STATS. They only change under the lock, so plain increments do. */
+/* Trace points (MM_TRACE): TRACE_START(t) takes the start time, TRACE records the event from then until now */
+#ifdef MM_TRACE
+#define TRACE_START(t)              uint64_t t = trace_now()
+#define TRACE(event, t, size, arg)  trace_event(event, t, size, (uint64_t) (arg))
+#else
+#define TRACE_START(t)              ((void) 0)
+#define TRACE(event, t, size, arg)  ((void) 0)
+#endif
+
+#ifdef MM_STATS
+#define STAT_INC(field)     (counters.field++)
+#define STAT_SEARCH(nodes)  (counters.search_hist[search_bin(nodes)]++)
+#else
+#define STAT_INC(field)     ((void) 0)
+#define STAT_SEARCH(nodes)  ((void) (nodes))
+#endif
+
 /* Basic constants and macros */
 
 #define ALIGNMENT 16
@@ -109,11 +220,72 @@ team_t team = {
 
 #define WSIZE               8        /* word size (bytes) */
 #define DSIZE               16       /* doubleword size (bytes) */
-#define INIT_CHUNKSIZE      (1<<6)   /* initial heap size (bytes) */
-#define CHUNKSIZE           (1<<12)  
+#define INIT_CHUNKSIZE      (1<<6)   /* initial heap size (bytes), default of params.init_chunk */
+#define CHUNKSIZE           (1<<12)  /* default of params.chunk */
 #define OVERHEAD            16       /* overhead of header and footer (bytes) */
-#define NUM_BUCKET          17
-#define REALLOC_PADDING     (1<<7)   /* padding chunk to increase efficiency of realloc*/
+#define NUM_BUCKET          MM_NUM_BUCKETS
+#define BUCKET_TABLE_MAX    4096     /* getSeglistSize looks the bucket of smaller block sizes up in bucket_table */
+#define REALLOC_PADDING     (1<<7)   /* padding chunk to increase efficiency of realloc, default of params.realloc_pad */
+#define MAX_REQUEST         ((size_t) INT_MAX - CHUNKSIZE)  /* larger requests can't be met (mem_sbrk takes an int) */
+
+/* Adaptive placement policy */
+#define POLICY_WINDOW       512              /* mallocs between two policy evaluations */
+#define GROWTH_SHIFT        4                /* the fast policy grows the heap by 1/16 of its size at a time... */
+#define MAX_CHUNKSIZE       (1<<20)          /* ...but never by more than this in one step (default of params.max_chunk) */
+#define MAX_PARAM_CHUNK     (1<<30)          /* bound on the chunk parameters (mem_sbrk takes an int) */
+#define PARAMS_FILE_MAX     4096             /* longest parameter file mm_load_params reads (bytes) */
+#define FRAG_HIGH           0.5              /* switch to the dense policy above this fragmentation... */
+#define FRAG_LOW            0.25             /* ...and back to the fast policy below this one */
+#define SEARCH_HIGH         8                /* average search length that also calls for the dense policy */
+#define BEST_FIT_SCAN       2                /* blocks the dense policy looks at past the first fit */
+#define DENSE_MIN_BETTER    8                /* one in this many of those blocks must be a better fit to keep the dense policy... */
+#define DENSE_HOLD          8                /* ...or it is held off for this many windows */
+
+#define CACHE_LINE          64       /* unit of the cache coloring offsets (bytes) */
+
+/* Lifetime regions */
+#define REGION_ANY          0                /* unhinted blocks */
+#define REGION_SHORT        MM_SHORT_LIVED
+#define REGION_LONG         MM_LONG_LIVED
+#define NUM_REGION          3
+#define REGION_CHUNK        CHUNKSIZE        /* hinted regions take the wilderness this many bytes at a time */
+#define LIFETIME_SAMPLE     16               /* auto mode follows one in this many blocks... */
+#define LIFETIME_SLOTS      256              /* ...in a table of this many entries */
+#define LIFETIME_CLASSES    64               /* size classes the lifetime is predicted for */
+#define SHORT_LIFETIME      4096             /* a block freed within this many mallocs is short-lived */
+#define LIFETIME_CONFIDENCE 2                /* score a size class needs to be predicted either way */
+
+/* Movable blocks */
+#define MOVABLE             0x8              /* header bit of blocks allocated through a handle */
+#define HANDLE_TABLE_INIT   64               /* initial number of handles */
+
+/* Deferred frees */
+#define EPOCH_THREADS       64               /* threads that can enter critical sections */
+#define RETIRE_BATCH        64               /* try to reclaim every this many retired blocks */
+#define RETIRE_INIT         64               /* initial size of the retire list */
+
+/* Background maintenance */
+#define STAMP(bp)           ((char *)(bp) + 2*WSIZE)    /* age stamp of a free block of at least purge_min bytes... */
+#define PURGED(bp)          ((char *)(bp) + 3*WSIZE)    /* ...and how many of its bytes were decommitted */
+
+/* Memory budget */
+#define PRESSURE_CALLBACKS  8                /* callbacks that can be registered */
+
+/* Heap profiler */
+#define PROF_DEPTH          MM_PROF_DEPTH    /* frames kept of each call stack */
+#define PROF_SKIP           2                /* innermost frames left out: prof_sample and the public function */
+#define PROF_STACKS         4096             /* distinct call stacks kept (a power of two)... */
+#define PROF_OBJECTS        (1<<16)          /* ...and sampled blocks followed at once; either table is used up to 3/4 */
+#define PROF_IDLE           (1<<20)          /* bytes a thread allocates between two looks at whether sampling was turned on */
+#define PROF_MAX_GAP        ((double) LONG_MAX / 2)     /* bound on the gap to the next sample */
+#define PROF_SLOT(bp)       ((((size_t) (bp) >> 4) * 2654435761u) & (PROF_OBJECTS - 1))
+
+/* Count size bytes allocated as bp by the calling thread, and sample the block if that passes its sampling point */
+#define PROF_ALLOC(bp, size) \
+    do { if ((bp) != NULL && (prof_countdown -= (long) (size)) < 0) prof_sample(bp, size); } while (0)
+
+/* Event tracing (MM_TRACE) */
+#define TRACE_THREADS       256              /* threads that get a ring buffer */
 
 #define MAX(x, y) ((x) > (y)? (x) : (y))
 #define MIN(x, y) ((x) > (y)? (y) : (x))
@@ -126,9 +298,16 @@ team_t team = {
 #define PUT(p, val)  (*(size_t *)(p) = (val))
 
 /* Read the size and allocated fields from address p */
-#define GET_SIZE(p)  (GET(p) & ~0x7)
+#define GET_SIZE(p)  (GET(p) & ~0xf)
 #define GET_ALLOC(p) (GET(p) & 0x1)
 
+/* Read the lifetime region at address p, and shift a region into place for PACK */
+#define GET_REGION(p)   ((GET(p) >> 1) & 0x3)
+#define REGION_BITS(r)  ((size_t)(r) << 1)
+
+/* Read the movable bit at address p */
+#define GET_MOVABLE(p)  (GET(p) & MOVABLE)
+
 /* Given block ptr bp, compute address of its header and footer */
 #define HDRP(bp)       ((char *)(bp) - WSIZE)
 #define FTRP(bp)       ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
@@ -138,31 +317,326 @@ team_t team = {
 /* Given block ptr bp, compute address of next and previous blocks */
 #define NEXT_BLKP(bp)  ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
 #define PREV_BLKP(bp)  ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
-#define PRED_BLKP(bp)  ((char *) GET(PRED(bp)))
-#define SUCC_BLKP(bp)  ((char *) GET(SUCC(bp)))
+#define PRED_BLKP(bp)  TO_PTR(GET(PRED(bp)))
+#define SUCC_BLKP(bp)  TO_PTR(GET(SUCC(bp)))
+
+/*
+ * Links kept in the heap (free list pointers and heads, handle table entries). Built with -DMM_SHARED_HEAP, they are offsets from the
+ * start of the heap, so that a heap shared between processes works wherever each of them maps it; otherwise they are plain pointers,
+ * and a shared heap or a file must be mapped where it was set up (open_shared).
+ *
+ * As an offset, 0 stands for NULL, yet it is also where the head of bucket 0 of the unhinted lists is (free_listp is heap_base). The
+ * first block of a list links back to the head of its list as its predecessor (insert), so a block of bucket 0 would get 0, NULL, for
+ * it and couldn't be unlinked. Bucket 0 must therefore stay empty: the first limit of mm_buckets.h (which mkbuckets writes as
+ * EMPTY_LIMIT) is below the smallest block, DSIZE + OVERHEAD, as the _Static_assert below checks. That costs one list head that is
+ * never used, in the builds with plain pointers too, since they share mm_buckets.h and the layout of the heap.
+ */
+#ifdef MM_SHARED_HEAP
+#define TO_OFF(p)      ((p) ? (size_t)(p) - (size_t) heap_base : 0)
+#define TO_PTR(off)    ((off) ? (char *) ((size_t) heap_base + (off)) : NULL)
+#else
+#define TO_OFF(p)      ((size_t)(p))
+#define TO_PTR(off)    ((char *)(off))
+#endif
 
 /* Global variables */
+static char *heap_base;   /* start of the heap, what the links in the heap are relative to */
 static char *heap_listp;  /* pointer to first block */
-static char **free_listp; /* pointer to pointers to segregated free lists */
+static size_t *free_listp; /* pointer to the heads (offsets) of segregated free lists */
+static char *wilderness;  /* free block right before the epilogue (NULL if the last block is allocated) */
+static size_t *region_listp[NUM_REGION];            /* segregated free lists of each lifetime region... */
+static size_t hinted_lists[NUM_REGION - 1][NUM_BUCKET]; /* ...those of the hinted regions live here (or in the shared state) */
+static int hinted;        /* a hinted region has been given memory: until then, every block is in REGION_ANY */
+static const size_t bucket_limits[] = { MM_BUCKET_LIMITS };   /* largest block size of each bucket but the last (mm_buckets.h) */
+_Static_assert(sizeof(bucket_limits) / sizeof(bucket_limits[0]) == NUM_BUCKET - 1, "mm_buckets.h must have NUM_BUCKET - 1 limits");
+#define FIRST_LIMIT(...)    FIRST_LIMIT_(__VA_ARGS__)
+#define FIRST_LIMIT_(x, ...) (x)
+/* The head of the first list is at offset 0, which the links can't tell from NULL: no block may go into bucket 0 */
+_Static_assert(FIRST_LIMIT(MM_BUCKET_LIMITS) < DSIZE + OVERHEAD, "bucket 0 of mm_buckets.h must stay empty");
+static unsigned char bucket_table[BUCKET_TABLE_MAX / DSIZE + 1];   /* bucket of each block size up to BUCKET_TABLE_MAX, by size / DSIZE */
+
+#ifdef MM_STATS
+static mm_counters_t counters;              /* event counters; the gauges are filled in by mm_get_counters */
+#endif
+
+/*
+ * Tunable parameters (mm_set_params). The hot path reads them where the constants used to be: split_min on every placement,
+ * realloc_pad on every mm_realloc, the chunk sizes only when the heap grows. That is one load from a line that stays in cache, which
+ * times the same as the constants on the trace set; guarding it with a flag would cost the same load plus a branch.
+ */
+static mm_params_t params = { INIT_CHUNKSIZE, CHUNKSIZE, MAX_CHUNKSIZE, REALLOC_PADDING, DSIZE + OVERHEAD };
+
+/* Adaptive policy state */
+static int policy;                          /* current placement policy */
+static size_t chunksize;                    /* current heap growth chunk */
+static size_t free_bytes;                   /* bytes in all free blocks */
+static size_t small_limit;                  /* free blocks up to this size are too small for the typical request... */
+static size_t small_bytes;                  /* ...and hold these bytes */
+static size_t typical_size;                 /* running average of asize */
+static unsigned long num_malloc;            /* mm_malloc calls since mm_init */
+static unsigned long window_fits;           /* find_fit calls in the current window */
+static unsigned long window_nodes;          /* free blocks visited by those calls */
+static unsigned long dense_extra;           /* blocks best_fit visited past the first fit since the dense policy came on... */
+static unsigned long dense_better;          /* ...and how many of them were a better fit than the best one before */
+static unsigned long dense_hold;            /* windows left before the dense policy may come back */
+static double last_frag, last_search;       /* metrics of the last evaluation */
+static unsigned long num_transitions;
+static mm_transition_t policy_log[MM_POLICY_LOG];
+
+/* Cache coloring state (see mm_set_coloring) */
+static int num_colors;                      /* number of distinct offsets, 0 or 1 if coloring is off */
+static size_t color_min_size;               /* smallest block size that gets colored */
+static unsigned long next_color;            /* rotates through the offsets */
+
+/* Lifetime prediction state (auto mode of mm_malloc_hint) */
+static struct {
+    char *bp;                               /* sampled block, NULL if the slot is empty */
+    unsigned long birth;                    /* num_malloc when it was allocated */
+    int cls;                                /* its size class */
+} lifetime_samples[LIFETIME_SLOTS];
+static signed char lifetime_score[LIFETIME_CLASSES];   /* > 0: blocks of the class tend to die young, < 0: to live long */
+static int num_samples;                     /* occupied slots of lifetime_samples */
+static unsigned long num_auto;              /* auto mode mallocs */
+
+/* Handle table of the movable blocks (mm_halloc) and compaction state */
+typedef struct {
+    size_t bp;                              /* offset of the block, 0 if the entry is unused */
+    size_t pins;                            /* pin count, or the next unused entry + 1 if bp is 0 */
+} handle_t;
+static handle_t *handles;                   /* handle table, itself an (immovable) block in the heap */
+static size_t num_handles;                  /* entries in the table */
+static size_t free_handle;                  /* first unused entry + 1, 0 if there is none */
+static char *compact_cursor;                /* block where mm_compact resumes, NULL for the start of the heap */
+
+/* Epoch-based reclamation state (mm_free_deferred). The thread records are shared with readers that don't take the lock. */
+typedef struct {
+    char *bp;                               /* retired block */
+    unsigned long epoch;                    /* global epoch when it was retired */
+} retired_t;
+static struct {
+    int used;                               /* slot belongs to a thread */
+    int active;                             /* that thread is between mm_enter and mm_exit... */
+    unsigned long epoch;                    /* ...and saw this global epoch */
+} epoch_threads[EPOCH_THREADS];
+static __thread int epoch_slot = -1;        /* slot of the calling thread */
+static unsigned long global_epoch;
+static retired_t *retired;                  /* retire list, oldest first (so in epoch order); a block in the heap */
+static size_t num_retired, max_retired;
+
+/* Background maintenance state (mm_start_maintenance) */
+static mm_maint_t maint;                    /* parameters, all 0 until maintenance is set up */
+static unsigned long maint_decay;           /* decay time in passes */
+static unsigned long maint_tick;            /* passes so far: the clock of the age stamps */
+static char *idle_wild;                     /* the wilderness seen by the last pass... */
+static size_t idle_wsize;                   /* ...its size then... */
+static size_t idle_start;                   /* ...its size before the passes began to trim it... */
+static unsigned long idle_since;            /* ...and the pass that first saw it like that */
+static size_t purged_bytes;                 /* bytes of the free blocks decommitted by the passes */
+#ifdef MM_THREAD_SAFE
+static pthread_t maint_thread;
+static pthread_cond_t maint_cond = PTHREAD_COND_INITIALIZER;   /* wakes the thread up early to stop it */
+static int maint_running;
+#endif
+
+/* Memory budget state (mm_set_limits) */
+static size_t soft_limit, hard_limit;       /* committed bytes the heap may grow to, 0 for no limit */
+static struct {
+    mm_pressure_fn fn;
+    void *arg;
+} pressure_callbacks[PRESSURE_CALLBACKS];
+static int num_callbacks;
+static unsigned long pressure_events;       /* times an allocation hit a limit */
+static __thread size_t pressure;            /* the calling thread's last growth went past a limit by this many bytes (0: it didn't) */
+static __thread int soft_waived;            /* the calling thread is retrying: it may grow the heap past the soft limit */
+static __thread int relieving;              /* the calling thread is running the pressure callbacks */
+
+/* Heap profiler state (mm_set_sample_rate). The tables are mapped outside the heap on first use. */
+typedef struct {
+    int depth;                              /* frames, 0 if the slot is empty */
+    void *frames[PROF_DEPTH];               /* return addresses, innermost first */
+    double allocs, alloc_bytes;             /* estimated blocks and bytes allocated from this stack... */
+    double frees, free_bytes;               /* ...and how many of them were freed since */
+} prof_stack_t;
+typedef struct {
+    char *bp;                               /* sampled block, NULL if the slot is empty */
+    size_t size;                            /* bytes asked for */
+    double weight;                          /* blocks it stands for, 1 / P(a block of that size is sampled) */
+    int stack;                              /* slot of its call stack */
+} prof_object_t;
+static size_t prof_rate;                    /* mean bytes between two samples, 0 if sampling is off */
+static prof_stack_t *prof_stacks;           /* call stacks, open addressing on a hash of the frames */
+static prof_object_t *prof_objects;         /* sampled blocks still allocated, open addressing on PROF_SLOT */
+static int num_stacks;                      /* occupied slots of prof_stacks */
+static size_t prof_live;                    /* occupied slots of prof_objects */
+static __thread long prof_countdown;        /* bytes the calling thread allocates before its next sample */
+static __thread unsigned long prof_random;  /* its random number generator */
+static __thread int prof_busy;              /* it's taking a sample (backtrace may allocate) */
+
+#ifdef MM_TRACE
+/* Event tracing state: a ring buffer per thread, mapped outside the heap on its first event and written by that thread only */
+typedef struct {
+    unsigned long head;                     /* events written so far */
+    int thread;                             /* number of the ring */
+    mm_trace_rec_t recs[MM_TRACE_EVENTS];   /* event i is in recs[i % MM_TRACE_EVENTS] */
+} trace_ring_t;
+static trace_ring_t *trace_rings[TRACE_THREADS];
+static int num_rings;                       /* rings handed out (may exceed TRACE_THREADS) */
+static __thread trace_ring_t *trace_ring;   /* ring of the calling thread */
+static __thread int trace_off;              /* the calling thread couldn't get one */
+#endif
+
+#define SHARED_MAGIC        0x6d6d2d7368617265UL     /* the shared state of a heap is set up */
+
+/*
+ * State of a heap shared between processes or kept in a file, in the header page of the heap (mem_shared). Each process works on its
+ * own copies of these globals while it holds the lock: load_shared fetches them after taking it, save_shared writes them back before
+ * letting go (without MM_THREAD_SAFE there is no lock, and they are just written back after every call). Pointers are links (TO_OFF).
+ * The other globals (lifetime samples, retired blocks, maintenance...) stay with each process.
+ */
+typedef struct {
+    size_t magic;                           /* SHARED_MAGIC once the heap is set up... */
+    size_t base;                            /* ...at this address (which links are relative to without MM_SHARED_HEAP) */
+    pthread_mutex_t lock;                   /* process-shared and robust (MM_THREAD_SAFE) */
+    size_t hinted_lists[NUM_REGION - 1][NUM_BUCKET];   /* used in place of the static ones */
+    size_t wilderness, compact_cursor, handles;
+    size_t num_handles, free_handle;
+    int hinted;
+    size_t free_bytes, small_limit, small_bytes;
+    int policy;
+    size_t chunksize, typical_size;
+    unsigned long num_malloc, window_fits, window_nodes, dense_extra, dense_better, dense_hold;
+    double last_frag, last_search;
+} shared_t;
+static shared_t *shared;                    /* NULL if the heap is ours alone */
 
 /* Internal helper functions */
 static void *extend_heap(size_t words);
+static size_t grow_size(size_t asize);
+static void *malloc_region(size_t size, int region, int predict);
+static void *malloc_unhinted(size_t size);
+static size_t block_size(size_t size);
+static void free_block(void *ptr);
+static void *realloc_block(void *ptr, size_t size);
+static int reserve_heap(size_t bytes, int flags);
+static mm_handle_t halloc(size_t size);
+static int compact(size_t budget);
+static void reclaim(void);
+static int try_advance(void);
+static void free_batch(retired_t *batch, size_t n);
+static int cmp_retired(const void *a, const void *b);
+static void maintain(void);
+static double decay(unsigned long age);
+static void purge_block(char *bp, double share, size_t pagesize);
+#ifdef MM_THREAD_SAFE
+static void *maint_main(void *arg);
+#endif
+static void stamp_all(void);
+static size_t committed(void);
+static int over_limit(size_t size);
+static int relieve_pressure(void);
+static int open_shared(void);
+static void load_shared(void);
+static void save_shared(void);
+#ifdef MM_THREAD_SAFE
+static void lock_heap(void);
+static void unlock_heap(void);
+#endif
+static void *malloc_class(size_t asize, int bucket, int region, int predict);
+static void *allocate(size_t asize, int bucket, int region);
+static void *grow_wilderness(size_t bytes);
+static void *skip_pad(char *bp, size_t pad);
+static void split_tail(char *bp, size_t asize);
+static void *memalign_block(size_t alignment, size_t size);
 static void place(void *bp, size_t asize);
-static void *find_fit(size_t asize);
+static void *carve(size_t asize, int region);
+static void *find_fit(size_t asize, int bucket, int region);
+static void *first_fit(size_t asize, int bucket, int region, unsigned long *nodes);
+static void *best_fit(size_t asize, int bucket, int region, unsigned long *nodes);
+static int lifetime_class(size_t asize);
+static int predict_region(size_t asize);
+static void add_sample(char *bp, size_t asize);
+static void end_sample(char *bp);
+static void score_lifetime(int cls, unsigned long age);
+static void prof_sample(void *bp, size_t size) __attribute__((noinline));
+static long next_sample(size_t rate);
+static void prof_record(char *bp, size_t size, double weight, void **frames, int depth);
+static int find_stack(void **frames, int depth);
+static void prof_free(char *bp);
+static void print_frame(FILE *fp, void *addr);
+#ifdef MM_TRACE
+static uint64_t trace_now(void);
+static void trace_event(int event, uint64_t start, size_t size, uint64_t arg);
+static trace_ring_t *new_ring(void);
+#endif
+static int grow_handles(void);
+static handle_t *live_handle(mm_handle_t h);
+static void keep_cursor(char *bp);
+static void trim_wilderness(size_t bytes);
 static void *coalesce(void *bp);
+#ifdef MM_STATS
+static int search_bin(unsigned long nodes);
+#endif
 static void insert(void *bp);
 static int getSeglistSize();
-static int isSeglistPointer(void *ptr);
+static int isSeglistPointer(void *ptr, int region);
 static void delete(void *bp);
+static void update_policy(void);
+static void set_policy(int new_policy);
 static void printBlock(void *bp);
 static void checkBlock(void *bp);
 static void printSeglist();
 static void checkSeglist();
+static void checkHandles();
 
 /*
  * mm_init - initialize the malloc package.
  */
 int mm_init(void) {
+    int i, b;
+
+    /* Buckets of the common block sizes, for getSeglistSize */
+    for (i = 0, b = 0; i <= BUCKET_TABLE_MAX / DSIZE; i++) {
+        while (b < NUM_BUCKET - 1 && (size_t) i * DSIZE > bucket_limits[b])
+            b++;
+        bucket_table[i] = b;
+    }
+
+    /* State of this process only: forget what was learned about lifetimes, retired blocks and so on */
+    next_color = 0;
+    num_transitions = 0;
+    memset(lifetime_samples, 0, sizeof(lifetime_samples));
+    memset(lifetime_score, 0, sizeof(lifetime_score));
+    num_samples = 0;
+    num_auto = 0;
+    retired = NULL;
+    num_retired = max_retired = 0;
+    idle_wild = NULL;
+    idle_wsize = idle_start = 0;
+    purged_bytes = 0;
+    pressure_events = 0;
+#ifdef MM_STATS
+    memset(&counters, 0, sizeof(counters));
+#endif
+    if (prof_stacks != NULL) {
+        memset(prof_stacks, 0, PROF_STACKS * sizeof(prof_stack_t));
+        memset(prof_objects, 0, PROF_OBJECTS * sizeof(prof_object_t));
+    }
+    num_stacks = 0;
+    prof_live = 0;
+
+    if (open_shared() < 0)
+        return -1;
+    if (shared != NULL && shared->magic == SHARED_MAGIC) {     // the heap was set up already (by another process, or before a restart)
+        heap_base = mem_heap_lo();
+        free_listp = (size_t *) heap_base;
+        heap_listp = heap_base + (NUM_BUCKET + 1) * WSIZE;
+        region_listp[REGION_ANY] = free_listp;
+        region_listp[REGION_SHORT] = shared->hinted_lists[0];
+        region_listp[REGION_LONG] = shared->hinted_lists[1];
+        load_shared();
+        return 0;
+    }
+
     /* Initialize the heap, which contains 17 pointers to 17 segregated free lists (initial value = 0),
     prologue, and epilogue
      * Total size: (17 * WSIZE) + (2 * WSIZE) + (WSIZE) = WSIZE * 20
@@ -171,7 +645,19 @@ int mm_init(void) {
         return -1;
 
     memset(heap_listp, 0, NUM_BUCKET * WSIZE);
-    free_listp = (char **) heap_listp;
+    heap_base = heap_listp;
+    free_listp = (size_t *) heap_listp;
+
+    /* The lists of the hinted regions are only used by some programs, so they don't take up heap space */
+    memset(hinted_lists, 0, sizeof(hinted_lists));
+    region_listp[REGION_ANY] = free_listp;
+    region_listp[REGION_SHORT] = hinted_lists[0];
+    region_listp[REGION_LONG] = hinted_lists[1];
+    hinted = 0;
+    if (shared != NULL) {                                       // all processes must see them
+        region_listp[REGION_SHORT] = shared->hinted_lists[0];
+        region_listp[REGION_LONG] = shared->hinted_lists[1];
+    }
 
     /* Next, initialize the prologue and epilogue block and move the heap_listp */
     heap_listp += NUM_BUCKET * WSIZE;
@@ -179,11 +665,30 @@ int mm_init(void) {
     PUT(heap_listp + WSIZE, PACK(DSIZE, 1));    /* prologue footer */
     PUT(heap_listp + 2*WSIZE, PACK(0, 1));      /* epilogue header */
     heap_listp += WSIZE;                        /* heap_listp points at the prologue */
+
+    wilderness = NULL;
+
+    /* Reset the policy state: a fresh heap starts out with the fast policy */
+    free_bytes = small_limit = small_bytes = 0;
+    typical_size = 0;
+    num_malloc = window_fits = window_nodes = dense_extra = dense_better = dense_hold = 0;
+    last_frag = last_search = 0;
+    policy = MM_POLICY_FAST;
+    chunksize = params.chunk;
+
+    handles = NULL;
+    num_handles = free_handle = 0;
+    compact_cursor = NULL;
     
-    /* Extend the empty heap with a free block of INIT_CHUNKSIZE bytes */
-    if (extend_heap(INIT_CHUNKSIZE/WSIZE) == NULL)
+    /* Extend the empty heap with a free block of params.init_chunk bytes */
+    if (extend_heap(params.init_chunk/WSIZE) == NULL)
         return -1;
 
+    if (shared != NULL) {                                       // publish the new heap
+        save_shared();
+        shared->base = (size_t) heap_base;
+        shared->magic = SHARED_MAGIC;
+    }
     // mm_check(0);
     return 0;
 }
@@ -191,55 +696,119 @@ int mm_init(void) {
 /*
  * mm_malloc
  * - We always allocate a block whose size is a multiple of the alignment.
- * - We search the free list for a fit using find_fit function (first-fit policy). If no fit is found, we get more memory by using extend_heap
- * and place the block. Splitting occurs in place function.
+ * - We search the free list for a fit using find_fit function (first-fit policy). If no fit is found, the block is carved off the
+ * wilderness, which is grown by extend_heap first if it's too small. Splitting occurs in place function.
+ * - Until a hinted region has been given memory, malloc_unhinted takes the shortest way there (as it does for mm_realloc).
  */
 void *mm_malloc(size_t size) {
-    size_t asize;      /* adjusted block size */
-    size_t extendsize; /* amount to extend heap if no fit is found */
-    char *bp;
-
-    /* Ignore spurious requests */
-    if (size <= 0)
-	    return NULL;
-
-    /* Adjust block size to include overhead and alignment reqs. */
-    if (size <= DSIZE)
-	    asize = DSIZE + OVERHEAD;
-    else
-	    asize = DSIZE * ((size + (OVERHEAD) + (DSIZE-1)) / DSIZE);
-
-    /* Search the free list for a fit */
-    if ((bp = find_fit(asize)) != NULL) {
-	    place(bp, asize); // Found the fit for the free list, place and return the pointer to the allocated block
-	    return bp; 
-    }
+    TRACE_START(t);
+    void *bp;
+
+    MM_LOCK();
+    STAT_INC(mallocs);
+    bp = hinted ? malloc_region(size, REGION_ANY, 0) : malloc_unhinted(size);
+    if (bp == NULL && relieve_pressure())
+        bp = hinted ? malloc_region(size, REGION_ANY, 0) : malloc_unhinted(size);
+    soft_waived = 0;
+    MM_UNLOCK();
+    PROF_ALLOC(bp, size);
+    TRACE(MM_EV_MALLOC, t, size, bp);
+    return bp;
+}
 
-    /* No fit found. Get more memory and place the block */
-    extendsize = MAX(asize, CHUNKSIZE);
-    
-    if ((bp = extend_heap(extendsize/WSIZE)) == NULL)
-	    return NULL;
-    
-    place(bp, asize);
+/*
+ * mm_malloc_class - mm_malloc for a size known at compile time: asize is the size of its block and bucket the bucket of the free lists
+ * that size falls into, both worked out in advance (mm::alloc in mm.hpp), so that neither has to be computed here.
+ */
+void *mm_malloc_class(size_t asize, int bucket) {
+    TRACE_START(t);
+    void *bp;
+
+    MM_LOCK();
+    STAT_INC(mallocs);
+    bp = malloc_class(asize, bucket, REGION_ANY, 0);
+    if (bp == NULL && relieve_pressure())
+        bp = malloc_class(asize, bucket, REGION_ANY, 0);
+    soft_waived = 0;
+    MM_UNLOCK();
+    PROF_ALLOC(bp, asize - OVERHEAD);
+    TRACE(MM_EV_MALLOC, t, asize - OVERHEAD, bp);
+    return bp;
+}
 
-    // mm_check(0);
+/*
+ * mm_malloc_hint - mm_malloc for a block that is expected to be short-lived (MM_SHORT_LIVED) or long-lived (MM_LONG_LIVED), which is
+ * placed in the region of the heap kept for such blocks. With MM_LIFETIME_AUTO the region is predicted instead. No hint (or both)
+ * is the same as mm_malloc.
+ */
+void *mm_malloc_hint(size_t size, int hint) {
+    TRACE_START(t);
+    int region = hint & (MM_SHORT_LIVED | MM_LONG_LIVED);
+    void *bp;
+
+    if (region == (MM_SHORT_LIVED | MM_LONG_LIVED))
+        region = REGION_ANY;
+    MM_LOCK();
+    STAT_INC(mallocs);
+    bp = malloc_region(size, region, (hint & MM_LIFETIME_AUTO) != 0);
+    if (bp == NULL && relieve_pressure())
+        bp = malloc_region(size, region, (hint & MM_LIFETIME_AUTO) != 0);
+    soft_waived = 0;
+    MM_UNLOCK();
+    PROF_ALLOC(bp, size);
+    TRACE(MM_EV_MALLOC, t, size, bp);
     return bp;
 }
 
+/*
+ * mm_set_coloring - Turn cache coloring of blocks of at least min_size bytes on (colors > 1) or off. The start of successive colored blocks
+ * rotates through colors different cache line offsets, which costs up to (colors-1) cache lines per block until they are reused by
+ * smaller requests.
+ */
+void mm_set_coloring(size_t min_size, int colors) {
+    MM_LOCK();
+    color_min_size = min_size;
+    num_colors = colors;
+    MM_UNLOCK();
+}
+
 /*
  * mm_free - Freeing a block. Adopt immediate coalescing, and insert the newly freed, coalesced block into the appropriate free list.
  */
 void mm_free(void *ptr) {
-    size_t size = GET_SIZE(HDRP(ptr));
+    TRACE_START(t);
+
+    MM_LOCK();
+    STAT_INC(frees);
+    free_block(ptr);
+    MM_UNLOCK();
+    TRACE(MM_EV_FREE, t, 0, ptr);
+}
+
+/*
+ * free_block - The body of mm_free
+ */
+static void free_block(void *ptr) {
+    size_t size, rbits;
 
-    PUT(HDRP(ptr), PACK(size, 0)); // zero-ed the allocated bit of header and footer
-    PUT(FTRP(ptr), PACK(size, 0));
+    if (ptr == NULL)
+        return;
+    size = GET_SIZE(HDRP(ptr));
+    rbits = REGION_BITS(GET_REGION(HDRP(ptr)));
+    if (num_samples)
+        end_sample(ptr); // learn the lifetime of the block if it was sampled
+    if (prof_live)
+        prof_free(ptr);
+
+    PUT(HDRP(ptr), PACK(size, rbits)); // zero-ed the allocated bit of header and footer
+    PUT(FTRP(ptr), PACK(size, rbits));
     
     PUT(PRED(ptr), 0); // Also zero-ed the predecessor and successor pointer (optional)
     PUT(SUCC(ptr), 0);
 
-    insert(coalesce(ptr)); // insert the freed and coalesed block into the free list
+    TRACE_START(t);
+    insert(coalesce(ptr)); // insert the freed and coalesed block into the free list (or make it the wilderness)
+    TRACE(MM_EV_COALESCE, t, size, ptr);
   
 //    mm_check(0);
 }
@@ -249,22 +818,44 @@ void mm_free(void *ptr) {
  * maintain the block larger than the normal block (by adding realloc_padding) in order to avoid extending the heap/malloc over and over again.
  */
 void *mm_realloc(void *ptr, size_t size) {
+    TRACE_START(t);
+    void *new_ptr;
+
+    MM_LOCK();
+    STAT_INC(reallocs);
+    new_ptr = realloc_block(ptr, size);
+    if (new_ptr == NULL && relieve_pressure())
+        new_ptr = realloc_block(ptr, size);
+    soft_waived = 0;
+    MM_UNLOCK();
+    PROF_ALLOC(new_ptr, size);
+    TRACE(MM_EV_REALLOC, t, size, new_ptr);
+    return new_ptr;
+}
+
+/*
+ * realloc_block - The body of mm_realloc
+ */
+static void *realloc_block(void *ptr, size_t size) {
     void *new_ptr = ptr;                                                    /* Pointer to be returned */
     size_t new_size = size;                                                 /* Adjusted size of the new block */
-    int extraSpace;                                                          
+    long extraSpace;                                                          
     size_t extendsize;                                                      /* Size of heap extension if needed */
-    int sizeDifference = 0;
-    size_t currentBlockSize = GET_SIZE(HDRP(ptr));                          /* Size of the current block */
-
-    // Size 0 is just like freeing the block
-    if (size == 0) {
-        mm_free(ptr);
-        return NULL;
-    } 
-    else if (ptr == NULL) {
-        mm_malloc(size);
+    long sizeDifference = 0;
+    size_t currentBlockSize;                                                /* Size of the current block */
+    size_t rbits;                                                           /* The block stays in its lifetime region */
+
+    // A NULL block is just like mallocing, and size 0 is just like freeing the block
+    if (ptr == NULL)
+        return hinted ? malloc_region(size, REGION_ANY, 0) : malloc_unhinted(size);
+    else if (size == 0) {
+        free_block(ptr);
         return NULL;
     }
+    else if (size > MAX_REQUEST)
+        return NULL;
+    currentBlockSize = GET_SIZE(HDRP(ptr));
+    rbits = REGION_BITS(GET_REGION(HDRP(ptr)));
     
     // Add the overhead and alignment requirements
     if (new_size <= DSIZE) {
@@ -274,319 +865,2329 @@ void *mm_realloc(void *ptr, size_t size) {
     }
 
     /* Add realloc padding to block size to optimize realloc */
-    new_size += REALLOC_PADDING;
+    new_size += params.realloc_pad;
 
     /* Calculate the size difference between the size of the current block and the size needed */
-    sizeDifference = currentBlockSize - new_size;
+    sizeDifference = (long) currentBlockSize - (long) new_size;
     
     /* Allocate more space if not sufficient memory at the current block */
     if (sizeDifference < 0) {
-        size_t nextBlockSize = GET_SIZE(HDRP(NEXT_BLKP(ptr)));
-        /* If next block is a free block or the epilogue block, then extend the block without copying the data over */
-        if (!GET_ALLOC(HDRP(NEXT_BLKP(ptr))) || !nextBlockSize ) {
-            extraSpace = currentBlockSize + nextBlockSize - new_size;
-            
-            if (extraSpace < 0) {
-                extendsize = MAX(-extraSpace, CHUNKSIZE);
-                if ((extend_heap(extendsize/WSIZE)) == NULL)                /* Request more memory by extend_heap */
-                    return NULL;
-                extraSpace += extendsize;
+        char *next = NEXT_BLKP(ptr);
+        size_t nextBlockSize = GET_SIZE(HDRP(next));
+        extraSpace = (long) (currentBlockSize + nextBlockSize) - (long) new_size;
+
+        /* If the block is the last one (the next block is the wilderness or the epilogue), the heap can grow under it */
+        if (extraSpace < 0 && (next == wilderness || !nextBlockSize)) {
+            extendsize = MAX((size_t) -extraSpace, MIN(params.chunk, mem_heapleft() & ~(size_t) (DSIZE-1)));
+            if ((extend_heap(extendsize/WSIZE)) == NULL)                    /* Request more memory by extend_heap */
+                return NULL;
+            next = wilderness;
+            nextBlockSize = GET_SIZE(HDRP(next));
+            extraSpace = (long) (currentBlockSize + nextBlockSize) - (long) new_size;
+        }
+
+        /* If next block is free and large enough, then extend the block without copying the data over */
+        if (extraSpace >= 0 && !GET_ALLOC(HDRP(next))) {
+            int from_wild = (next == wilderness);                           /* delete forgets the wilderness */
+            delete(next);                                                   /* Do the coalescing with the next block (free) */
+            if (from_wild && extraSpace >= DSIZE + OVERHEAD) {              /* Only take what's needed from the wilderness */
+                PUT(HDRP(ptr), PACK(new_size, 1 | rbits));
+                PUT(FTRP(ptr), PACK(new_size, 1 | rbits));
+                wilderness = NEXT_BLKP(ptr);
+                PUT(HDRP(wilderness), PACK(extraSpace, 0));
+                PUT(FTRP(wilderness), PACK(extraSpace, 0));
             }
-                
-            delete(NEXT_BLKP(ptr));                                         /* Do the coalescing with the next block (free) */
-            PUT(HDRP(ptr), PACK(new_size + extraSpace, 1)); 
-            PUT(FTRP(ptr), PACK(new_size + extraSpace, 1)); 
+            else {
+                PUT(HDRP(ptr), PACK(new_size + extraSpace, 1 | rbits)); 
+                PUT(FTRP(ptr), PACK(new_size + extraSpace, 1 | rbits)); 
+            }
+            keep_cursor(ptr);
         } 
         else {        /* Not sufficient size and the next block is allocated, then use malloc to request the new block of memory and copy the data over */
-            new_ptr = mm_malloc(new_size - DSIZE);
-            size_t copy_size = MIN(size, new_size);
+            new_ptr = hinted ? malloc_region(new_size - DSIZE, GET_REGION(HDRP(ptr)), 0) : malloc_unhinted(new_size - DSIZE);
+            if (new_ptr == NULL)
+                return NULL;
+            size_t copy_size = MIN(size, currentBlockSize - OVERHEAD);
             memcpy(new_ptr, ptr, copy_size);
-            mm_free(ptr);
+            free_block(ptr);
         }
     }
+    if (new_ptr == ptr)
+        STAT_INC(realloc_in_place);
+    else
+        STAT_INC(realloc_copies);
 //    mm_check(0); 
     return new_ptr;     // Return the reallocated block 
 }
 
 /*
- * mm_check - Return 1 if the heap is consistent. Do the checking by calling checkSeglist and checkBlock. Otherwise, print specific error messages.
+ * mm_memalign - mm_malloc for a block whose payload is aligned to alignment bytes, a power of two. Blocks are ALIGNMENT-aligned anyway;
+ * for a larger alignment, a block with room to spare is allocated, and what lies before the aligned payload and after its end is split
+ * off again, the same way as the pad of a colored block.
  */
-int mm_check(int verbose)
-{
-    char *bp = heap_listp;
-    
-    if ((GET_SIZE(HDRP(heap_listp)) != DSIZE) || !GET_ALLOC(HDRP(heap_listp))) { // check for bad prologue
-	    printf("Bad prologue header\n");
-    }
-    
-    if (verbose) printf("-------Heap--------\n");
-   
-    for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {         // check each block in the heap (and print if verbose)
-	    if (verbose) printBlock(bp);                                    
-	    checkBlock(bp);
-    }
-    
-    if (verbose) printf("-------Heap--------\n");
-
-    
-    if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp)))) {                  // check for bad epilogue
-	    printf("Bad epilogue header\n");
-    }
-    
-    if (verbose) printSeglist();                                                // check the seglist (and print if verbose)
-    checkSeglist();
-    
-    return 1;
+void *mm_memalign(size_t alignment, size_t size) {
+    TRACE_START(t);
+    void *bp;
+
+    MM_LOCK();
+    STAT_INC(mallocs);
+    bp = memalign_block(alignment, size);
+    if (bp == NULL && relieve_pressure())
+        bp = memalign_block(alignment, size);
+    soft_waived = 0;
+    MM_UNLOCK();
+    PROF_ALLOC(bp, size);
+    TRACE(MM_EV_MALLOC, t, size, bp);
+    return bp;
 }
 
-/* =============================================================================================================
- * =============================== HELPER FUNCTIONS ============================================================
- *==============================================================================================================
- */
-
 /*
- * extend_heap - Extend heap with free block and return its block pointer
+ * memalign_block - The body of mm_memalign
  */
-
-static void *extend_heap(size_t words)
-{
+static void *memalign_block(size_t alignment, size_t size) {
+    size_t asize, pad;
     char *bp;
-    size_t size;
-
-    /* Allocate an even number of words to maintain alignment */
-    size = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
 
-    if ((bp = mem_sbrk(size)) == (void *)-1) // Request more memory
-	    return NULL;
+    if (alignment <= ALIGNMENT)
+        return malloc_region(size, REGION_ANY, 0);
+    if (size == 0 || size > MAX_REQUEST || alignment > MAX_REQUEST)
+        return NULL;
+    if (size <= DSIZE)
+        asize = DSIZE + OVERHEAD;
+    else
+        asize = DSIZE * ((size + (OVERHEAD) + (DSIZE-1)) / DSIZE);
 
-    /* Initialize free block header/footer and the epilogue header */
-    PUT(HDRP(bp), PACK(size, 0));         /* free block header */
-    PUT(FTRP(bp), PACK(size, 0));         /* free block footer */
-    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* new epilogue header */
-    
-    bp = coalesce(bp); /* Coalesce if the previous/next block is free */
-    insert(bp); // insert the block into the appropriate segregated list
+    if ((bp = allocate(asize + alignment + DSIZE + OVERHEAD, getSeglistSize(asize + alignment + DSIZE + OVERHEAD), REGION_ANY)) == NULL)
+        return NULL;
+    pad = -(size_t) bp & (alignment - 1);
+    if (pad != 0 && pad < DSIZE + OVERHEAD)     // too small to be a free block: take the next aligned address
+        pad += alignment;
+    if (pad != 0)
+        bp = skip_pad(bp, pad);
+    split_tail(bp, asize);
     return bp;
 }
 
 /*
- * place - Place block of asize bytes at the start of free block bp
- * and do the splitting if the extraSpace is at least the minimum size
+ * mm_usable_size - Number of payload bytes of the block ptr, which may be more than were asked for (0 for NULL). Only the block's own
+ * header is read, which no one else changes while the block is allocated, so no lock is taken.
  */
-static void place(void *bp, size_t asize)
-{
-    size_t csize = GET_SIZE(HDRP(bp));
-    if ((csize - asize) >= (DSIZE + OVERHEAD)) { // if the extraSpace is at least the minimum size
-        /* Place the block by setting header and footer for the block */
-        delete(bp);                              // delete the original block from the free list
-	    PUT(HDRP(bp), PACK(asize, 1));
-	    PUT(FTRP(bp), PACK(asize, 1));
-        
-        /* Do the splitting: set header and footer for the next block */
-	    bp = NEXT_BLKP(bp);
-	    PUT(HDRP(bp), PACK(csize-asize, 0));
-	    PUT(FTRP(bp), PACK(csize-asize, 0));
+size_t mm_usable_size(void *ptr) {
+    if (ptr == NULL)
+        return 0;
+    return GET_SIZE(HDRP(ptr)) - OVERHEAD;
+}
 
-        PUT(PRED(bp), 0);                       // also zero-ed the predecessor and successor pointer of the block (optional)
-        PUT(SUCC(bp), 0);
-        
-        insert(bp);                             // insert the splitted block into the appropriate free list
-    }
-    else {                                      // the extraSpace is not sufficient for splitting
-        delete(bp);                             // delete the block from the free list
-	    PUT(HDRP(bp), PACK(csize, 1));          // and allocate by setting header and footer
-	    PUT(FTRP(bp), PACK(csize, 1));
-    }
+/*
+ * mm_reserve - Make sure that at least bytes bytes can be allocated without growing the heap again. If the free block at the end of
+ * the heap is smaller than that, the heap is extended by the difference in a single step. With MM_RESERVE_PREFAULT, the pages of that
+ * block are also faulted in now rather than on first use. Returns 0 on success and -1 if the heap cannot grow.
+ */
+int mm_reserve(size_t bytes, int flags)
+{
+    int ret;
+
+    MM_LOCK();
+    ret = reserve_heap(bytes, flags);
+    if (ret < 0 && relieve_pressure())
+        ret = reserve_heap(bytes, flags);
+    soft_waived = 0;
+    MM_UNLOCK();
+    return ret;
 }
 
 /*
- * find_fit - Find a fit for a block with asize bytes. Adopt first-fit policy.
+ * reserve_heap - The body of mm_reserve
  */
-static void *find_fit(size_t asize)
+static int reserve_heap(size_t bytes, int flags)
 {
-    int bucket = getSeglistSize(asize);     // get the appropriate bucket
-    void *class_p, *bp;
-    size_t blk_size;
-    
-    while (bucket < NUM_BUCKET) {
-        class_p = free_listp + bucket;
-        if (GET(class_p) != 0) {
-            bp = (void *) GET(class_p);
-            while (bp) {
-                blk_size = GET_SIZE(HDRP(bp));
-                if (asize <= blk_size) {        // found the first fit: return the pointer to the block
-                    return bp;
-                }
-                bp = SUCC_BLKP(bp);             // continue iterating through the free list
-            }
-        }
-        bucket++;                               // fit not found: go to the next bucket
-    }
-    return NULL;                                // return NULL if no fit is found
+    size_t asize, wsize;
+
+    if (bytes == 0)
+        return 0;
+    asize = DSIZE * ((bytes + (OVERHEAD) + (DSIZE-1)) / DSIZE);
+
+    wsize = wilderness ? GET_SIZE(HDRP(wilderness)) : 0;       // the wilderness counts towards the reservation
+    if (wsize < asize && extend_heap((asize - wsize)/WSIZE) == NULL)
+        return -1;
+
+    if (flags & MM_RESERVE_PREFAULT)
+        mem_prefault(wilderness, GET_SIZE(HDRP(wilderness)) - OVERHEAD);
+    return 0;
 }
 
 /*
- * coalesce - boundary tag coalescing. Return ptr to coalesced block. There are 4 cases when coalescing.
+ * mm_halloc - Allocate a movable block with a payload of size bytes and return a handle to it (0 on failure). The handle number is kept
+ * in the first word of the block, and the payload starts DSIZE bytes in to keep it aligned.
  */
-static void *coalesce(void *bp) {
-    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));             // check if the previous block is allocated
-    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));             // check if the next block is allocated
-    size_t size = GET_SIZE(HDRP(bp));
-    
-    if (prev_alloc && next_alloc) {                                 /* Case 1: both blocks already allocated, no coalescing */
-        return bp;
-    }
-    else if (prev_alloc && !next_alloc) {                           /* Case 2: combine with the next block */
-        delete(NEXT_BLKP(bp));                              // delete the next block from the free list, prepare for coalescing
-        size += GET_SIZE(HDRP(NEXT_BLKP(bp)));              
-        PUT(HDRP(bp), PACK(size, 0));                       // get the new size, then update the footer and header
-        PUT(FTRP(bp), PACK(size, 0));
-    }
-    else if (!prev_alloc && next_alloc) {                           /* Case 3: combine with the previous block */
-        delete(PREV_BLKP(bp));                              // delete the previous block from the free list, prepare for coalescing
-        size += GET_SIZE(HDRP(PREV_BLKP(bp)));
-        PUT(FTRP(bp), PACK(size, 0));                       // get the new size, then update the footer and header
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-        bp = PREV_BLKP(bp);                                 // move the pointer to the start of the new block
-    }
-    else {                                                          /* Case 4: combine with the both next and previous blocks */
-        delete(PREV_BLKP(bp));                              // delete both blocks from the free list, prepare for coalescing
-        delete(NEXT_BLKP(bp));
-        size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(FTRP(NEXT_BLKP(bp)));
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));            // get the new size, then update the appropriate footer and header
-        PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0));
-        bp = PREV_BLKP(bp);                                 // move the pointer to the start of the new block
-    }
-    return bp;
+mm_handle_t mm_halloc(size_t size) {
+    mm_handle_t h;
+
+    MM_LOCK();
+    h = halloc(size);
+    if (h == 0 && relieve_pressure())
+        h = halloc(size);
+    soft_waived = 0;
+    MM_UNLOCK();
+    return h;
 }
 
 /*
- * isSeglistPointer - return 1 if the pointer ptr is the seglist pointer (a pointer to a doubly linked list of free blocks of a class size)
+ * halloc - The body of mm_halloc
  */
-static int isSeglistPointer(void *ptr) {
-    size_t ptr_val = (size_t) ptr;
-    size_t start = (size_t) free_listp;
-    size_t end = start + WSIZE*(NUM_BUCKET-1);
+static mm_handle_t halloc(size_t size) {
+    size_t h;
+    char *bp;
 
-    if (ptr_val > end || ptr_val < start)
+    if (size == 0)
         return 0;
-    if ((end - ptr_val) % WSIZE)
+    if (free_handle == 0 && grow_handles() < 0)
         return 0;
-    return 1;
+    if ((bp = malloc_region(size + DSIZE, REGION_ANY, 0)) == NULL)
+        return 0;
+
+    h = free_handle - 1;                                        // take the first unused entry
+    free_handle = handles[h].pins;
+    handles[h].bp = TO_OFF(bp);
+    handles[h].pins = 0;
+
+    PUT(HDRP(bp), GET(HDRP(bp)) | MOVABLE);
+    PUT(FTRP(bp), GET(FTRP(bp)) | MOVABLE);
+    PUT(bp, h);
+    return h + 1;
 }
 
 /*
- * delete - delete a block from the free list. There are also 4 cases.
+ * mm_hfree - Free the movable block of handle h and recycle the handle. Does nothing if h is not live or is pinned.
  */
-static void delete(void *bp) {
-    int pre = !isSeglistPointer(PRED_BLKP(bp));             // if bp is not the first block (the previous block is not the seglist pointer)      
-    int suc = (SUCC_BLKP(bp) != NULL);
-    
-    if (GET_ALLOC(HDRP(bp))) {
-        printf("ERROR: Calling delete on an allocated block!\n");
-        return;
+void mm_hfree(mm_handle_t h) {
+    handle_t *entry;
+
+    MM_LOCK();
+    if ((entry = live_handle(h)) != NULL && entry->pins == 0) {
+        free_block(TO_PTR(entry->bp));
+        entry->bp = 0;
+        entry->pins = free_handle;
+        free_handle = h;
     }
+    MM_UNLOCK();
+}
 
-    if (!pre && suc) {                                      // if bp is the first block and has successors
-        PUT(PRED_BLKP(bp), (size_t) SUCC_BLKP(bp));
-        PUT(PRED(SUCC_BLKP(bp)), (size_t) PRED_BLKP(bp));
-    }
-    else if (!pre && !suc) {                                // if bp is both the first and the last block of the list
-        PUT(PRED_BLKP(bp), (size_t) SUCC_BLKP(bp));
-    }
-    else if (pre && suc) {                                  // if bp is a block in the middle with successors and predecessors
-        PUT(SUCC(PRED_BLKP(bp)), (size_t) SUCC_BLKP(bp));
-        PUT(PRED(SUCC_BLKP(bp)), (size_t) PRED_BLKP(bp));
-    }
-    else {                                                  // if bp is the last block
-        PUT(SUCC(PRED_BLKP(bp)), 0);
+/*
+ * mm_pin - Pin the block of handle h in place and return the address of its payload, or NULL if h is not live. Pins nest.
+ */
+void *mm_pin(mm_handle_t h) {
+    handle_t *entry;
+    void *ptr = NULL;
+
+    MM_LOCK();
+    if ((entry = live_handle(h)) != NULL) {
+        entry->pins++;
+        ptr = TO_PTR(entry->bp) + DSIZE;
     }
-
-    PUT(PRED(bp), 0);                                       // as always, we also zero-ed the predecessor and successor pointer (optional)
-    PUT(SUCC(bp), 0);
+    MM_UNLOCK();
+    return ptr;
 }
 
 /*
- * insert - insert a free block pointed at by bp into the appropriate free list (bucket) at the beginning.
+ * mm_unpin - Undo one mm_pin of handle h. The address it returned must not be used once the block is no longer pinned. Does nothing
+ * if h is not live or not pinned.
  */
-static void insert(void *bp) {
+void mm_unpin(mm_handle_t h) {
+    handle_t *entry;
 
-    size_t size = GET_SIZE(HDRP(bp));                       // size of the block at bp
-    char **bucket_ptr;                                      // the pointer to the bucket (class size)
-    size_t bp_val = (size_t) bp;
+    MM_LOCK();
+    if ((entry = live_handle(h)) != NULL && entry->pins > 0)
+        entry->pins--;
+    MM_UNLOCK();
+}
 
-    bucket_ptr = free_listp + getSeglistSize(size);         // move the bucket pointer to the right place
-    if (GET(bucket_ptr) == 0) {                             // if this bucket is empty
-        PUT(bucket_ptr, bp_val);                            // bucket points to block at bp
-        PUT(PRED(bp), (size_t) bucket_ptr);                 // also set the predecessor and successor of block at bp
-        PUT(SUCC(bp), 0);
-    }
-    else {                                                  // if this bucket is not empty, insert the free block at the beginning of the bucket
-        PUT(PRED(bp), (size_t) bucket_ptr);
-        PUT(SUCC(bp), GET(bucket_ptr));
-        PUT(PRED(GET(bucket_ptr)), bp_val);
-        PUT(bucket_ptr, bp_val);
-    }
+/*
+ * live_handle - The entry of handle h, or NULL if h was never returned by mm_halloc (0 among them) or was freed since
+ */
+static handle_t *live_handle(mm_handle_t h) {
+    if (h == 0 || h > num_handles || handles[h - 1].bp == 0)
+        return NULL;
+    return &handles[h - 1];
 }
 
 /*
- * getSeglistSize - get the appropriate bucket number for the block size (17 buckets numbered from 0 to 16)
+ * mm_compact - Do up to budget bytes worth of compaction work (moving a block costs its size, stepping over one costs OVERHEAD).
+ * Starting at the cursor, every free block followed by an unpinned movable block of its region is swapped with it, which pushes the free space up
+ * towards the wilderness where it coalesces. Returns 1 if the pass isn't finished yet. Once it reaches the wilderness, the wilderness
+ * is trimmed off the heap if it's at least CHUNKSIZE bytes, the next call starts a new pass and 0 is returned.
  */
+int mm_compact(size_t budget) {
+    int ret;
 
-static int getSeglistSize(size_t blksize) {
-    if (blksize <= 8) 			    return 0;
-	else if (blksize <= 32) 	    return 1;
-	else if (blksize <= 64) 	    return 2;
-	else if (blksize <= 128) 	    return 3;
-	else if (blksize <= 256) 	    return 4;
-	else if (blksize <= 512) 	    return 5;
-	else if (blksize <= 1024) 	    return 6;
-	else if (blksize <= 2048) 	    return 7;
-	else if (blksize <= 4096) 	    return 8;
-	else if (blksize <= 8192) 	    return 9;
-	else if (blksize <= 16384) 	    return 10;
-	else if (blksize <= 32769) 	    return 11;
-	else if (blksize <= 65536) 	    return 12;
-	else if (blksize <= 131072)     return 13;
-	else if (blksize <= 262144)     return 14;
-	else if (blksize <= 524288)     return 15;
-	else   					        return 16;
+    MM_LOCK();
+    ret = compact(budget);
+    MM_UNLOCK();
+    return ret;
 }
 
-/* 
- * ------------------------- BELOW HERE ARE FUNCTIONS FOR CHECKING THE CONSISTENCY OF THE HEAP, USED BY MM_CHECKHEAP() --------------------------
-*/
-static void printBlock(void *bp) {                                          /* Print the block information at bp */
-    size_t hsize, halloc, fsize, falloc;
-
-    hsize = GET_SIZE(HDRP(bp));
-    halloc = GET_ALLOC(HDRP(bp));
-    fsize = GET_SIZE(FTRP(bp));
-    falloc = GET_ALLOC(FTRP(bp));
+/*
+ * compact - The body of mm_compact
+ */
+static int compact(size_t budget) {
+    char *bp = compact_cursor ? compact_cursor : NEXT_BLKP(heap_listp);
+    char *next;
+    size_t fsize, nsize, rbits, spent = 0;
+
+    while (GET_SIZE(HDRP(bp)) > 0 && bp != wilderness) {
+        if (spent >= budget) {                                  // out of budget: resume here next time
+            compact_cursor = bp;
+            return 1;
+        }
+        next = NEXT_BLKP(bp);
+        spent += OVERHEAD;
+        if (GET_ALLOC(HDRP(bp)) || !GET_MOVABLE(HDRP(next)) || handles[GET(next)].pins ||
+            GET_REGION(HDRP(bp)) != GET_REGION(HDRP(next))) {   // sliding would move the boundary of a lifetime region
+            bp = next;                                          // nothing to slide here
+            continue;
+        }
 
-    if (hsize == 0) {
-	    printf("%p: EOL\n", bp);
-	    return;
+        /* Slide the movable block down over the free block bp, and the free space up behind it */
+        fsize = GET_SIZE(HDRP(bp));
+        nsize = GET_SIZE(HDRP(next));
+        rbits = REGION_BITS(GET_REGION(HDRP(bp)));
+        delete(bp);
+        memmove(HDRP(bp), HDRP(next), nsize);
+        handles[GET(bp)].bp = TO_OFF(bp);
+        spent += nsize;
+
+        next = NEXT_BLKP(bp);
+        PUT(HDRP(next), PACK(fsize, rbits));
+        PUT(FTRP(next), PACK(fsize, rbits));
+        bp = coalesce(next);
+        insert(bp);
     }
 
-    printf("%p: header: [%ld:%c] footer: [%ld:%c] pred: [%p] succ: [%p]\n", bp,
-	   hsize, (halloc ? 'a' : 'f'),
-	   fsize, (falloc ? 'a' : 'f'),
-       (void *) GET(PRED(bp)),
-       (void *) GET(SUCC(bp)));
+    compact_cursor = NULL;
+    if (wilderness && GET_SIZE(HDRP(wilderness)) >= CHUNKSIZE)
+        trim_wilderness(GET_SIZE(HDRP(wilderness)));
+    return 0;
 }
 
-static void printSeglist() {                                                /* Print the segregated list */
-    void *ptr, *bp;
-    printf("\n------Beginning of Segregated Free List-------\n");
-    for (int i = 0; i < NUM_BUCKET; i++) {
-        ptr = free_listp + i;
-        if (GET(ptr) == 0) {
-            printf("- [%p] Bucket %d: (empty)\n", ptr, i);
+/*
+ * mm_enter - Start a critical section of the calling thread: blocks retired from now on won't be freed until it calls mm_exit.
+ * The first call of a thread claims one of EPOCH_THREADS records for good. Returns -1 if there is none left.
+ */
+int mm_enter(void) {
+    int slot = epoch_slot;
+
+    if (slot < 0) {
+        for (slot = 0; slot < EPOCH_THREADS; slot++)
+            if (__atomic_exchange_n(&epoch_threads[slot].used, 1, __ATOMIC_ACQ_REL) == 0)
+                break;
+        if (slot == EPOCH_THREADS)
+            return -1;
+        epoch_slot = slot;
+    }
+    __atomic_store_n(&epoch_threads[slot].active, 1, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&epoch_threads[slot].epoch, __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return 0;
+}
+
+/*
+ * mm_exit - End the critical section of the calling thread (none if it holds no record: mm_enter was never called or failed)
+ */
+void mm_exit(void) {
+    if (epoch_slot < 0)
+        return;
+    __atomic_store_n(&epoch_threads[epoch_slot].active, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * mm_free_deferred - Retire the block ptr: it's freed once no critical section that might still see it is left. The epoch is
+ * advanced whenever it can be, and every RETIRE_BATCH retired blocks, the blocks that became safe are reclaimed. Returns -1 if the retire list can't grow (the block is not retired).
+ */
+int mm_free_deferred(void *ptr) {
+    retired_t *list;
+    size_t n;
+
+    if (ptr == NULL)
+        return 0;
+    MM_LOCK();
+    if (num_retired == max_retired) {
+        n = max_retired ? 2 * max_retired : RETIRE_INIT;
+        list = retired ? realloc_block(retired, n * sizeof(retired_t)) : malloc_region(n * sizeof(retired_t), REGION_ANY, 0);
+        if (list == NULL) {
+            MM_UNLOCK();
+            return -1;
+        }
+        retired = list;
+        max_retired = n;
+    }
+    retired[num_retired].bp = ptr;
+    retired[num_retired].epoch = global_epoch;
+    if (++num_retired % RETIRE_BATCH == 0)
+        reclaim();
+    else
+        try_advance();
+    MM_UNLOCK();
+    return 0;
+}
+
+/*
+ * mm_reclaim - Free whatever retired blocks are safe to free now
+ */
+void mm_reclaim(void) {
+    MM_LOCK();
+    reclaim();
+    MM_UNLOCK();
+}
+
+/*
+ * mm_start_maintenance - Set the maintenance parameters and start the thread that runs a pass every params->interval_ms. Without
+ * MM_THREAD_SAFE there is no thread: 1 is returned and mm_maintain is left to the caller. Returns 0 on success and -1 on error
+ * (maintenance isn't available for a shared heap).
+ */
+int mm_start_maintenance(const mm_maint_t *params) {
+    if (params->interval_ms == 0)
+        return -1;
+    if (shared != NULL)                                         // the stamps would have to be shared too
+        return -1;
+    MM_LOCK();
+    maint = *params;
+    maint.purge_min = MAX(maint.purge_min, mem_pagesize());    // smaller blocks have no whole page to give back
+    maint_decay = MAX(maint.decay_ms / maint.interval_ms, 1);
+    stamp_all();
+#ifdef MM_THREAD_SAFE
+    if (!maint_running) {
+        maint_running = 1;
+        if (pthread_create(&maint_thread, NULL, maint_main, NULL) != 0) {
+            maint_running = 0;
+            MM_UNLOCK();
+            return -1;
+        }
+    }
+    MM_UNLOCK();
+    return 0;
+#else
+    return 1;
+#endif
+}
+
+/*
+ * mm_stop_maintenance - Stop the maintenance thread and wait for it. The parameters stay in effect for mm_maintain.
+ */
+void mm_stop_maintenance(void) {
+#ifdef MM_THREAD_SAFE
+    int running;
+
+    MM_LOCK();
+    running = maint_running;
+    maint_running = 0;
+    pthread_cond_signal(&maint_cond);
+    MM_UNLOCK();
+    if (running)
+        pthread_join(maint_thread, NULL);
+#endif
+}
+
+/*
+ * mm_maintain - Run one maintenance pass now. It counts as interval_ms of idle time for the free blocks.
+ */
+void mm_maintain(void) {
+    MM_LOCK();
+    maintain();
+    MM_UNLOCK();
+}
+
+/*
+ * mm_set_limits - Set the soft and hard limit on the committed bytes of the heap (0 for none). They only stop the heap from growing,
+ * they don't shrink it.
+ */
+void mm_set_limits(size_t soft, size_t hard) {
+    MM_LOCK();
+    soft_limit = soft;
+    hard_limit = hard;
+    MM_UNLOCK();
+}
+
+/*
+ * mm_set_params - Set the tunable parameters. Returns -1 and changes nothing if one is out of range: all are multiples of DSIZE,
+ * blocks must be at least DSIZE + OVERHEAD bytes, and the padding and split threshold are at most CHUNKSIZE, so that a request up
+ * to MAX_REQUEST plus them still fits mem_sbrk.
+ */
+int mm_set_params(const mm_params_t *p) {
+    if (p->init_chunk < DSIZE + OVERHEAD || p->init_chunk > MAX_PARAM_CHUNK ||
+        p->chunk < DSIZE + OVERHEAD || p->chunk > p->max_chunk || p->max_chunk > MAX_PARAM_CHUNK ||
+        p->realloc_pad > CHUNKSIZE || p->split_min < DSIZE + OVERHEAD || p->split_min > CHUNKSIZE)
+        return -1;
+    if ((p->init_chunk | p->chunk | p->max_chunk | p->realloc_pad | p->split_min) % DSIZE)
+        return -1;
+    MM_LOCK();
+    params = *p;
+    MM_UNLOCK();
+    return 0;
+}
+
+/*
+ * mm_get_params - Get the tunable parameters
+ */
+void mm_get_params(mm_params_t *p) {
+    MM_LOCK();
+    *p = params;
+    MM_UNLOCK();
+}
+
+/* Names of the tunable parameters in a parameter file */
+static const struct {
+    const char *name;
+    size_t offset;
+} param_names[] = {
+    { "init_chunk", offsetof(mm_params_t, init_chunk) },
+    { "chunk", offsetof(mm_params_t, chunk) },
+    { "max_chunk", offsetof(mm_params_t, max_chunk) },
+    { "realloc_pad", offsetof(mm_params_t, realloc_pad) },
+    { "split_min", offsetof(mm_params_t, split_min) },
+};
+#define NUM_PARAMS  (sizeof(param_names) / sizeof(param_names[0]))
+
+/*
+ * mm_load_params - Set the tunable parameters from the file at path. Returns 0, or -1 if it can't be read, is longer than
+ * PARAMS_FILE_MAX bytes, has a line that isn't "name value" with a known name, or sets a parameter out of range. The file is read
+ * without stdio, which would allocate: the malloc of mm-preload.c loads it while it sets the heap up.
+ */
+int mm_load_params(const char *path) {
+    char buf[PARAMS_FILE_MAX + 1], name[64], *line, *next, *hash;
+    unsigned long value;
+    mm_params_t p;
+    ssize_t len;
+    size_t i;
+    int fd, n;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return -1;
+    len = read(fd, buf, sizeof(buf));
+    close(fd);
+    if (len < 0 || len > PARAMS_FILE_MAX)
+        return -1;
+    buf[len] = '\0';
+    mm_get_params(&p);
+    for (line = buf; line != NULL; line = next) {
+        if ((next = strchr(line, '\n')) != NULL)
+            *next++ = '\0';
+        if ((hash = strchr(line, '#')) != NULL)
+            *hash = '\0';
+        if ((n = sscanf(line, "%63s %lu", name, &value)) <= 0)      // blank line
+            continue;
+        for (i = 0; i < NUM_PARAMS && strcmp(name, param_names[i].name); i++)
+            ;
+        if (n != 2 || i == NUM_PARAMS)
+            return -1;
+        *(size_t *) ((char *) &p + param_names[i].offset) = value;
+    }
+    return mm_set_params(&p);
+}
+
+/*
+ * mm_save_params - Write the tunable parameters to a file at path that mm_load_params reads back. Returns 0, or -1 on error.
+ */
+int mm_save_params(const char *path) {
+    FILE *fp;
+    mm_params_t p;
+    size_t i;
+    int ret;
+
+    if ((fp = fopen(path, "w")) == NULL)
+        return -1;
+    mm_get_params(&p);
+    for (i = 0; i < NUM_PARAMS; i++)
+        fprintf(fp, "%s %lu\n", param_names[i].name, (unsigned long) *(size_t *) ((char *) &p + param_names[i].offset));
+    ret = ferror(fp) ? -1 : 0;
+    return fclose(fp) == 0 ? ret : -1;
+}
+
+/*
+ * mm_add_pressure_callback - Register fn to be called with arg when the heap would grow past a limit. Returns -1 if there are
+ * PRESSURE_CALLBACKS of them already.
+ */
+int mm_add_pressure_callback(mm_pressure_fn fn, void *arg) {
+    int ret = -1;
+
+    MM_LOCK();
+    if (num_callbacks < PRESSURE_CALLBACKS) {
+        pressure_callbacks[num_callbacks].fn = fn;
+        pressure_callbacks[num_callbacks].arg = arg;
+        num_callbacks++;
+        ret = 0;
+    }
+    MM_UNLOCK();
+    return ret;
+}
+
+/*
+ * mm_checkpoint - Write a heap that is a file (mem_init_file) back to disk as it is now, so that it can be reopened in this state
+ * even after the system crashed. Returns 0, or -1 if the heap isn't a file or writing it failed.
+ */
+int mm_checkpoint(void) {
+    int ret;
+
+    MM_LOCK();
+    if (shared != NULL)
+        save_shared();
+    ret = mem_sync();
+    MM_UNLOCK();
+    return ret;
+}
+
+/*
+ * mm_offset - Offset of ptr from the start of the heap, which is the same in all processes that share the heap (0 for NULL)
+ */
+size_t mm_offset(void *ptr) {
+    return ptr ? (char *) ptr - heap_base : 0;
+}
+
+/*
+ * mm_address - Address of the block at offset in this process' mapping of the heap (NULL for 0)
+ */
+void *mm_address(size_t offset) {
+    return offset ? heap_base + offset : NULL;
+}
+
+/*
+ * mm_fork_prepare, mm_fork_parent, mm_fork_child - Handlers for pthread_atfork, so that a process that forks while another thread is in
+ * the allocator gets a heap in a consistent state and a lock it can take. The child has only the forking thread: the maintenance thread
+ * and the epoch records of the other threads are gone with them. A shared heap's lock is the parent's to let go of.
+ */
+void mm_fork_prepare(void) {
+    MM_LOCK();
+}
+
+void mm_fork_parent(void) {
+    MM_UNLOCK();
+}
+
+void mm_fork_child(void) {
+    int slot;
+
+    for (slot = 0; slot < EPOCH_THREADS; slot++)
+        if (slot != epoch_slot)
+            epoch_threads[slot].used = epoch_threads[slot].active = 0;
+#ifdef MM_THREAD_SAFE
+    maint_running = 0;
+    pthread_cond_init(&maint_cond, NULL);
+    if (shared == NULL)
+        pthread_mutex_init(&mm_lock, NULL);
+#endif
+}
+
+/*
+ * mm_check - Return 1 if the heap is consistent. Do the checking by calling checkSeglist and checkBlock. Otherwise, print specific error messages.
+ */
+int mm_check(int verbose)
+{
+    char *bp = heap_listp;
+    
+    if ((GET_SIZE(HDRP(heap_listp)) != DSIZE) || !GET_ALLOC(HDRP(heap_listp))) { // check for bad prologue
+	    printf("Bad prologue header\n");
+    }
+    
+    if (verbose) printf("-------Heap--------\n");
+   
+    for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {         // check each block in the heap (and print if verbose)
+	    if (verbose) printBlock(bp);                                    
+	    checkBlock(bp);
+    }
+    
+    if (verbose) printf("-------Heap--------\n");
+
+    
+    if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp)))) {                  // check for bad epilogue
+	    printf("Bad epilogue header\n");
+    }
+    
+    if (verbose) printSeglist();                                                // check the seglist (and print if verbose)
+    checkSeglist();
+    checkHandles();
+    
+    return 1;
+}
+
+/* =============================================================================================================
+ * =============================== HELPER FUNCTIONS ============================================================
+ *==============================================================================================================
+ */
+
+/*
+ * extend_heap - Extend heap with free block and return its block pointer. The new block is merged into the wilderness.
+ */
+
+static void *extend_heap(size_t words)
+{
+    TRACE_START(t);
+    char *bp;
+    size_t size;
+
+    /* Allocate an even number of words to maintain alignment */
+    size = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
+
+    if (over_limit(size))
+        return NULL;
+    if ((bp = mem_sbrk(size)) == (void *)-1) { // Request more memory
+        if (soft_limit || hard_limit)           // without limits, running out of memory is not something the callbacks can relieve
+            pressure = size;
+        TRACE(MM_EV_EXTEND, t, size, 0);
+	    return NULL;
+    }
+
+    /* Initialize free block header/footer and the epilogue header */
+    PUT(HDRP(bp), PACK(size, 0));         /* free block header */
+    PUT(FTRP(bp), PACK(size, 0));         /* free block footer */
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* new epilogue header */
+    
+    bp = coalesce(bp); /* Coalesce if the previous/next block is free */
+    insert(bp); // the block is right before the epilogue: this makes it the wilderness
+    STAT_INC(extends);
+    TRACE(MM_EV_EXTEND, t, size, bp);
+    return bp;
+}
+
+/*
+ * malloc_region - The body of mm_malloc and mm_malloc_hint: allocate size bytes in the given lifetime region, or in the predicted one
+ * if predict is set (and then maybe follow the block to learn its lifetime).
+ */
+static void *malloc_region(size_t size, int region, int predict)
+{
+    size_t asize = block_size(size);
+
+    if (asize == 0)
+        return NULL;
+    return malloc_class(asize, getSeglistSize(asize), region, predict);
+}
+
+/*
+ * malloc_unhinted - mm_malloc while no hinted region has been given memory (hinted is 0), so that every block is in REGION_ANY: the
+ * fit is looked for there alone, and a miss is carved off the wilderness, without the region, prediction and coloring work of
+ * malloc_class and allocate. A block to be colored goes through malloc_class.
+ */
+static void *malloc_unhinted(size_t size)
+{
+    size_t asize = block_size(size), wsize;
+    char *bp;
+
+    if (asize == 0)
+        return NULL;
+    if (num_colors > 1)
+        return malloc_class(asize, getSeglistSize(asize), REGION_ANY, 0);
+
+    typical_size += ((long) asize - (long) typical_size) / 16;
+    if (++num_malloc % POLICY_WINDOW == 0)
+        update_policy();
+
+    if (free_bytes != 0 && (bp = find_fit(asize, getSeglistSize(asize), REGION_ANY)) != NULL) {
+        place(bp, asize);
+        return bp;
+    }
+    wsize = wilderness ? GET_SIZE(HDRP(wilderness)) : 0;
+    if (wsize < asize && grow_wilderness(asize - wsize) == NULL)
+        return NULL;
+    return carve(asize, REGION_ANY);
+}
+
+/*
+ * block_size - Size of the block for a request of size bytes, with the overhead and rounded up to the alignment; 0 for spurious
+ * requests and those that could never be met
+ */
+static size_t block_size(size_t size)
+{
+    if (size <= 0 || size > MAX_REQUEST)
+	    return 0;
+    if (size <= DSIZE)
+	    return DSIZE + OVERHEAD;
+    return DSIZE * ((size + (OVERHEAD) + (DSIZE-1)) / DSIZE);
+}
+
+/*
+ * malloc_class - The rest of malloc_region, once the block size asize and its bucket are known (mm_malloc_class knows them in advance)
+ */
+static void *malloc_class(size_t asize, int bucket, int region, int predict)
+{
+    size_t pad;        /* cache coloring offset */
+    char *bp;
+
+    /* Track the typical request size and periodically re-evaluate the policy */
+    typical_size += ((long) asize - (long) typical_size) / 16;
+    if (++num_malloc % POLICY_WINDOW == 0)
+        update_policy();
+
+    if (predict)
+        region = predict_region(asize);
+
+    /* Large blocks get pad extra bytes in front of them, which are split off again once the block is placed */
+    if (num_colors > 1 && asize >= color_min_size && (pad = (next_color++ % num_colors) * CACHE_LINE) != 0) {
+        if ((bp = allocate(asize + pad, getSeglistSize(asize + pad), region)) != NULL)
+            bp = skip_pad(bp, pad);
+    }
+    else
+        bp = allocate(asize, bucket, region);
+
+    if (predict && bp != NULL && num_auto++ % LIFETIME_SAMPLE == 0)
+        add_sample(bp, asize);
+
+    // mm_check(0);
+    return bp;
+}
+
+/*
+ * allocate - Allocate a block of asize bytes (in bucket) in the given region: search the region's free lists for a fit (skipped altogether while
+ * the free lists are empty). If no fit is found, carve the block off the wilderness; hinted regions carve off REGION_CHUNK bytes at once
+ * and keep the rest in their free lists. Only when the wilderness is too small, fits in the other regions are used before the heap grows
+ * (if there are any: a program that gives no hints never has blocks outside REGION_ANY). When the heap can't grow by the step grow_size
+ * asks for, it grows by just the missing bytes.
+ */
+static void *allocate(size_t asize, int bucket, int region)
+{
+    size_t wsize, csize, rest;
+    char *bp;
+    int r;
+
+    if (free_bytes != 0 && (bp = find_fit(asize, bucket, region)) != NULL) {
+	    place(bp, asize); // Found the fit for the free list, place and return the pointer to the allocated block
+	    return bp; 
+    }
+
+    wsize = wilderness ? GET_SIZE(HDRP(wilderness)) : 0;
+    if (wsize < asize && free_bytes != 0 && hinted) {
+        for (r = 0; r < NUM_REGION; r++) {
+            if (r != region && (bp = find_fit(asize, bucket, r)) != NULL) {
+                place(bp, asize);   // the block keeps the region it was free in
+                return bp;
+            }
+        }
+    }
+
+    csize = asize;
+    if (region != REGION_ANY)
+        hinted = 1;
+    if (region != REGION_ANY && (wsize >= REGION_CHUNK || wsize < asize))   // don't grow the heap just to round up to a chunk
+        csize = MAX(asize, REGION_CHUNK);
+    if (wsize < csize && grow_wilderness(csize - wsize) == NULL)
+        return NULL;
+    bp = carve(csize, region);
+
+    /* Keep the rest of a region chunk in the region's free lists */
+    if ((rest = GET_SIZE(HDRP(bp)) - asize) >= DSIZE + OVERHEAD && region != REGION_ANY) {
+        PUT(HDRP(bp), PACK(asize, 1 | REGION_BITS(region)));
+        PUT(FTRP(bp), PACK(asize, 1 | REGION_BITS(region)));
+        PUT(HDRP(NEXT_BLKP(bp)), PACK(rest, REGION_BITS(region)));
+        PUT(FTRP(NEXT_BLKP(bp)), PACK(rest, REGION_BITS(region)));
+        insert(NEXT_BLKP(bp));
+    }
+    return bp;
+}
+
+/*
+ * grow_wilderness - Grow the heap so that the wilderness gains at least bytes bytes, by the step grow_size asks for or, when the heap
+ * can't grow that much, by just bytes. Returns the wilderness, or NULL if the heap can't grow.
+ */
+static void *grow_wilderness(size_t bytes)
+{
+    char *bp;
+
+    if ((bp = extend_heap(grow_size(bytes)/WSIZE)) == NULL) {
+        pressure = 0;                       // the rounded-up step didn't fit: settle for the exact shortfall
+        bp = extend_heap(bytes/WSIZE);
+    }
+    return bp;
+}
+
+/*
+ * skip_pad - Split the first pad bytes off the allocated block bp as a free block (of the same region) and return the rest. The block in
+ * front of bp is allocated or of another region (bp was a coalesced free block), so there is nothing to coalesce the pad with.
+ */
+static void *skip_pad(char *bp, size_t pad)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+    size_t rbits = REGION_BITS(GET_REGION(HDRP(bp)));
+    char *nbp = bp + pad;
+
+    PUT(HDRP(nbp), PACK(size - pad, 1 | rbits));
+    PUT(FTRP(nbp), PACK(size - pad, 1 | rbits));
+    PUT(HDRP(bp), PACK(pad, rbits));
+    PUT(FTRP(bp), PACK(pad, rbits));
+    insert(bp);
+    return nbp;
+}
+
+/*
+ * split_tail - Shrink the allocated block bp to asize bytes if the rest is large enough to be a block, and free the rest
+ */
+static void split_tail(char *bp, size_t asize)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+    size_t rbits = REGION_BITS(GET_REGION(HDRP(bp)));
+    char *tail;
+
+    if (size - asize < DSIZE + OVERHEAD)
+        return;
+    PUT(HDRP(bp), PACK(asize, 1 | rbits));
+    PUT(FTRP(bp), PACK(asize, 1 | rbits));
+    tail = NEXT_BLKP(bp);
+    PUT(HDRP(tail), PACK(size - asize, rbits));
+    PUT(FTRP(tail), PACK(size - asize, rbits));
+    PUT(PRED(tail), 0);
+    PUT(SUCC(tail), 0);
+    insert(coalesce(tail));
+    STAT_INC(splits);
+}
+
+/*
+ * grow_size - Number of bytes to extend the heap by when no free block fits asize. The fast policy grows the heap geometrically
+ * (by 1/2^GROWTH_SHIFT of its current size) so that a bulk load needs O(log n) extensions instead of one per params.chunk; the step
+ * is capped at params.max_chunk so that a large heap does not overshoot by much. The dense policy always grows by params.chunk.
+ * Near the soft limit or the end of the heap the step shrinks to what is left, but never below asize.
+ */
+static size_t grow_size(size_t asize)
+{
+    size_t used, step;
+
+    if (policy == MM_POLICY_FAST)
+        chunksize = MIN(MAX(params.chunk, mem_heapsize() >> GROWTH_SHIFT), params.max_chunk);
+    step = chunksize;
+    if (soft_limit && !soft_waived && (used = committed()) + step > soft_limit)     // don't cross the soft limit just to round up
+        step = soft_limit > used ? (soft_limit - used) & ~(size_t) (DSIZE-1) : 0;
+    step = MIN(step, mem_heapleft() & ~(size_t) (DSIZE-1));                         // nor ask memlib for more than it has
+    return MAX(asize, step);
+}
+
+/*
+ * place - Place block of asize bytes at the start of free block bp
+ * and do the splitting if the extraSpace is at least params.split_min. Both parts stay in the region of bp.
+ */
+static void place(void *bp, size_t asize)
+{
+    size_t csize = GET_SIZE(HDRP(bp));
+    size_t rbits = REGION_BITS(GET_REGION(HDRP(bp)));
+    if ((csize - asize) >= params.split_min) {  // if the extraSpace is at least the split threshold
+        /* Place the block by setting header and footer for the block */
+        delete(bp);                              // delete the original block from the free list
+	    PUT(HDRP(bp), PACK(asize, 1 | rbits));
+	    PUT(FTRP(bp), PACK(asize, 1 | rbits));
+        
+        /* Do the splitting: set header and footer for the next block */
+	    bp = NEXT_BLKP(bp);
+	    PUT(HDRP(bp), PACK(csize-asize, rbits));
+	    PUT(FTRP(bp), PACK(csize-asize, rbits));
+
+        PUT(PRED(bp), 0);                       // also zero-ed the predecessor and successor pointer of the block (optional)
+        PUT(SUCC(bp), 0);
+        
+        insert(bp);                             // insert the splitted block into the appropriate free list
+        STAT_INC(splits);
+    }
+    else {                                      // the extraSpace is not sufficient for splitting
+        delete(bp);                             // delete the block from the free list
+	    PUT(HDRP(bp), PACK(csize, 1 | rbits));  // and allocate by setting header and footer
+	    PUT(FTRP(bp), PACK(csize, 1 | rbits));
+    }
+}
+
+/*
+ * carve - Allocate a block of asize bytes at the start of the wilderness, which must be large enough, by bumping the wilderness pointer
+ * past it. The wilderness is handed out whole if the rest would be too small to be a block. The block belongs to region.
+ */
+static void *carve(size_t asize, int region)
+{
+    char *bp = wilderness;
+    size_t wsize = GET_SIZE(HDRP(bp));
+
+    if (wsize - asize >= DSIZE + OVERHEAD) {
+        PUT(HDRP(bp), PACK(asize, 1 | REGION_BITS(region)));
+        PUT(FTRP(bp), PACK(asize, 1 | REGION_BITS(region)));
+        wilderness = NEXT_BLKP(bp);
+        PUT(HDRP(wilderness), PACK(wsize - asize, 0));
+        PUT(FTRP(wilderness), PACK(wsize - asize, 0));
+    }
+    else {
+        PUT(HDRP(bp), PACK(wsize, 1 | REGION_BITS(region)));
+        PUT(FTRP(bp), PACK(wsize, 1 | REGION_BITS(region)));
+        wilderness = NULL;
+    }
+    return bp;
+}
+
+/*
+ * find_fit - Find a fit for a block with asize bytes, starting from its bucket, in the free lists of region: first_fit under the fast
+ * policy, best_fit under the dense one. The number of blocks visited before the first fit is recorded for update_policy (and the
+ * histogram of mm_get_counters).
+ */
+static void *find_fit(size_t asize, int bucket, int region)
+{
+    TRACE_START(t);
+    unsigned long nodes = 0;
+    void *bp;
+
+    if (policy == MM_POLICY_FAST)
+        bp = first_fit(asize, bucket, region, &nodes);
+    else
+        bp = best_fit(asize, bucket, region, &nodes);
+    window_fits++;
+    window_nodes += nodes;
+    STAT_SEARCH(nodes);
+    TRACE(MM_EV_FIND_FIT, t, asize, nodes);
+    return bp;
+}
+
+/*
+ * first_fit - The fast policy: the first block that fits, as the allocator always did. Sets *nodes to the blocks visited.
+ */
+static void *first_fit(size_t asize, int bucket, int region, unsigned long *nodes)
+{
+    size_t *list = region_listp[region];
+    unsigned long n = 0;
+    char *bp;
+
+    for (; bucket < NUM_BUCKET; bucket++) {
+        for (bp = TO_PTR(list[bucket]); bp != NULL; bp = SUCC_BLKP(bp)) {
+            n++;
+            if (asize <= GET_SIZE(HDRP(bp))) {
+                *nodes = n;
+                return bp;
+            }
+        }
+    }
+    *nodes = n;
+    return NULL;
+}
+
+/*
+ * best_fit - The dense policy: after the first fit, keep looking at up to BEST_FIT_SCAN more blocks of the same bucket and return the
+ * smallest one (stopping early on an exact fit). Sets *nodes to the blocks visited before the first fit; the blocks visited after it,
+ * and how many of them were a better fit, are added to dense_extra and dense_better for update_policy's cost check.
+ */
+static void *best_fit(size_t asize, int bucket, int region, unsigned long *nodes)
+{
+    size_t *list = region_listp[region];
+    size_t blk_size, best_size = 0;
+    unsigned long n = 0, extra = 0, better = 0;
+    char *bp, *best = NULL;
+
+    for (; bucket < NUM_BUCKET; bucket++) {
+        for (bp = TO_PTR(list[bucket]); bp != NULL; bp = SUCC_BLKP(bp)) {
+            blk_size = GET_SIZE(HDRP(bp));
+            if (best == NULL)
+                n++;
+            else
+                extra++;
+            if (asize <= blk_size && (best == NULL || blk_size < best_size)) {
+                if (best != NULL)
+                    better++;
+                best = bp;
+                best_size = blk_size;
+                if (blk_size == asize)          // nothing can beat an exact fit
+                    break;
+            }
+            if (best != NULL && extra >= BEST_FIT_SCAN)
+                break;
+        }
+        if (best != NULL)                       // the best fit of this bucket is good enough
+            break;
+    }
+    *nodes = n;
+    dense_extra += extra;
+    dense_better += better;
+    return best;
+}
+
+/*
+ * lifetime_class - Size class used for lifetime prediction: one class per DSIZE up to 48 * DSIZE, then one per power of two, the
+ * last one taking all the sizes above. They come from the size rather than the bucket, whose limits mm_buckets.h may move.
+ */
+static int lifetime_class(size_t asize) {
+    int cls = 48;
+
+    if (asize <= 48 * DSIZE)
+        return asize / DSIZE;
+    for (asize = (asize - 1) >> 10; asize && cls < LIFETIME_CLASSES - 1; asize >>= 1)
+        cls++;
+    return cls;
+}
+
+/*
+ * predict_region - Region for a block of asize bytes in auto mode, from the lifetime score of its size class. Classes without a clear
+ * tendency go to the unhinted region.
+ */
+static int predict_region(size_t asize) {
+    int score = lifetime_score[lifetime_class(asize)];
+
+    if (score >= LIFETIME_CONFIDENCE)
+        return REGION_SHORT;
+    if (score <= -LIFETIME_CONFIDENCE)
+        return REGION_LONG;
+    return REGION_ANY;
+}
+
+/*
+ * add_sample - Remember when the block bp was allocated, so that its lifetime is known when it's freed. A block still alive in the
+ * slot being taken over has outlived SHORT_LIFETIME or not; the former counts as a long lifetime for its class.
+ */
+static void add_sample(char *bp, size_t asize) {
+    int slot = (((size_t) bp >> 4) * 2654435761u) % LIFETIME_SLOTS;
+
+    if (lifetime_samples[slot].bp != NULL) {
+        if (num_malloc - lifetime_samples[slot].birth >= SHORT_LIFETIME)
+            score_lifetime(lifetime_samples[slot].cls, num_malloc - lifetime_samples[slot].birth);
+    }
+    else
+        num_samples++;
+    lifetime_samples[slot].bp = bp;
+    lifetime_samples[slot].birth = num_malloc;
+    lifetime_samples[slot].cls = lifetime_class(asize);
+}
+
+/*
+ * end_sample - Called by mm_free: if bp is a sampled block, score its lifetime and free its slot
+ */
+static void end_sample(char *bp) {
+    int slot = (((size_t) bp >> 4) * 2654435761u) % LIFETIME_SLOTS;
+
+    if (lifetime_samples[slot].bp != bp)
+        return;
+    score_lifetime(lifetime_samples[slot].cls, num_malloc - lifetime_samples[slot].birth);
+    lifetime_samples[slot].bp = NULL;
+    num_samples--;
+}
+
+/*
+ * score_lifetime - Move the score of a size class towards short (age < SHORT_LIFETIME) or long, saturating at +-2*LIFETIME_CONFIDENCE
+ * so that a class whose behavior changes is re-predicted soon enough.
+ */
+static void score_lifetime(int cls, unsigned long age) {
+    if (age < SHORT_LIFETIME && lifetime_score[cls] < 2 * LIFETIME_CONFIDENCE)
+        lifetime_score[cls]++;
+    else if (age >= SHORT_LIFETIME && lifetime_score[cls] > -2 * LIFETIME_CONFIDENCE)
+        lifetime_score[cls]--;
+}
+
+/*
+ * prof_sample - Called by the public functions once the calling thread has allocated past its sampling point, with the block bp of
+ * size bytes it's about to return: draw the next point and record the call stack of the block. The stack is taken without the lock,
+ * and not at all when backtrace itself allocates.
+ */
+static void prof_sample(void *bp, size_t size) {
+    size_t rate = __atomic_load_n(&prof_rate, __ATOMIC_RELAXED);
+    void *frames[PROF_SKIP + PROF_DEPTH];
+    double weight;
+    int depth;
+
+    if (rate == 0) {
+        prof_countdown = PROF_IDLE;
+        return;
+    }
+    prof_countdown = next_sample(rate);
+    if (prof_busy)
+        return;
+    prof_busy = 1;
+    depth = backtrace(frames, PROF_SKIP + PROF_DEPTH) - PROF_SKIP;
+    weight = 1 / -expm1(-(double) size / rate);
+    MM_LOCK();
+    if (depth > 0)
+        prof_record(bp, size, weight, frames + PROF_SKIP, depth);
+    MM_UNLOCK();
+    prof_busy = 0;
+}
+
+/*
+ * next_sample - Bytes to the next sampling point: exponentially distributed with mean rate, so that sampling is a Poisson process
+ * over the bytes allocated
+ */
+static long next_sample(size_t rate) {
+    unsigned long x = prof_random;
+    double u;
+
+    if (x == 0)
+        x = ((size_t) &prof_random * 2654435761u) | 1;      // a different sequence in each thread
+    x ^= x >> 12;                                           // xorshift64*
+    x ^= x << 25;
+    x ^= x >> 27;
+    prof_random = x;
+    u = (((x * 2685821657736338717UL) >> 11) + 1) * (1.0 / (1UL << 53));   // uniform in (0, 1]
+    return (long) MIN(-log(u) * rate, PROF_MAX_GAP);
+}
+
+/*
+ * prof_record - File the sampled block bp under the call stack frames. A block that is still in the table was resized in place by
+ * mm_realloc, which counts as freeing it and allocating it anew. Samples that don't fit in the tables are dropped.
+ */
+static void prof_record(char *bp, size_t size, double weight, void **frames, int depth) {
+    size_t slot;
+    int stack;
+
+    if (prof_live)
+        prof_free(bp);
+    if (prof_stacks == NULL || prof_live >= PROF_OBJECTS / 4 * 3 || (stack = find_stack(frames, depth)) < 0)
+        return;
+    prof_stacks[stack].allocs += weight;
+    prof_stacks[stack].alloc_bytes += weight * size;
+
+    slot = PROF_SLOT(bp);
+    while (prof_objects[slot].bp != NULL)
+        slot = (slot + 1) & (PROF_OBJECTS - 1);
+    prof_objects[slot].bp = bp;
+    prof_objects[slot].size = size;
+    prof_objects[slot].weight = weight;
+    prof_objects[slot].stack = stack;
+    prof_live++;
+}
+
+/*
+ * find_stack - Slot of the call stack frames in prof_stacks, added if it's new. Returns -1 if the table is full.
+ */
+static int find_stack(void **frames, int depth) {
+    size_t h = depth;
+    int slot;
+
+    for (int i = 0; i < depth; i++)
+        h = (h ^ (size_t) frames[i]) * 1099511628211UL;
+    for (slot = h & (PROF_STACKS - 1); prof_stacks[slot].depth != 0; slot = (slot + 1) & (PROF_STACKS - 1))
+        if (prof_stacks[slot].depth == depth && !memcmp(prof_stacks[slot].frames, frames, depth * sizeof(void *)))
+            return slot;
+    if (num_stacks >= PROF_STACKS / 4 * 3)
+        return -1;
+    prof_stacks[slot].depth = depth;
+    memcpy(prof_stacks[slot].frames, frames, depth * sizeof(void *));
+    num_stacks++;
+    return slot;
+}
+
+/*
+ * prof_free - Called by mm_free: if bp is a sampled block, count it as freed from its call stack and take it out of the table. The
+ * blocks after it that were displaced from their slot are moved back, so that lookups never need to skip deleted entries.
+ */
+static void prof_free(char *bp) {
+    size_t slot = PROF_SLOT(bp), next, home;
+    prof_stack_t *st;
+
+    while (prof_objects[slot].bp != bp) {
+        if (prof_objects[slot].bp == NULL)
+            return;
+        slot = (slot + 1) & (PROF_OBJECTS - 1);
+    }
+    st = &prof_stacks[prof_objects[slot].stack];
+    st->frees += prof_objects[slot].weight;
+    st->free_bytes += prof_objects[slot].weight * prof_objects[slot].size;
+    prof_live--;
+
+    for (next = (slot + 1) & (PROF_OBJECTS - 1); prof_objects[next].bp != NULL; next = (next + 1) & (PROF_OBJECTS - 1)) {
+        home = PROF_SLOT(prof_objects[next].bp);
+        if (((next - home) & (PROF_OBJECTS - 1)) >= ((next - slot) & (PROF_OBJECTS - 1))) {   // the hole is between its home and it
+            prof_objects[slot] = prof_objects[next];
+            slot = next;
+        }
+    }
+    prof_objects[slot].bp = NULL;
+}
+
+/*
+ * grow_handles - Double the handle table (moving it if needed) and chain the new entries into the unused list. Called with no unused entry.
+ */
+static int grow_handles(void) {
+    size_t n = num_handles ? 2 * num_handles : HANDLE_TABLE_INIT;
+    handle_t *table;
+
+    if (handles == NULL)
+        table = malloc_region(n * sizeof(handle_t), REGION_ANY, 0);
+    else
+        table = realloc_block(handles, n * sizeof(handle_t));
+    if (table == NULL)
+        return -1;
+
+    for (size_t i = num_handles; i < n; i++) {
+        table[i].bp = 0;
+        table[i].pins = (i + 1 < n) ? i + 2 : 0;
+    }
+    free_handle = num_handles + 1;
+    handles = table;
+    num_handles = n;
+    return 0;
+}
+
+/*
+ * keep_cursor - The compaction cursor must point at a block: if the block bp just swallowed it, move it back to bp
+ */
+static void keep_cursor(char *bp) {
+    if (compact_cursor > bp && compact_cursor < NEXT_BLKP(bp))
+        compact_cursor = bp;
+}
+
+/*
+ * trim_wilderness - Give the last bytes bytes of the wilderness back with mem_trim. If that leaves less than a block, all of it goes
+ * and its header becomes the new epilogue; a free block in front of it (of a hinted region) then becomes the wilderness.
+ */
+static void trim_wilderness(size_t bytes) {
+    char *bp = wilderness;
+    size_t wsize = GET_SIZE(HDRP(bp));
+
+    if (wsize - bytes < DSIZE + OVERHEAD)
+        bytes = wsize;
+    if (mem_trim(bytes) < 0)
+        return;
+    if (bytes == wsize) {
+        delete(bp);                             // forget about the wilderness
+        PUT(HDRP(bp), PACK(0, 1));              // new epilogue header
+        if (!GET_ALLOC(FTRP(PREV_BLKP(bp)))) {
+            bp = PREV_BLKP(bp);
+            delete(bp);
+            PUT(HDRP(bp), PACK(GET_SIZE(HDRP(bp)), 0));
+            PUT(FTRP(bp), PACK(GET_SIZE(HDRP(bp)), 0));
+            insert(bp);
+        }
+        return;
+    }
+    PUT(HDRP(bp), PACK(wsize - bytes, 0));
+    PUT(FTRP(bp), PACK(wsize - bytes, 0));
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));       // new epilogue header
+}
+
+/*
+ * reclaim - Advance the epoch if possible, then free the retired blocks of epochs that no reader can still be in. The retire list is
+ * in epoch order, so those blocks are a prefix of it.
+ */
+static void reclaim(void) {
+    size_t n = 0;
+
+    try_advance();
+    while (n < num_retired && retired[n].epoch + 2 <= global_epoch)
+        n++;
+    if (n == 0)
+        return;
+
+    qsort(retired, n, sizeof(retired_t), cmp_retired);
+    free_batch(retired, n);
+    memmove(retired, retired + n, (num_retired - n) * sizeof(retired_t));
+    num_retired -= n;
+}
+
+/*
+ * try_advance - Move to the next global epoch if every thread inside a critical section has seen the current one. Returns 1 if it moved.
+ */
+static int try_advance(void) {
+    unsigned long epoch = global_epoch;
+
+    for (int i = 0; i < EPOCH_THREADS; i++) {
+        if (!__atomic_load_n(&epoch_threads[i].used, __ATOMIC_ACQUIRE))
+            continue;
+        if (__atomic_load_n(&epoch_threads[i].active, __ATOMIC_SEQ_CST) &&
+            __atomic_load_n(&epoch_threads[i].epoch, __ATOMIC_SEQ_CST) != epoch)
+            return 0;
+    }
+    __atomic_store_n(&global_epoch, epoch + 1, __ATOMIC_SEQ_CST);
+    return 1;
+}
+
+/*
+ * free_batch - Free n retired blocks sorted by address. A run of blocks that are neighbors in the heap (and in the same region) is
+ * turned into one free block first, so it is coalesced and inserted once instead of once per block.
+ */
+static void free_batch(retired_t *batch, size_t n) {
+    size_t i = 0, size, rbits;
+    char *bp;
+
+    while (i < n) {
+        bp = batch[i].bp;
+        size = GET_SIZE(HDRP(bp));
+        rbits = REGION_BITS(GET_REGION(HDRP(bp)));
+        if (num_samples)
+            end_sample(bp);
+        if (prof_live)
+            prof_free(bp);
+        while (i + 1 < n && batch[i + 1].bp == bp + size && REGION_BITS(GET_REGION(HDRP(bp + size))) == rbits) {
+            if (num_samples)
+                end_sample(bp + size);
+            if (prof_live)
+                prof_free(bp + size);
+            size += GET_SIZE(HDRP(bp + size));
+            i++;
+        }
+        i++;
+
+        PUT(HDRP(bp), PACK(size, rbits));
+        PUT(FTRP(bp), PACK(size, rbits));
+        insert(coalesce(bp));
+    }
+}
+
+/*
+ * cmp_retired - qsort comparison of retired blocks by address
+ */
+static int cmp_retired(const void *a, const void *b) {
+    char *x = ((const retired_t *) a)->bp, *y = ((const retired_t *) b)->bp;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * maintain - The body of mm_maintain. Decommit part of every free block of at least purge_min bytes, and of the wilderness, according
+ * to how long it has been idle, then top up the prefaulted headroom above the break.
+ */
+static void maintain(void) {
+    size_t pagesize = mem_pagesize();
+    size_t wsize, target;
+    char *bp;
+
+    if (maint.purge_min == 0)                                   // not set up
+        return;
+    maint_tick++;
+    for (int r = 0; r < NUM_REGION; r++) {
+        for (int i = getSeglistSize(maint.purge_min); i < NUM_BUCKET; i++) {
+            for (bp = TO_PTR(region_listp[r][i]); bp != NULL; bp = SUCC_BLKP(bp)) {
+                if (GET_SIZE(HDRP(bp)) >= maint.purge_min)
+                    purge_block(bp, decay(maint_tick - GET(STAMP(bp))), pagesize);
+            }
+        }
+    }
+
+    /* The wilderness is idle as long as it stays the same between passes (it isn't stamped, carve moves it too often) */
+    wsize = wilderness ? GET_SIZE(HDRP(wilderness)) : 0;
+    if (wilderness != idle_wild || wsize != idle_wsize) {
+        idle_wild = wilderness;
+        idle_wsize = idle_start = wsize;
+        idle_since = maint_tick;
+    }
+    else if (wsize >= maint.purge_min) {
+        target = (size_t) (decay(maint_tick - idle_since) * idle_start) & ~(pagesize - 1);
+        if (target > idle_start - wsize) {
+            trim_wilderness(MIN(target - (idle_start - wsize), wsize));
+            idle_wild = wilderness;
+            idle_wsize = wilderness ? GET_SIZE(HDRP(wilderness)) : 0;
+        }
+    }
+
+    mem_headroom(maint.headroom);
+}
+
+/*
+ * decay - Share of an idle free block that should be decommitted after age passes: a smoothstep from 0 to 1 over the decay time,
+ * which leaves recently freed blocks alone (they are the most likely to be reused) and takes the last pages of old ones gently.
+ */
+static double decay(unsigned long age) {
+    double x = (double) age / maint_decay;
+
+    if (x >= 1)
+        return 1;
+    return x * x * (3 - 2 * x);
+}
+
+/*
+ * purge_block - Decommit the first share of the whole pages of the free block bp (past its age stamp and before its footer), minus
+ * the ones decommitted already
+ */
+static void purge_block(char *bp, double share, size_t pagesize) {
+    char *lo = (char *) (((size_t) PURGED(bp) + WSIZE + pagesize - 1) & ~(pagesize - 1));
+    char *hi = (char *) ((size_t) FTRP(bp) & ~(pagesize - 1));
+    size_t target, purged = GET(PURGED(bp));
+
+    if (hi <= lo)
+        return;
+    target = (size_t) (share * (hi - lo)) & ~(pagesize - 1);
+    if (target > purged) {
+        mem_decommit(lo + purged, target - purged);
+        purged_bytes += target - purged;
+        PUT(PURGED(bp), target);
+    }
+}
+
+#ifdef MM_THREAD_SAFE
+/*
+ * maint_main - The maintenance thread: a pass every interval_ms until mm_stop_maintenance. It waits on maint_cond with the lock released.
+ */
+static void *maint_main(void *arg) {
+    struct timespec deadline;
+
+    MM_LOCK();
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    while (maint_running) {
+        deadline.tv_sec += maint.interval_ms / 1000;
+        deadline.tv_nsec += (maint.interval_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        while (maint_running && pthread_cond_timedwait(&maint_cond, &mm_lock, &deadline) != ETIMEDOUT)
+            ;
+        if (maint_running)
+            maintain();
+    }
+    MM_UNLOCK();
+    return NULL;
+}
+#endif
+
+/*
+ * open_shared - Find out whether the heap is shared or a file (mem_shared). With MM_THREAD_SAFE, use its lock then, and set the lock up
+ * if the heap is new, or if it is a file that was reopened: whoever held the lock before is gone. Returns -1 if the header page has
+ * no room for the shared state, or if the links in the heap are pointers (no MM_SHARED_HEAP) and it is mapped elsewhere than where
+ * it was set up.
+ */
+static int open_shared(void) {
+    size_t room;
+
+#ifdef MM_THREAD_SAFE
+    mm_lockp = &mm_lock;
+#endif
+    if ((shared = mem_shared(&room)) == NULL)
+        return 0;
+    if (room < sizeof(shared_t)) {
+        shared = NULL;
+        return -1;
+    }
+#ifndef MM_SHARED_HEAP
+    if (shared->magic == SHARED_MAGIC && shared->base != (size_t) mem_heap_lo()) {
+        shared = NULL;
+        return -1;
+    }
+#endif
+    if (shared->magic != SHARED_MAGIC)
+        memset(shared->hinted_lists, 0, sizeof(shared->hinted_lists));
+#ifdef MM_THREAD_SAFE
+    mm_lockp = &shared->lock;
+    if (shared->magic != SHARED_MAGIC || mem_persistent()) {
+        pthread_mutexattr_t attr;
+
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);   // a process that dies holding it doesn't block the others for good
+        pthread_mutex_init(&shared->lock, &attr);
+        pthread_mutexattr_destroy(&attr);
+    }
+#endif
+    return 0;
+}
+
+#ifdef MM_THREAD_SAFE
+/*
+ * lock_heap - MM_LOCK. If the previous owner of the lock of a shared heap died holding it, the heap is taken over as it was left
+ * (mm_check tells whether that's consistent).
+ */
+static void lock_heap(void) {
+    if (pthread_mutex_lock(mm_lockp) == EOWNERDEAD)
+        pthread_mutex_consistent(mm_lockp);
+    if (shared != NULL)
+        load_shared();
+}
+
+/*
+ * unlock_heap - MM_UNLOCK
+ */
+static void unlock_heap(void) {
+    if (shared != NULL)
+        save_shared();
+    pthread_mutex_unlock(mm_lockp);
+}
+#endif
+
+/*
+ * load_shared - Fetch the globals of the shared heap
+ */
+static void load_shared(void) {
+    wilderness = TO_PTR(shared->wilderness);
+    compact_cursor = TO_PTR(shared->compact_cursor);
+    handles = (handle_t *) TO_PTR(shared->handles);
+    num_handles = shared->num_handles;
+    free_handle = shared->free_handle;
+    hinted = shared->hinted;
+    free_bytes = shared->free_bytes;
+    small_limit = shared->small_limit;
+    small_bytes = shared->small_bytes;
+    policy = shared->policy;
+    chunksize = shared->chunksize;
+    typical_size = shared->typical_size;
+    num_malloc = shared->num_malloc;
+    window_fits = shared->window_fits;
+    window_nodes = shared->window_nodes;
+    dense_extra = shared->dense_extra;
+    dense_better = shared->dense_better;
+    dense_hold = shared->dense_hold;
+    last_frag = shared->last_frag;
+    last_search = shared->last_search;
+}
+
+/*
+ * save_shared - Write the globals of the shared heap back
+ */
+static void save_shared(void) {
+    shared->wilderness = TO_OFF(wilderness);
+    shared->compact_cursor = TO_OFF(compact_cursor);
+    shared->handles = TO_OFF(handles);
+    shared->num_handles = num_handles;
+    shared->free_handle = free_handle;
+    shared->hinted = hinted;
+    shared->free_bytes = free_bytes;
+    shared->small_limit = small_limit;
+    shared->small_bytes = small_bytes;
+    shared->policy = policy;
+    shared->chunksize = chunksize;
+    shared->typical_size = typical_size;
+    shared->num_malloc = num_malloc;
+    shared->window_fits = window_fits;
+    shared->window_nodes = window_nodes;
+    shared->dense_extra = dense_extra;
+    shared->dense_better = dense_better;
+    shared->dense_hold = dense_hold;
+    shared->last_frag = last_frag;
+    shared->last_search = last_search;
+}
+
+/*
+ * stamp_all - Restart the aging of every free block of at least purge_min bytes, which is needed when purge_min changes: the blocks
+ * that weren't big enough before have no stamp yet. What was decommitted of them is forgotten (it counts as committed again).
+ */
+static void stamp_all(void) {
+    char *bp;
+
+    for (int r = 0; r < NUM_REGION; r++) {
+        for (int i = 0; i < NUM_BUCKET; i++) {
+            for (bp = TO_PTR(region_listp[r][i]); bp != NULL; bp = SUCC_BLKP(bp)) {
+                if (GET_SIZE(HDRP(bp)) >= maint.purge_min) {
+                    PUT(STAMP(bp), maint_tick);
+                    PUT(PURGED(bp), 0);
+                }
+            }
+        }
+    }
+    purged_bytes = 0;
+}
+
+/*
+ * committed - Bytes of memory the heap holds: the heap and the headroom above it as far as they were faulted in, minus what the
+ * maintenance passes gave back of the free blocks. This is an upper bound: a free block that is coalesced or split forgets what was
+ * decommitted of it (its pages count as committed again, though they stay out of memory until they are written), and so does every
+ * block when purge_min changes. over_limit counts the resident pages before it lets a limit fail a growth.
+ */
+static size_t committed(void) {
+    return mem_committed() - purged_bytes;
+}
+
+/*
+ * over_limit - Return 1 (and put the calling thread under pressure) if growing the heap by size bytes would take it past the hard
+ * limit, or past the soft limit unless that is waived. When the committed() estimate says so, the pages actually resident have the
+ * last word.
+ */
+static int over_limit(size_t size) {
+    size_t used;
+
+    if (soft_limit == 0 && hard_limit == 0)
+        return 0;
+    used = committed() + size;
+    if ((hard_limit && used > hard_limit) || (soft_limit && !soft_waived && used > soft_limit))
+        used = MIN(used, mem_resident() + size);
+    if (hard_limit && used > hard_limit) {
+        pressure = used - hard_limit;
+        return 1;
+    }
+    if (soft_limit && !soft_waived && used > soft_limit) {
+        pressure = used - soft_limit;
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * relieve_pressure - Called with the lock held after an allocation failed. If it failed at a limit, run the pressure callbacks with
+ * the lock released (they are expected to free blocks), give back all the idle memory of the heap, waive the soft limit and return 1,
+ * so that the caller retries once. The headroom goes too; the next maintenance pass builds it up again.
+ */
+static int relieve_pressure(void) {
+    size_t excess = pressure, pagesize = mem_pagesize();
+    int n = num_callbacks;
+    char *bp;
+
+    pressure = 0;
+    if (excess == 0 || relieving)
+        return 0;
+    pressure_events++;
+
+    relieving = 1;
+    for (int i = 0; i < n; i++) {
+        mm_pressure_fn fn = pressure_callbacks[i].fn;
+        void *arg = pressure_callbacks[i].arg;
+
+        MM_UNLOCK();
+        fn(excess, arg);
+        MM_LOCK();
+    }
+    relieving = 0;
+
+    compact(SIZE_MAX);                                          // slide movable blocks down, trims a large wilderness
+    if (wilderness)
+        trim_wilderness(GET_SIZE(HDRP(wilderness)));
+    if (maint.purge_min) {
+        for (int r = 0; r < NUM_REGION; r++) {
+            for (int i = getSeglistSize(maint.purge_min); i < NUM_BUCKET; i++) {
+                for (bp = TO_PTR(region_listp[r][i]); bp != NULL; bp = SUCC_BLKP(bp)) {
+                    if (GET_SIZE(HDRP(bp)) >= maint.purge_min)
+                        purge_block(bp, 1, pagesize);
+                }
+            }
+        }
+    }
+    mem_headroom(0);
+
+    soft_waived = 1;
+    return 1;
+}
+
+/*
+ * update_policy - Called every POLICY_WINDOW mallocs. Estimate the external fragmentation as the share of free bytes held by buckets
+ * below the bucket of the typical request (those blocks are too small to serve it), together with the average find_fit search length
+ * of the last window, and switch policies with some hysteresis. insert and delete keep count of the bytes of blocks up to small_limit,
+ * the largest size of those buckets, so the free lists are only walked when the typical request moves to another bucket.
+ * On top of that, the dense policy has a cost check: if, since it came on, fewer than one in DENSE_MIN_BETTER of the blocks best_fit
+ * looked at past the first fit turned out to be a better fit, the longer searches buy nothing on this workload, so the fast policy
+ * comes back and the dense one is held off for DENSE_HOLD windows.
+ */
+static void update_policy(void) {
+    int typical_bucket = getSeglistSize(typical_size);
+    size_t limit = typical_bucket ? bucket_limits[typical_bucket - 1] : 0;
+    char *bp;
+    int r, b;
+
+    if (limit != small_limit) {                 // the typical request moved to another bucket: count the small blocks again
+        small_limit = limit;
+        small_bytes = 0;
+        for (r = 0; r < NUM_REGION; r++)
+            for (b = 0; b < typical_bucket; b++)
+                for (bp = TO_PTR(region_listp[r][b]); bp != NULL; bp = SUCC_BLKP(bp))
+                    small_bytes += GET_SIZE(HDRP(bp));
+    }
+
+    /* A nearly empty free list says nothing about fragmentation */
+    last_frag = (free_bytes >= CHUNKSIZE) ? (double) small_bytes / free_bytes : 0;
+    last_search = window_fits ? (double) window_nodes / window_fits : 0;
+    window_fits = window_nodes = 0;
+    if (dense_hold)
+        dense_hold--;
+
+    if (policy == MM_POLICY_FAST && !dense_hold && (last_frag > FRAG_HIGH || last_search > SEARCH_HIGH))
+        set_policy(MM_POLICY_DENSE);
+    else if (policy == MM_POLICY_DENSE && last_frag < FRAG_LOW && last_search < SEARCH_HIGH/2)
+        set_policy(MM_POLICY_FAST);
+    else if (policy == MM_POLICY_DENSE && dense_better * DENSE_MIN_BETTER < dense_extra) {
+        dense_hold = DENSE_HOLD;
+        set_policy(MM_POLICY_FAST);
+    }
+}
+
+/*
+ * set_policy - Switch to new_policy, adjust the heap growth chunk and log the transition
+ */
+static void set_policy(int new_policy) {
+    mm_transition_t *t = &policy_log[num_transitions % MM_POLICY_LOG];
+
+    t->op = num_malloc;
+    t->from = policy;
+    t->to = new_policy;
+    t->frag = last_frag;
+    t->avg_search = last_search;
+    num_transitions++;
+
+    policy = new_policy;
+    dense_extra = dense_better = 0;
+    chunksize = params.chunk;                               // the fast policy scales it up again on the next extend_heap
+}
+
+/*
+ * mm_get_stats - Fill in a snapshot of the policy statistics
+ */
+void mm_get_stats(mm_stats_t *stats) {
+    unsigned long first;
+
+    MM_LOCK();
+    first = (num_transitions > MM_POLICY_LOG) ? num_transitions - MM_POLICY_LOG : 0;
+    stats->policy = policy;
+    stats->chunksize = chunksize;
+    stats->free_bytes = free_bytes;
+    stats->wilderness = wilderness ? GET_SIZE(HDRP(wilderness)) : 0;
+    stats->typical_size = typical_size;
+    stats->frag = last_frag;
+    stats->avg_search = last_search;
+    stats->transitions = num_transitions;
+    stats->committed = committed();
+    stats->pressure_events = pressure_events;
+    stats->num_log = num_transitions - first;
+    for (unsigned long i = first; i < num_transitions; i++)
+        stats->log[i - first] = policy_log[i % MM_POLICY_LOG];
+    MM_UNLOCK();
+}
+
+/*
+ * mm_get_counters - Fill in the gauges and, with MM_STATS, the event counters. Counting the free blocks of each bucket walks the free
+ * lists. Returns 0, or -1 if the event counters aren't kept.
+ */
+int mm_get_counters(mm_counters_t *c) {
+    char *bp;
+    int r, b;
+
+    MM_LOCK();
+#ifdef MM_STATS
+    *c = counters;
+#else
+    memset(c, 0, sizeof(*c));
+#endif
+    if (free_listp != NULL) {                                   // there is a heap (mm_init was called)
+        c->heap_bytes = mem_heapsize();
+        c->free_bytes = free_bytes;
+        c->wilderness = wilderness ? GET_SIZE(HDRP(wilderness)) : 0;
+        c->live_bytes = c->heap_bytes - (NUM_BUCKET + 3) * WSIZE - c->free_bytes - c->wilderness;  // less the list heads, prologue and epilogue
+        for (b = 0; b < NUM_BUCKET; b++)
+            for (r = 0; r < NUM_REGION; r++)
+                for (bp = TO_PTR(region_listp[r][b]); bp != NULL; bp = SUCC_BLKP(bp)) {
+                    c->bucket_blocks[b]++;
+                    c->bucket_bytes[b] += GET_SIZE(HDRP(bp));
+                }
+    }
+    MM_UNLOCK();
+#ifdef MM_STATS
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+/*
+ * mm_print_stats - Write the counters and the policy statistics to fp, as text (MM_STATS_TEXT) or as a JSON object (MM_STATS_JSON).
+ * Returns 0, or -1 if writing failed.
+ */
+int mm_print_stats(FILE *fp, int format) {
+    mm_counters_t c;
+    mm_stats_t st;
+    int kept, b;
+
+    kept = mm_get_counters(&c) == 0;
+    mm_get_stats(&st);
+    if (format == MM_STATS_JSON) {
+        fprintf(fp, "{\"heap_bytes\": %lu, \"live_bytes\": %lu, \"free_bytes\": %lu, \"wilderness\": %lu, \"committed\": %lu, ",
+                (unsigned long) c.heap_bytes, (unsigned long) c.live_bytes, (unsigned long) c.free_bytes,
+                (unsigned long) c.wilderness, (unsigned long) st.committed);
+        fprintf(fp, "\"policy\": \"%s\", \"chunksize\": %lu, \"frag\": %.4f, \"avg_search\": %.4f, \"transitions\": %lu, "
+                "\"pressure_events\": %lu, \"counted\": %s, ", st.policy == MM_POLICY_FAST ? "fast" : "dense",
+                (unsigned long) st.chunksize, st.frag, st.avg_search, st.transitions, st.pressure_events, kept ? "true" : "false");
+        fprintf(fp, "\"mallocs\": %lu, \"frees\": %lu, \"reallocs\": %lu, \"realloc_in_place\": %lu, \"realloc_copies\": %lu, "
+                "\"splits\": %lu, \"coalesces\": %lu, \"extends\": %lu, \"buckets\": [", c.mallocs, c.frees, c.reallocs,
+                c.realloc_in_place, c.realloc_copies, c.splits, c.coalesces, c.extends);
+        for (b = 0; b < NUM_BUCKET; b++) {
+            if (b < NUM_BUCKET - 1)
+                fprintf(fp, "{\"limit\": %lu, ", (unsigned long) bucket_limits[b]);
+            else
+                fprintf(fp, "{\"limit\": null, ");
+            fprintf(fp, "\"blocks\": %lu, \"bytes\": %lu}%s", c.bucket_blocks[b], (unsigned long) c.bucket_bytes[b],
+                    b < NUM_BUCKET - 1 ? ", " : "], \"search_hist\": [");
+        }
+        for (b = 0; b < MM_SEARCH_BINS; b++)
+            fprintf(fp, "%lu%s", c.search_hist[b], b < MM_SEARCH_BINS - 1 ? ", " : "]}\n");
+    }
+    else {
+        fprintf(fp, "heap %lu bytes: %lu live, %lu free, %lu wilderness; %lu committed\n", (unsigned long) c.heap_bytes,
+                (unsigned long) c.live_bytes, (unsigned long) c.free_bytes, (unsigned long) c.wilderness, (unsigned long) st.committed);
+        fprintf(fp, "policy %s, chunk %lu, frag %.2f, search %.1f, %lu transitions, %lu pressure events\n",
+                st.policy == MM_POLICY_FAST ? "fast" : "dense", (unsigned long) st.chunksize, st.frag, st.avg_search,
+                st.transitions, st.pressure_events);
+        if (kept) {
+            fprintf(fp, "calls: %lu malloc, %lu free, %lu realloc (%lu in place, %lu copied)\n", c.mallocs, c.frees, c.reallocs,
+                    c.realloc_in_place, c.realloc_copies);
+            fprintf(fp, "blocks: %lu splits, %lu coalesces, %lu heap extensions\n", c.splits, c.coalesces, c.extends);
+        }
+        else
+            fprintf(fp, "(built without MM_STATS: no event counters)\n");
+        fprintf(fp, "%6s %10s %10s %12s\n", "bucket", "limit", "blocks", "bytes");
+        for (b = 0; b < NUM_BUCKET; b++) {
+            if (b < NUM_BUCKET - 1)
+                fprintf(fp, "%6d %10lu", b, (unsigned long) bucket_limits[b]);
+            else
+                fprintf(fp, "%6d %10s", b, "-");
+            fprintf(fp, " %10lu %12lu\n", c.bucket_blocks[b], (unsigned long) c.bucket_bytes[b]);
+        }
+        if (kept) {
+            fprintf(fp, "find_fit searches by blocks visited:\n");
+            for (b = 0; b < MM_SEARCH_BINS; b++) {
+                if (b < 2)
+                    fprintf(fp, "%12d", b);
+                else if (b < MM_SEARCH_BINS - 1)
+                    fprintf(fp, "%6lu-%-5lu", 1UL << (b - 1), (1UL << b) - 1);
+                else
+                    fprintf(fp, "%6lu-     ", 1UL << (b - 1));
+                fprintf(fp, " %lu\n", c.search_hist[b]);
+            }
+        }
+    }
+    return ferror(fp) ? -1 : 0;
+}
+
+/*
+ * mm_set_sample_rate - Sample one allocation every bytes bytes on average, or stop sampling (0). Blocks sampled before are still
+ * followed until they are freed. The calling thread draws its first sampling point right away, the others within PROF_IDLE bytes.
+ * Returns 0, or -1 if the profiler's tables can't be mapped.
+ */
+int mm_set_sample_rate(size_t bytes) {
+    void *frames[1];
+
+    if (bytes != 0)
+        backtrace(frames, 1);       // loads what backtrace needs now, not in the middle of an allocation
+    MM_LOCK();
+    if (bytes != 0 && prof_stacks == NULL) {
+        prof_stacks = mmap(NULL, PROF_STACKS * sizeof(prof_stack_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        prof_objects = mmap(NULL, PROF_OBJECTS * sizeof(prof_object_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (prof_stacks == MAP_FAILED || prof_objects == MAP_FAILED) {
+            if (prof_stacks != MAP_FAILED)
+                munmap(prof_stacks, PROF_STACKS * sizeof(prof_stack_t));
+            if (prof_objects != MAP_FAILED)
+                munmap(prof_objects, PROF_OBJECTS * sizeof(prof_object_t));
+            prof_stacks = NULL;
+            prof_objects = NULL;
+            MM_UNLOCK();
+            return -1;
+        }
+    }
+    __atomic_store_n(&prof_rate, bytes, __ATOMIC_RELAXED);
+    MM_UNLOCK();
+    prof_countdown = 0;
+    return 0;
+}
+
+/*
+ * mm_dump_profile - Write the heap profile to fp: a legacy pprof heap profile (MM_PROF_PPROF), with the mappings of the process so that
+ * pprof can symbolize it, or folded stacks of the live (MM_PROF_LIVE) or allocated (MM_PROF_ALLOC) bytes, outermost frame first. The
+ * stacks are copied under the lock and written without it, since writing and symbolizing may allocate. Returns -1 if the profiler was
+ * never turned on or writing failed.
+ */
+int mm_dump_profile(FILE *fp, int format) {
+    prof_stack_t *snap;
+    double live, live_bytes, allocs, alloc_bytes, value;
+    char buf[4096];
+    ssize_t n;
+    int fd, slot, i;
+
+    if ((snap = mmap(NULL, PROF_STACKS * sizeof(prof_stack_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+        return -1;
+    MM_LOCK();
+    if (prof_stacks != NULL)
+        memcpy(snap, prof_stacks, PROF_STACKS * sizeof(prof_stack_t));
+    MM_UNLOCK();
+    if (prof_stacks == NULL) {
+        munmap(snap, PROF_STACKS * sizeof(prof_stack_t));
+        return -1;
+    }
+
+    if (format == MM_PROF_PPROF) {
+        live = live_bytes = allocs = alloc_bytes = 0;
+        for (slot = 0; slot < PROF_STACKS; slot++) {
+            live += snap[slot].allocs - snap[slot].frees;
+            live_bytes += snap[slot].alloc_bytes - snap[slot].free_bytes;
+            allocs += snap[slot].allocs;
+            alloc_bytes += snap[slot].alloc_bytes;
+        }
+        fprintf(fp, "heap profile: %.0f: %.0f [%.0f: %.0f] @ heapprofile\n", live, live_bytes, allocs, alloc_bytes);
+        for (slot = 0; slot < PROF_STACKS; slot++) {
+            if (snap[slot].depth == 0)
+                continue;
+            fprintf(fp, "%.0f: %.0f [%.0f: %.0f] @", snap[slot].allocs - snap[slot].frees, snap[slot].alloc_bytes - snap[slot].free_bytes,
+                    snap[slot].allocs, snap[slot].alloc_bytes);
+            for (i = 0; i < snap[slot].depth; i++)
+                fprintf(fp, " %p", snap[slot].frames[i]);
+            fputc('\n', fp);
+        }
+        fputs("\nMAPPED_LIBRARIES:\n", fp);
+        if ((fd = open("/proc/self/maps", O_RDONLY)) >= 0) {
+            while ((n = read(fd, buf, sizeof(buf))) > 0)
+                fwrite(buf, 1, n, fp);
+            close(fd);
+        }
+    }
+    else {
+        for (slot = 0; slot < PROF_STACKS; slot++) {
+            if (snap[slot].depth == 0)
+                continue;
+            value = format == MM_PROF_LIVE ? snap[slot].alloc_bytes - snap[slot].free_bytes : snap[slot].alloc_bytes;
+            if (value < 0.5)
+                continue;
+            for (i = snap[slot].depth - 1; i >= 0; i--) {
+                print_frame(fp, snap[slot].frames[i]);
+                fputc(i > 0 ? ';' : ' ', fp);
+            }
+            fprintf(fp, "%.0f\n", value);
+        }
+    }
+    munmap(snap, PROF_STACKS * sizeof(prof_stack_t));
+    return ferror(fp) ? -1 : 0;
+}
+
+/*
+ * print_frame - Write the function of the return address addr for a folded stack: its name if it's in a dynamic symbol table, else
+ * the file it's in and the offset in there
+ */
+static void print_frame(FILE *fp, void *addr) {
+    Dl_info info;
+    const char *file;
+
+    if (!dladdr((char *) addr - 1, &info) || info.dli_fname == NULL)    // addr - 1: still in the call, even if it was the last instruction
+        fprintf(fp, "%p", addr);
+    else if (info.dli_sname != NULL)
+        fputs(info.dli_sname, fp);
+    else {
+        file = strrchr(info.dli_fname, '/') ? strrchr(info.dli_fname, '/') + 1 : info.dli_fname;
+        fprintf(fp, "%s+%#lx", file, (unsigned long) ((char *) addr - (char *) info.dli_fbase));
+    }
+}
+
+/*
+ * mm_dump_heap - Write a map of the heap to fp, tagged with tag. Only the header words are copied under the lock; they are written
+ * without it. The copy is sized for the heap as it was before the lock was taken, and made again if the heap grew meanwhile.
+ * Returns -1 if there is no heap or writing failed.
+ */
+int mm_dump_heap(FILE *fp, uint64_t tag) {
+    mm_map_header_t header = { "MMHEAP01", tag };
+    uint64_t *words;
+    size_t max_blocks, n;
+    char *bp;
+    int b;
+
+    if (free_listp == NULL)
+        return -1;
+    for (;;) {
+        max_blocks = mem_heapsize() / (DSIZE + OVERHEAD) + 1;
+        if ((words = mmap(NULL, max_blocks * sizeof(uint64_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+            return -1;
+        MM_LOCK();
+        if (mem_heapsize() / (DSIZE + OVERHEAD) + 1 <= max_blocks)
+            break;
+        MM_UNLOCK();
+        munmap(words, max_blocks * sizeof(uint64_t));
+    }
+    n = 0;
+    for (bp = NEXT_BLKP(heap_listp); GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp))
+        words[n++] = GET(HDRP(bp));
+    header.heap_start = (uint64_t) heap_base;
+    header.heap_size = mem_heapsize();
+    header.first = NEXT_BLKP(heap_listp) - WSIZE - heap_base;
+    MM_UNLOCK();
+    header.num_blocks = n;
+    for (b = 0; b < NUM_BUCKET - 1; b++)
+        header.bucket_limits[b] = bucket_limits[b];
+
+    fwrite(&header, sizeof(header), 1, fp);
+    fwrite(words, sizeof(uint64_t), n, fp);
+    munmap(words, max_blocks * sizeof(uint64_t));
+    return ferror(fp) ? -1 : 0;
+}
+
+/*
+ * mm_dump_trace - Write the events in the ring buffers of all threads to fp, as Chrome trace JSON (MM_TRACE_JSON) or in binary
+ * (MM_TRACE_BINARY). Threads go on writing while their ring is copied; events they may have overwritten meanwhile are left out.
+ * Returns -1 without MM_TRACE or if writing failed.
+ */
+int mm_dump_trace(FILE *fp, int format) {
+#ifdef MM_TRACE
+    static const char *names[] = { "?", "malloc", "free", "realloc", "find_fit", "coalesce", "extend_heap" };
+    mm_trace_header_t header = { "MMTRACE1", sizeof(mm_trace_rec_t), getpid() };
+    mm_trace_rec_t *copy, *rec;
+    trace_ring_t *ring;
+    unsigned long head, first, valid, i;
+    int n, k, sep = 0;
+
+    if ((copy = mmap(NULL, MM_TRACE_EVENTS * sizeof(mm_trace_rec_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+        return -1;
+    if (format == MM_TRACE_BINARY)
+        fwrite(&header, sizeof(header), 1, fp);
+    else
+        fprintf(fp, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    n = MIN(__atomic_load_n(&num_rings, __ATOMIC_ACQUIRE), TRACE_THREADS);
+    for (k = 0; k < n; k++) {
+        if ((ring = __atomic_load_n(&trace_rings[k], __ATOMIC_ACQUIRE)) == NULL)
+            continue;
+        head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        first = head > MM_TRACE_EVENTS ? head - MM_TRACE_EVENTS : 0;
+        for (i = first; i < head; i++)
+            copy[i - first] = ring->recs[i % MM_TRACE_EVENTS];
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        valid = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);        // events up to this one may have been written over
+        valid = valid >= MM_TRACE_EVENTS ? valid - MM_TRACE_EVENTS + 1 : 0;
+        for (i = MAX(first, valid); i < head; i++) {
+            rec = &copy[i - first];
+            if (format == MM_TRACE_BINARY) {
+                fwrite(rec, sizeof(*rec), 1, fp);
+                continue;
+            }
+            fprintf(fp, "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": %u, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f, ",
+                    sep ? ",\n" : "", names[rec->event < sizeof(names) / sizeof(names[0]) ? rec->event : 0], header.pid,
+                    rec->thread, rec->start / 1000.0, rec->duration / 1000.0);
+            if (rec->event == MM_EV_FIND_FIT)
+                fprintf(fp, "\"args\": {\"size\": %lu, \"visited\": %lu}}", (unsigned long) rec->size, (unsigned long) rec->arg);
+            else
+                fprintf(fp, "\"args\": {\"size\": %lu, \"ptr\": \"%#lx\"}}", (unsigned long) rec->size, (unsigned long) rec->arg);
+            sep = 1;
+        }
+    }
+    if (format != MM_TRACE_BINARY)
+        fprintf(fp, "\n]}\n");
+    munmap(copy, MM_TRACE_EVENTS * sizeof(mm_trace_rec_t));
+    return ferror(fp) ? -1 : 0;
+#else
+    return -1;
+#endif
+}
+
+#ifdef MM_TRACE
+/*
+ * trace_now - Current time for the trace (ns)
+ */
+static uint64_t trace_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * trace_event - Append an event that began at start to the ring of the calling thread. The record is written before the head moves
+ * past it, so a dumper that sees the head also sees the record.
+ */
+static void trace_event(int event, uint64_t start, size_t size, uint64_t arg) {
+    trace_ring_t *ring = trace_ring;
+    mm_trace_rec_t *rec;
+    unsigned long head;
+
+    if (ring == NULL && (ring = new_ring()) == NULL)
+        return;
+    head = ring->head;
+    rec = &ring->recs[head % MM_TRACE_EVENTS];
+    rec->start = start;
+    rec->duration = MIN(trace_now() - start, UINT32_MAX);
+    rec->event = event;
+    rec->thread = ring->thread;
+    rec->size = size;
+    rec->arg = arg;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * new_ring - Map a ring for the calling thread and publish it. Past TRACE_THREADS rings, the thread's events aren't traced.
+ */
+static trace_ring_t *new_ring(void) {
+    trace_ring_t *ring;
+    int k;
+
+    if (trace_off)
+        return NULL;
+    trace_off = 1;
+    if ((k = __atomic_fetch_add(&num_rings, 1, __ATOMIC_RELAXED)) >= TRACE_THREADS)
+        return NULL;
+    if ((ring = mmap(NULL, sizeof(trace_ring_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+        return NULL;
+    ring->thread = k;
+    __atomic_store_n(&trace_rings[k], ring, __ATOMIC_RELEASE);
+    trace_off = 0;
+    return trace_ring = ring;
+}
+#endif
+
+#ifdef MM_STATS
+/*
+ * search_bin - Bin of the find_fit histogram for a search that visited nodes free blocks: 0, 1, 2-3, 4-7 and so on
+ */
+static int search_bin(unsigned long nodes) {
+    int bin = 0;
+
+    while (nodes != 0 && bin < MM_SEARCH_BINS - 1) {
+        nodes >>= 1;
+        bin++;
+    }
+    return bin;
+}
+#endif
+
+/*
+ * coalesce - boundary tag coalescing. Return ptr to coalesced block. There are 4 cases when coalescing. A free neighbor of another
+ * lifetime region counts as allocated, except for the wilderness.
+ */
+static void *coalesce(void *bp) {
+    size_t region = GET_REGION(HDRP(bp));
+    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));             // check if the previous block is allocated
+    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));             // check if the next block is allocated
+    size_t size = GET_SIZE(HDRP(bp));
+
+    if (hinted) {                                                   // without hints, every block is in REGION_ANY
+        if (!prev_alloc && PREV_BLKP(bp) != wilderness && GET_REGION(FTRP(PREV_BLKP(bp))) != region)
+            prev_alloc = 1;
+        if (!next_alloc && NEXT_BLKP(bp) != wilderness && GET_REGION(HDRP(NEXT_BLKP(bp))) != region)
+            next_alloc = 1;
+    }
+    
+    if (prev_alloc && next_alloc) {                                 /* Case 1: both blocks already allocated, no coalescing */
+        keep_cursor(bp);                                    // bp may still have swallowed the cursor (a run of free_batch)
+        return bp;
+    }
+    else if (prev_alloc && !next_alloc) {                           /* Case 2: combine with the next block */
+        STAT_INC(coalesces);
+        delete(NEXT_BLKP(bp));                              // delete the next block from the free list, prepare for coalescing
+        size += GET_SIZE(HDRP(NEXT_BLKP(bp)));              
+        PUT(HDRP(bp), PACK(size, REGION_BITS(region)));     // get the new size, then update the footer and header
+        PUT(FTRP(bp), PACK(size, REGION_BITS(region)));
+    }
+    else if (!prev_alloc && next_alloc) {                           /* Case 3: combine with the previous block */
+        STAT_INC(coalesces);
+        delete(PREV_BLKP(bp));                              // delete the previous block from the free list, prepare for coalescing
+        size += GET_SIZE(HDRP(PREV_BLKP(bp)));
+        PUT(FTRP(bp), PACK(size, REGION_BITS(region)));     // get the new size, then update the footer and header
+        PUT(HDRP(PREV_BLKP(bp)), PACK(size, REGION_BITS(region)));
+        bp = PREV_BLKP(bp);                                 // move the pointer to the start of the new block
+    }
+    else {                                                          /* Case 4: combine with the both next and previous blocks */
+        STAT_INC(coalesces);
+        delete(PREV_BLKP(bp));                              // delete both blocks from the free list, prepare for coalescing
+        delete(NEXT_BLKP(bp));
+        size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(FTRP(NEXT_BLKP(bp)));
+        PUT(HDRP(PREV_BLKP(bp)), PACK(size, REGION_BITS(region)));  // get the new size, then update the appropriate footer and header
+        PUT(FTRP(NEXT_BLKP(bp)), PACK(size, REGION_BITS(region)));
+        bp = PREV_BLKP(bp);                                 // move the pointer to the start of the new block
+    }
+    keep_cursor(bp);
+    return bp;
+}
+
+/*
+ * isSeglistPointer - return 1 if the pointer ptr is the seglist pointer (a pointer to a doubly linked list of free blocks of a class size)
+ * of the given region. No block lies among the list heads, so being in their range is enough.
+ */
+static int isSeglistPointer(void *ptr, int region) {
+    size_t *heads = region_listp[region];
+
+    return (size_t *) ptr >= heads && (size_t *) ptr < heads + NUM_BUCKET;
+}
+
+/*
+ * delete - delete a block from the free list. There are also 4 cases. Deleting the wilderness just forgets about it.
+ */
+static void delete(void *bp) {
+    if (bp == wilderness) {                                 // the wilderness is not in any list
+        wilderness = NULL;
+        return;
+    }
+
+    int pre = !isSeglistPointer(PRED_BLKP(bp), GET_REGION(HDRP(bp)));  // if bp is not the first block (the previous block is not the seglist pointer)      
+    int suc = (SUCC_BLKP(bp) != NULL);
+    
+    if (GET_ALLOC(HDRP(bp))) {
+        printf("ERROR: Calling delete on an allocated block!\n");
+        return;
+    }
+
+    size_t size = GET_SIZE(HDRP(bp));                       // keep the free byte counters up to date
+    free_bytes -= size;
+    small_bytes -= (size <= small_limit) ? size : 0;
+    if (maint.purge_min && size >= maint.purge_min)
+        purged_bytes -= GET(PURGED(bp));
+
+    if (!pre && suc) {                                      // if bp is the first block and has successors
+        PUT(PRED_BLKP(bp), GET(SUCC(bp)));
+        PUT(PRED(SUCC_BLKP(bp)), GET(PRED(bp)));
+    }
+    else if (!pre && !suc) {                                // if bp is both the first and the last block of the list
+        PUT(PRED_BLKP(bp), GET(SUCC(bp)));
+    }
+    else if (pre && suc) {                                  // if bp is a block in the middle with successors and predecessors
+        PUT(SUCC(PRED_BLKP(bp)), GET(SUCC(bp)));
+        PUT(PRED(SUCC_BLKP(bp)), GET(PRED(bp)));
+    }
+    else {                                                  // if bp is the last block
+        PUT(SUCC(PRED_BLKP(bp)), 0);
+    }
+
+    PUT(PRED(bp), 0);                                       // as always, we also zero-ed the predecessor and successor pointer (optional)
+    PUT(SUCC(bp), 0);
+}
+
+/*
+ * insert - insert a free block pointed at by bp into the appropriate free list (bucket of its region) at the beginning. A free block
+ * right before the epilogue becomes the wilderness instead.
+ */
+static void insert(void *bp) {
+    if (GET_SIZE(HDRP(NEXT_BLKP(bp))) == 0) {
+        wilderness = bp;
+        return;
+    }
+
+    size_t size = GET_SIZE(HDRP(bp));                       // size of the block at bp
+    size_t *bucket_ptr;                                     // the pointer to the bucket (class size)
+    size_t bp_val = TO_OFF(bp);
+
+    int bucket = getSeglistSize(size);
+    bucket_ptr = region_listp[GET_REGION(HDRP(bp))] + bucket;  // move the bucket pointer to the right place
+    free_bytes += size;                                     // keep the free byte counters up to date
+    small_bytes += (size <= small_limit) ? size : 0;
+    if (maint.purge_min && size >= maint.purge_min) {       // start aging the block
+        PUT(STAMP(bp), maint_tick);
+        PUT(PURGED(bp), 0);
+    }
+    if (GET(bucket_ptr) == 0) {                             // if this bucket is empty
+        PUT(bucket_ptr, bp_val);                            // bucket points to block at bp
+        PUT(PRED(bp), TO_OFF(bucket_ptr));                  // also set the predecessor and successor of block at bp
+        PUT(SUCC(bp), 0);
+    }
+    else {                                                  // if this bucket is not empty, insert the free block at the beginning of the bucket
+        PUT(PRED(bp), TO_OFF(bucket_ptr));
+        PUT(SUCC(bp), GET(bucket_ptr));
+        PUT(PRED(TO_PTR(GET(bucket_ptr))), bp_val);
+        PUT(bucket_ptr, bp_val);
+    }
+}
+
+/*
+ * getSeglistSize - get the appropriate bucket number for the block size (17 buckets numbered from 0 to 16), from the limits of
+ * mm_buckets.h, which mm.hpp shares to work out the buckets of constant sizes at compile time. The common block sizes are looked up
+ * in bucket_table, which mm_init fills in from the limits, rather than compared with them one by one.
+ */
+
+static int getSeglistSize(size_t blksize) {
+    int i;
+
+    if (blksize <= BUCKET_TABLE_MAX && blksize % DSIZE == 0)
+        return bucket_table[blksize / DSIZE];
+#pragma GCC unroll 16                   /* into the chain of compares with constants it used to be */
+    for (i = 0; i < NUM_BUCKET - 1; i++)
+        if (blksize <= bucket_limits[i])
+            return i;
+    return NUM_BUCKET - 1;
+}
+
+/* 
+ * ------------------------- BELOW HERE ARE FUNCTIONS FOR CHECKING THE CONSISTENCY OF THE HEAP, USED BY MM_CHECKHEAP() --------------------------
+*/
+static void printBlock(void *bp) {                                          /* Print the block information at bp */
+    size_t hsize, halloc, fsize, falloc;
+
+    hsize = GET_SIZE(HDRP(bp));
+    halloc = GET_ALLOC(HDRP(bp));
+    fsize = GET_SIZE(FTRP(bp));
+    falloc = GET_ALLOC(FTRP(bp));
+
+    if (hsize == 0) {
+	    printf("%p: EOL\n", bp);
+	    return;
+    }
+
+    printf("%p: header: [%ld:%c] footer: [%ld:%c] pred: [%p] succ: [%p]\n", bp,
+	   hsize, (halloc ? 'a' : 'f'),
+	   fsize, (falloc ? 'a' : 'f'),
+       (void *) PRED_BLKP(bp),
+       (void *) SUCC_BLKP(bp));
+}
+
+static void printSeglist() {                                                /* Print the segregated list */
+    void *ptr, *bp;
+    printf("\n------Beginning of Segregated Free List-------\n");
+    for (int i = 0; i < NUM_REGION * NUM_BUCKET; i++) {
+        ptr = region_listp[i / NUM_BUCKET] + i % NUM_BUCKET;
+        if (GET(ptr) == 0) {
+            printf("- [%p] Region %d bucket %d: (empty)\n", ptr, i / NUM_BUCKET, i % NUM_BUCKET);
         } 
         else {
-            printf("- [%p] Bucket %d: (not empty)\n", ptr, i);
-            bp = (void *) GET(ptr);
+            printf("- [%p] Region %d bucket %d: (not empty)\n", ptr, i / NUM_BUCKET, i % NUM_BUCKET);
+            bp = TO_PTR(GET(ptr));
             while (bp != ((void *) 0)) {
                 printBlock(bp);
                 bp = SUCC_BLKP(bp);
@@ -615,30 +3216,85 @@ static void checkSeglist() {                                                /* C
 	char *bp;
 	int freeInSeglist = 0;
 	int freeInHeap = 0;
+	size_t freeBytes = 0, smallBytes = 0;
 
-	for (int i = 0; i < NUM_BUCKET; ++i){
-		for (bp = free_listp[i]; bp != NULL; bp = SUCC_BLKP(bp)) {
+	for (int i = 0; i < NUM_REGION * NUM_BUCKET; ++i){
+		for (bp = TO_PTR(region_listp[i / NUM_BUCKET][i % NUM_BUCKET]); bp != NULL; bp = SUCC_BLKP(bp)) {
             freeInSeglist++;                                                            /* increment free blocks in seglist */
+            freeBytes += GET_SIZE(HDRP(bp));
+            smallBytes += (GET_SIZE(HDRP(bp)) <= small_limit) ? GET_SIZE(HDRP(bp)) : 0;
 			checkBlock(bp);
 			
 			if (GET_ALLOC(HDRP(bp))) {                                                  /* check if all the blocks in the seglist are free */
 			    printf("ERROR: allocated block (%p) appeared in seg list.\n", bp);
 			}
 
-			if (getSeglistSize(GET_SIZE(HDRP(bp))) != i) {                              /* check if there is a block in a wrong bucket */
+			if (getSeglistSize(GET_SIZE(HDRP(bp))) != i % NUM_BUCKET) {                 /* check if there is a block in a wrong bucket */
 			    printf("ERROR: block (%p) located in wrong bucket.\n", bp);
 			}
+
+			if (GET_REGION(HDRP(bp)) != i / NUM_BUCKET) {                               /* ... or in the lists of the wrong region */
+			    printf("ERROR: block (%p) located in wrong region.\n", bp);
+			}
 	    }	
 	}
 
-	/* Computer total number of free blocks in heap */
+	/* Computer total number of free blocks in heap, except for the wilderness */
     for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
-		if (!GET_ALLOC(HDRP(bp))) {
+		if (!GET_ALLOC(HDRP(bp)) && bp != wilderness) {
 			freeInHeap++;
 	    }
+		if (!GET_ALLOC(HDRP(bp)) && GET_SIZE(HDRP(NEXT_BLKP(bp))) == 0 && bp != wilderness) {
+			printf("ERROR: free block (%p) before the epilogue is not the wilderness.\n", bp);
+		}
+	}
+
+	if (wilderness && (GET_ALLOC(HDRP(wilderness)) || GET_SIZE(HDRP(NEXT_BLKP(wilderness))) != 0)) {
+		printf("ERROR: wilderness (%p) is not a free block before the epilogue.\n", wilderness);
 	}
 
     if (freeInSeglist != freeInHeap){
     	printf("ERROR: number of free blocks in seglist is inconsistent with in heap.\n");
     }
-}
\ No newline at end of file
+
+    if (freeBytes != free_bytes || smallBytes != small_bytes) {                 /* the counters of update_policy */
+        printf("ERROR: free byte counters (%lu, %lu small) don't match the seglist (%lu, %lu small).\n",
+               (unsigned long) free_bytes, (unsigned long) small_bytes, (unsigned long) freeBytes, (unsigned long) smallBytes);
+    }
+}
+
+static void checkHandles() {                                                /* Check the handle table against the movable blocks */
+    char *bp;
+    size_t unused = 0, live = 0, movable = 0;
+    int cursorSeen = (compact_cursor == NULL);
+
+    for (size_t h = free_handle; h != 0; h = handles[h - 1].pins) {            /* the unused entries */
+        if (handles[h - 1].bp != 0)
+            printf("ERROR: unused handle %lu points at block (%p).\n", (unsigned long) h, TO_PTR(handles[h - 1].bp));
+        if (++unused > num_handles)
+            break;
+    }
+
+    for (size_t i = 0; i < num_handles; i++) {                                  /* the live entries */
+        if ((bp = TO_PTR(handles[i].bp)) == NULL)
+            continue;
+        live++;
+        if (!GET_ALLOC(HDRP(bp)) || !GET_MOVABLE(HDRP(bp)) || !GET_MOVABLE(FTRP(bp)))
+            printf("ERROR: handle %lu points at block (%p), which is not an allocated movable block.\n", (unsigned long) i + 1, bp);
+        else if (GET(bp) != i)
+            printf("ERROR: block (%p) of handle %lu refers back to handle %lu.\n", bp, (unsigned long) i + 1, (unsigned long) GET(bp) + 1);
+    }
+
+    for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+        if (GET_ALLOC(HDRP(bp)) && GET_MOVABLE(HDRP(bp)))
+            movable++;
+        if (bp == compact_cursor)
+            cursorSeen = 1;
+    }
+
+    if (unused + live != num_handles || live != movable)
+        printf("ERROR: %lu live and %lu unused handles, %lu movable blocks in heap.\n",
+               (unsigned long) live, (unsigned long) unused, (unsigned long) movable);
+    if (!cursorSeen)
+        printf("ERROR: compaction cursor (%p) does not point at a block.\n", compact_cursor);
+}
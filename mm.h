@@ -1,10 +1,294 @@
 #include <stdio.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 extern int mm_init (void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
 extern int mm_check(int verbose);
+extern int mm_reserve(size_t bytes, int flags);
+extern void mm_set_coloring(size_t min_size, int colors);
+
+extern void *mm_malloc_hint(size_t size, int hint);
+extern void *mm_malloc_class(size_t asize, int bucket);
+extern void *mm_memalign(size_t alignment, size_t size);
+extern size_t mm_usable_size(void *ptr);
+
+/* Handlers for pthread_atfork, for programs that fork while other threads allocate */
+extern void mm_fork_prepare(void);
+extern void mm_fork_parent(void);
+extern void mm_fork_child(void);
+
+/*
+ * Movable blocks. mm_halloc returns a handle; the block may be moved by
+ * mm_compact unless it's pinned, so its address is only valid between
+ * mm_pin and the matching mm_unpin. A handle that is 0 or was freed is
+ * ignored (mm_pin returns NULL), and so is mm_hfree of a pinned block.
+ */
+typedef size_t mm_handle_t;     /* 0 is never a valid handle */
+
+extern mm_handle_t mm_halloc(size_t size);
+extern void mm_hfree(mm_handle_t h);
+extern void *mm_pin(mm_handle_t h);
+extern void mm_unpin(mm_handle_t h);
+extern int mm_compact(size_t budget);
+
+/*
+ * Deferred frees for data that lock-free readers may still be using.
+ * Readers bracket their accesses with mm_enter/mm_exit; a block passed
+ * to mm_free_deferred is freed once every reader that could have seen
+ * it has left its critical section.
+ */
+extern int mm_enter(void);
+extern void mm_exit(void);
+extern int mm_free_deferred(void *ptr);
+extern void mm_reclaim(void);
+
+/*
+ * Background maintenance. A pass every interval_ms gives back part of
+ * the pages of every free block of at least purge_min bytes, more the
+ * longer the block has been idle (all of them after decay_ms), and keeps
+ * headroom bytes above the heap break faulted in, so that mm_malloc and
+ * mm_free don't need to make system calls themselves.
+ */
+typedef struct {
+    unsigned interval_ms;   /* time between two passes */
+    unsigned decay_ms;      /* idle time after which a free block is given back entirely */
+    size_t purge_min;       /* smaller free blocks are left alone */
+    size_t headroom;        /* bytes kept faulted in above the heap break */
+} mm_maint_t;
+
+extern int mm_start_maintenance(const mm_maint_t *params);
+extern void mm_stop_maintenance(void);
+extern void mm_maintain(void);
+
+/*
+ * Memory budget. When the heap would have to grow past the soft limit,
+ * the pressure callbacks are run (without the allocator lock, so they
+ * may free blocks) and idle memory is given back before the allocation
+ * is retried; it fails only if the heap can't grow without passing the
+ * hard limit. The callbacks get the number of bytes the heap would be
+ * over the limit by. Limits are on committed bytes (mm_stats_t), 0 for
+ * no limit. That count may include pages given back by the maintenance
+ * pass, so before a limit fails an allocation, the pages of the heap
+ * actually in memory are counted.
+ */
+typedef void (*mm_pressure_fn)(size_t excess, void *arg);
+
+extern void mm_set_limits(size_t soft, size_t hard);
+extern int mm_add_pressure_callback(mm_pressure_fn fn, void *arg);
+
+/*
+ * Tunable parameters, in bytes (multiples of 16). mm_set_params checks
+ * and sets them all at once; init_chunk is used by the next mm_init that
+ * sets a heap up, the others right away. mm_load_params reads them from
+ * a file of "name value" lines ('#' starts a comment, names left out
+ * keep their value), as written by mm_save_params and by the tuning mode
+ * of mdriver (-T). Each process of a shared heap has its own.
+ */
+typedef struct {
+    size_t init_chunk;      /* first free block of a new heap */
+    size_t chunk;           /* smallest step the heap grows by */
+    size_t max_chunk;       /* largest step the fast policy grows it by */
+    size_t realloc_pad;     /* room added to every block mm_realloc sizes */
+    size_t split_min;       /* smallest rest split off a free block that is allocated */
+} mm_params_t;
+
+extern int mm_set_params(const mm_params_t *params);
+extern void mm_get_params(mm_params_t *params);
+extern int mm_load_params(const char *path);
+extern int mm_save_params(const char *path);
+
+/*
+ * Heap shared between processes (mem_init_shared/mem_attach in memlib.h,
+ * needs a build with MM_THREAD_SAFE and MM_SHARED_HEAP). Every process maps
+ * the heap at its own address, so blocks are handed from one to another by
+ * offset; without MM_SHARED_HEAP, mm_init fails on a heap that is mapped
+ * anywhere but where it was set up. A heap
+ * kept in a file (mem_init_file) is found again by mm_init after a
+ * restart; mm_checkpoint writes it to disk. Likewise, after mem_restore
+ * goes back to a snapshot of a shared heap, mm_init picks the heap up as
+ * it was then.
+ */
+extern int mm_checkpoint(void);
+extern size_t mm_offset(void *ptr);
+extern void *mm_address(size_t offset);
+
+/* Flags for mm_reserve */
+#define MM_RESERVE_PREFAULT 1   /* fault in the reserved pages right away */
+
+/*
+ * Lifetime hints for mm_malloc_hint. Short- and long-lived blocks are
+ * kept in separate regions of the heap; with MM_LIFETIME_AUTO the
+ * allocator predicts the lifetime from what it saw of earlier blocks
+ * of the same size.
+ */
+#define MM_SHORT_LIVED      1
+#define MM_LONG_LIVED       2
+#define MM_LIFETIME_AUTO    4
+
+/*
+ * Placement policies. The allocator starts out with the fast policy and
+ * switches between the two on its own, based on how fragmented the free
+ * lists look (see mm_get_stats).
+ */
+#define MM_POLICY_FAST  0   /* first fit, heap grows in large chunks */
+#define MM_POLICY_DENSE 1   /* best fit, heap grows in small chunks */
+
+#define MM_POLICY_LOG   16  /* number of policy transitions remembered */
+
+/* One switch between placement policies */
+typedef struct {
+    unsigned long op;       /* mm_malloc call that triggered the switch */
+    int from;               /* policy before the switch */
+    int to;                 /* policy after the switch */
+    double frag;            /* fragmentation estimate at that point */
+    double avg_search;      /* average find_fit search length at that point */
+} mm_transition_t;
+
+/* Snapshot of the allocator statistics, filled in by mm_get_stats */
+typedef struct {
+    int policy;             /* current placement policy */
+    size_t chunksize;       /* current heap growth chunk (bytes) */
+    size_t free_bytes;      /* bytes held in the free lists */
+    size_t wilderness;      /* size of the free block at the top of the heap */
+    size_t typical_size;    /* running average of the adjusted request size */
+    double frag;            /* free bytes in blocks smaller than typical_size / free_bytes */
+    double avg_search;      /* average free blocks visited per find_fit */
+    size_t committed;       /* bytes of memory held by the heap (see mm_set_limits) */
+    unsigned long pressure_events;      /* allocations that hit a memory limit */
+    unsigned long transitions;          /* total number of policy switches */
+    int num_log;                        /* valid entries in log */
+    mm_transition_t log[MM_POLICY_LOG]; /* most recent switches, oldest first */
+} mm_stats_t;
+
+extern void mm_get_stats(mm_stats_t *stats);
+
+/*
+ * Allocator counters, for monitoring. The event counters (calls, splits,
+ * coalesces, heap growths, find_fit search lengths) are only kept in a
+ * build with -DMM_STATS; they count since mm_init, in this process.
+ * mm_get_counters fills in the gauges either way and returns 0, or -1 if
+ * the event counters aren't kept (they are 0 then). mm_print_stats writes
+ * the counters and the mm_get_stats snapshot to fp as text or as a JSON
+ * object.
+ */
+#define MM_NUM_BUCKETS  17  /* buckets of the free lists */
+#define MM_SEARCH_BINS  12  /* find_fit histogram: 0 blocks visited, 1, 2-3, 4-7, ..., 1024 or more */
+
+typedef struct {
+    size_t heap_bytes;                  /* size of the heap */
+    size_t live_bytes;                  /* bytes in allocated blocks, headers included */
+    size_t free_bytes;                  /* bytes in the free lists */
+    size_t wilderness;                  /* bytes in the free block at the top of the heap */
+    unsigned long bucket_blocks[MM_NUM_BUCKETS];    /* free blocks in each bucket (all regions) */
+    size_t bucket_bytes[MM_NUM_BUCKETS];            /* bytes in them */
+    unsigned long mallocs;              /* mm_malloc calls, and the other allocating ones */
+    unsigned long frees;                /* mm_free calls */
+    unsigned long reallocs;             /* mm_realloc calls... */
+    unsigned long realloc_in_place;     /* ...that kept the block where it was */
+    unsigned long realloc_copies;       /* ...and that moved it */
+    unsigned long splits;               /* blocks split off the rest of a free block */
+    unsigned long coalesces;            /* free blocks merged with a free neighbor */
+    unsigned long extends;              /* extend_heap calls that grew the heap */
+    unsigned long search_hist[MM_SEARCH_BINS];      /* find_fit calls by free blocks visited */
+} mm_counters_t;
+
+#define MM_STATS_TEXT   0
+#define MM_STATS_JSON   1
+
+extern int mm_get_counters(mm_counters_t *counters);
+extern int mm_print_stats(FILE *fp, int format);
+
+/*
+ * Heap profiler. With a sample rate of r bytes, the call stack of one
+ * allocation in every r bytes allocated, on average, is recorded (an
+ * allocation of s bytes is picked with probability 1 - exp(-s/r)), and
+ * the sampled blocks are followed until they are freed; 0 stops sampling.
+ * mm_dump_profile writes the estimated bytes and blocks allocated from
+ * each call stack since mm_init, and those still live, as a heap profile
+ * that pprof reads (pprof <program> <file>) or as folded stacks for
+ * flamegraph.pl. Function names in folded stacks come from the dynamic
+ * symbol table, so the program should be linked with -rdynamic. The
+ * profile is of the calling process only.
+ */
+#define MM_PROF_DEPTH   20  /* frames kept of each call stack */
+
+#define MM_PROF_PPROF   0   /* legacy pprof heap profile */
+#define MM_PROF_LIVE    1   /* folded stacks of the bytes still allocated... */
+#define MM_PROF_ALLOC   2   /* ...or of all the bytes allocated */
+
+extern int mm_set_sample_rate(size_t bytes);
+extern int mm_dump_profile(FILE *fp, int format);
+
+/*
+ * Event tracing, in a build with -DMM_TRACE (otherwise the trace points
+ * are compiled out and mm_dump_trace returns -1). Every allocating call,
+ * mm_free and mm_realloc, and within them every find_fit search, coalesce
+ * and heap extension, is recorded with its start time and duration in a
+ * ring buffer of the calling thread, which keeps its last MM_TRACE_EVENTS
+ * events. mm_dump_trace writes the events of all threads as Chrome trace
+ * JSON (chrome://tracing, Perfetto) or in binary: an mm_trace_header_t
+ * followed by the records, in the order they ended within each thread.
+ */
+#define MM_TRACE_EVENTS (1<<16)     /* events kept per thread (a power of two) */
+
+/* Events */
+#define MM_EV_MALLOC    1           /* mm_malloc, mm_malloc_hint, mm_malloc_class or mm_memalign */
+#define MM_EV_FREE      2
+#define MM_EV_REALLOC   3
+#define MM_EV_FIND_FIT  4           /* arg: free blocks visited */
+#define MM_EV_COALESCE  5           /* a freed block merged into its free neighbors and inserted */
+#define MM_EV_EXTEND    6           /* extend_heap */
+
+typedef struct {
+    uint64_t start;                 /* CLOCK_MONOTONIC (ns) */
+    uint32_t duration;              /* ns */
+    uint16_t event;                 /* MM_EV_* */
+    uint16_t thread;                /* number of the thread's ring buffer */
+    uint64_t size;                  /* bytes asked for, freed or grown by (0 for mm_free) */
+    uint64_t arg;                   /* address of the block, or see the event */
+} mm_trace_rec_t;
+
+typedef struct {
+    char magic[8];                  /* "MMTRACE1" */
+    uint32_t rec_size;              /* sizeof(mm_trace_rec_t) */
+    uint32_t pid;                   /* process the events are of */
+} mm_trace_header_t;
+
+#define MM_TRACE_JSON   0
+#define MM_TRACE_BINARY 1
+
+extern int mm_dump_trace(FILE *fp, int format);
+
+/*
+ * Heap map. mm_dump_heap writes an mm_map_header_t and then, for every
+ * block of the heap in address order, its header word: the block size
+ * with the MM_MAP_* flags in the low bits. Blocks are contiguous, so
+ * each one starts where the one before ends, the first at first; the
+ * bucket of a free block follows from its size and bucket_limits. A file
+ * may hold a series of maps (mdriver -m); heapviz renders them.
+ */
+#define MM_MAP_ALLOC    1           /* the block is allocated */
+#define MM_MAP_REGION   6           /* its lifetime region (MM_SHORT_LIVED or MM_LONG_LIVED) times 2 */
+#define MM_MAP_MOVABLE  8           /* it belongs to a handle */
+#define MM_MAP_SIZE(w)  ((w) & ~(uint64_t) 15)
+
+typedef struct {
+    char magic[8];                  /* "MMHEAP01" */
+    uint64_t tag;                   /* passed to mm_dump_heap (a time, an operation number...) */
+    uint64_t heap_start;            /* address of the heap */
+    uint64_t heap_size;             /* its size (bytes) */
+    uint64_t first;                 /* offset of the header of the first block from heap_start */
+    uint64_t num_blocks;            /* header words that follow */
+    uint64_t bucket_limits[MM_NUM_BUCKETS - 1];     /* largest block size of each bucket but the last */
+} mm_map_header_t;
+
+extern int mm_dump_heap(FILE *fp, uint64_t tag);
 
 /* 
  * Students work in teams of one or two.  Teams enter their team name, 
@@ -21,3 +305,6 @@ typedef struct {
 
 extern team_t team;
 
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,205 @@
+/*
+ * mm.hpp - C++ interface to the mm package: a std::pmr::memory_resource
+ *     and a stateful STL allocator that allocate from the mm heap.
+ *
+ * The heap must be set up (mem_init or mem_init_vm, then mm_init) before
+ * the first allocation, and the mm package must be built with
+ * MM_THREAD_SAFE if more than one thread uses it. A resource can carry a
+ * lifetime hint (MM_SHORT_LIVED, MM_LONG_LIVED, MM_LIFETIME_AUTO), so that
+ * the blocks of a container that is known to be short- or long-lived are
+ * kept in their own region of the heap, as with mm_malloc_hint.
+ *
+ * The size and alignment of every allocation are passed through: blocks
+ * aligned to more than mm_alignment bytes come from mm_memalign. mm_free
+ * doesn't need the size of a block, since it is in its header, so sized
+ * deallocation costs nothing extra but saves nothing either.
+ *
+ * mm-new.cpp replaces the global operator new and delete in the same way.
+ *
+ * For a size known at compile time, mm::alloc<N>() works out the block
+ * size and the free list bucket of N as constants and calls
+ * mm_malloc_class, which skips computing them on every call.
+ */
+#ifndef MM_HPP
+#define MM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <memory_resource>
+
+#include "mm.h"
+#include "mm_buckets.h"
+
+namespace mm {
+
+/* Alignment of every mm block */
+constexpr std::size_t mm_alignment = 16;
+
+/* Header plus footer of a block, and the smallest block */
+constexpr std::size_t mm_overhead = 16;
+constexpr std::size_t mm_min_block = 32;
+
+/* Largest block size of each bucket but the last, shared with mm.c */
+constexpr std::size_t bucket_limits[] = { MM_BUCKET_LIMITS };
+constexpr int num_buckets = sizeof(bucket_limits) / sizeof(bucket_limits[0]) + 1;
+
+/*
+ * block_size - Size of the block for a request of size bytes, as
+ *     mm_malloc works it out
+ */
+constexpr std::size_t block_size(std::size_t size)
+{
+    return size <= mm_alignment ? mm_min_block
+        : mm_alignment * ((size + mm_overhead + mm_alignment - 1) / mm_alignment);
+}
+
+/*
+ * bucket - Bucket of the free lists that blocks of asize bytes are kept in
+ */
+constexpr int bucket(std::size_t asize)
+{
+    int b = 0;
+
+    while (b < num_buckets - 1 && asize > bucket_limits[b])
+        b++;
+    return b;
+}
+
+/* Block size and bucket of the size class of N-byte requests */
+template <std::size_t N>
+struct size_class {
+    static_assert(N > 0, "mm::alloc of 0 bytes");
+    static constexpr std::size_t asize = block_size(N);
+    static constexpr int bucket = mm::bucket(asize);
+};
+
+/*
+ * alloc - mm_malloc(N), with the block size and bucket resolved at compile
+ *     time. Returns nullptr on failure.
+ */
+template <std::size_t N>
+inline void *alloc() noexcept
+{
+    return mm_malloc_class(size_class<N>::asize, size_class<N>::bucket);
+}
+
+/*
+ * free - Free a block from alloc<N>. mm_free takes the size from the
+ *     header of the block, so N is only there to pair up with alloc<N>.
+ */
+template <std::size_t N>
+inline void free(void *p) noexcept
+{
+    mm_free(p);
+}
+
+static_assert(block_size(1) == 32 && block_size(16) == 32 && block_size(17) == 48, "block_size");
+static_assert(num_buckets == 17 && bucket_limits[0] < mm_min_block, "mm_buckets.h must have 16 limits, the first below any block");
+static_assert(bucket(bucket_limits[0]) == 0 && bucket(bucket_limits[0] + 1) == 1 &&
+              bucket(bucket_limits[num_buckets - 2] + 1) == num_buckets - 1, "bucket");
+
+/*
+ * allocate - Allocate bytes bytes aligned to alignment with the given
+ *     lifetime hint (0 for none). Returns nullptr on failure.
+ */
+inline void *allocate(std::size_t bytes, std::size_t alignment, int hint = 0) noexcept
+{
+    if (bytes == 0)
+        bytes = 1;
+    if (alignment > mm_alignment)
+        return mm_memalign(alignment, bytes);
+    return hint ? mm_malloc_hint(bytes, hint) : mm_malloc(bytes);
+}
+
+/*
+ * deallocate - Free a block from allocate
+ */
+inline void deallocate(void *p, std::size_t, std::size_t) noexcept
+{
+    mm_free(p);
+}
+
+/*
+ * memory_resource - A polymorphic memory resource on the mm heap. All
+ *     resources share the one heap; two of them are equal if they have the
+ *     same hint, since each can free the blocks of the other.
+ */
+class memory_resource : public std::pmr::memory_resource {
+public:
+    explicit memory_resource(int hint = 0) noexcept : hint_(hint) {}
+
+    int hint() const noexcept { return hint_; }
+
+protected:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        void *p = mm::allocate(bytes, alignment, hint_);
+
+        if (p == nullptr)
+            throw std::bad_alloc();
+        return p;
+    }
+
+    void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override
+    {
+        mm::deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        const memory_resource *r = dynamic_cast<const memory_resource *>(&other);
+
+        return r != nullptr && r->hint_ == hint_;
+    }
+
+private:
+    int hint_;
+};
+
+/*
+ * allocator - A stateful STL allocator that allocates with the hint of its
+ *     resource. Allocators compare equal if their resources do.
+ */
+template <class T>
+class allocator {
+public:
+    typedef T value_type;
+
+    explicit allocator(memory_resource *r) noexcept : resource_(r) {}
+    template <class U>
+    allocator(const allocator<U> &other) noexcept : resource_(other.resource()) {}
+
+    T *allocate(std::size_t n)
+    {
+        if (n > SIZE_MAX / sizeof(T))
+            throw std::bad_array_new_length();
+        return static_cast<T *>(resource_->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *p, std::size_t n) noexcept
+    {
+        resource_->deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    memory_resource *resource() const noexcept { return resource_; }
+
+private:
+    memory_resource *resource_;
+};
+
+template <class T, class U>
+inline bool operator==(const allocator<T> &a, const allocator<U> &b) noexcept
+{
+    return a.resource()->is_equal(*b.resource());
+}
+
+template <class T, class U>
+inline bool operator!=(const allocator<T> &a, const allocator<U> &b) noexcept
+{
+    return !(a == b);
+}
+
+} // namespace mm
+
+#endif /* MM_HPP */
@@ -0,0 +1,18 @@
+/*
+ * mm_buckets.h - Size-class boundaries of the free lists of mm.c: the
+ *     largest block size of each bucket but the last.
+ *
+ * These are the default limits, powers of two (with the odd 32769 of the
+ * original allocator kept). mkbuckets writes a replacement fitted to the
+ * size and lifetime distribution of a set of traces:
+ *
+ *     ./mkbuckets traces/amptjp-bal.rep traces/cccp-bal.rep ... > mm_buckets.h
+ *
+ * mm.c and mm.hpp both use the table, so rebuild everything after
+ * replacing it. There must be NUM_BUCKET - 1 (16) limits, increasing,
+ * and the first must be below the smallest block (32 bytes): bucket 0
+ * stays empty, since the head of its list is at offset 0 of the heap,
+ * which the offset links of mm.c can't tell from NULL.
+ */
+#define MM_BUCKET_LIMITS \
+    8, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, 32769, 65536, 131072, 262144, 524288
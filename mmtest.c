@@ -0,0 +1,330 @@
+/*
+ * mmtest.c - Tests of the mm package (built with -DMM_THREAD_SAFE and
+ *     -DMM_SHARED_HEAP) for what the trace driver doesn't reach. Each test
+ *     starts from a heap of its own and prints the checks that failed.
+ *
+ * fill           Fills the heap up to MAX_HEAP with large blocks, then
+ *                with smaller and smaller ones: each size must be granted
+ *                until less than one block of it is left.
+ * purge-limit    Splits free blocks the maintenance pass gave back, so
+ *                that the committed estimate counts their pages again,
+ *                then grows the heap under a limit that only the pages
+ *                actually in memory stay below.
+ * compact        Compacts a heap of movable blocks with holes in it while
+ *                some of them are pinned, and uses handles that are not
+ *                live.
+ * shared-fork    Hands blocks back and forth with a child process that
+ *                maps the shared heap at another address.
+ * file-reopen    Closes a heap kept in a file, larger than MAX_HEAP, and
+ *                opens it again.
+ *
+ * Exits with the number of tests that failed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define BLOCK_OVERHEAD 32     /* most bytes mm.c adds to a request (header, footer, alignment) */
+
+#define PURGE_BLOCKS   32     /* free blocks purge-limit has the maintenance pass give back */
+#define PURGE_SIZE     (512 << 10)
+
+#define HANDLES        64     /* movable blocks compact starts with... */
+#define HANDLE_SIZE    1000
+#define PIN_EVERY      8      /* ...and one in this many is pinned */
+
+#define SHARED_SIZE    64     /* blocks shared-fork and file-reopen hand over */
+#define FILE_HEAP      ((size_t) 4 << 30)   /* size of the heap file of file-reopen... */
+#define FILE_BLOCK     (64 << 20)           /* ...and of blocks that don't fit a heap of MAX_HEAP */
+
+/* A test: returns the number of its checks that failed */
+typedef struct {
+    const char *name;
+    int (*run)(void);
+} test_t;
+
+static int fill(void);
+static int purge_limit(void);
+static int compact_pinned(void);
+static int shared_fork(void);
+static int file_reopen(void);
+static void usage(void);
+
+static const test_t tests[] = {
+    { "fill", fill },
+    { "purge-limit", purge_limit },
+    { "compact", compact_pinned },
+    { "shared-fork", shared_fork },
+    { "file-reopen", file_reopen },
+};
+#define NUM_TESTS (sizeof(tests) / sizeof(tests[0]))
+
+/* Count and print a failed check */
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("  %s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failed++; \
+        } \
+    } while (0)
+
+int main(int argc, char **argv)
+{
+    int i, j, failed, num_failed = 0;
+
+    if (argc > 1 && !strcmp(argv[1], "-h")) {
+        usage();
+        exit(0);
+    }
+    for (i = 1; i < argc; i++) {
+        for (j = 0; j < NUM_TESTS && strcmp(argv[i], tests[j].name); j++)
+            ;
+        if (j == NUM_TESTS) {
+            fprintf(stderr, "mmtest: no test %s\n", argv[i]);
+            exit(1);
+        }
+    }
+
+    for (j = 0; j < NUM_TESTS; j++) {
+        if (argc > 1) {
+            for (i = 1; i < argc && strcmp(argv[i], tests[j].name); i++)
+                ;
+            if (i == argc)
+                continue;
+        }
+        printf("%s\n", tests[j].name);
+        fflush(stdout);
+        failed = tests[j].run();
+        printf("%s: %s\n", tests[j].name, failed ? "FAILED" : "ok");
+        num_failed += (failed != 0);
+    }
+    exit(num_failed);
+}
+
+/*
+ * fill - Fill the heap with blocks of each size in turn, from 200 KB down.
+ *     An allocation may only fail when the wilderness and the room memlib
+ *     has left can't hold the block together.
+ */
+static int fill(void)
+{
+    static const size_t sizes[] = { 200 << 10, 100 << 10, 10 << 10, 1 << 10, 100 };
+    mm_stats_t st;
+    int failed = 0, i;
+
+    mem_init();
+    CHECK(mm_init() == 0);
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        while (mm_malloc(sizes[i]) != NULL)
+            ;
+        mm_get_stats(&st);
+        CHECK(st.wilderness + mem_heapleft() < sizes[i] + BLOCK_OVERHEAD);
+    }
+    CHECK(mm_check(0));
+    mem_deinit();
+    return failed;
+}
+
+/*
+ * purge_limit - Purge PURGE_BLOCKS free blocks of PURGE_SIZE bytes (kept
+ *     apart by small allocated ones), allocate most of each again without
+ *     touching it, and check that an allocation that has to grow the heap
+ *     by less than the limits leave above the resident pages succeeds.
+ */
+static int purge_limit(void)
+{
+    mm_maint_t maint = { 1000000, 1000000, 64 << 10, 0 };
+    void *big[PURGE_BLOCKS];
+    mm_stats_t st;
+    size_t limit;
+    int failed = 0, i;
+
+    mem_init();
+    CHECK(mm_init() == 0);
+    CHECK(mm_start_maintenance(&maint) == 0);           /* the thread waits out the interval: the passes are ours */
+    for (i = 0; i < PURGE_BLOCKS; i++) {
+        big[i] = mm_malloc(PURGE_SIZE);
+        CHECK(big[i] != NULL && mm_malloc(16) != NULL);
+        memset(big[i], i, PURGE_SIZE);
+    }
+    for (i = 0; i < PURGE_BLOCKS; i++)
+        mm_free(big[i]);
+    mm_maintain();                                      /* the decay time is one pass: all of their pages go */
+    for (i = 0; i < PURGE_BLOCKS; i++)
+        CHECK(mm_malloc(PURGE_SIZE / 2) != NULL);       /* splits each free block */
+
+    mm_get_stats(&st);
+    limit = mem_resident() + 4 * PURGE_SIZE;
+    CHECK(st.committed > limit);                        /* the estimate is over the limit... */
+    mm_set_limits(limit, limit);
+    CHECK(mm_malloc(2 * PURGE_SIZE) != NULL);           /* ...but the memory in use is not */
+    mm_get_stats(&st);
+    CHECK(st.pressure_events == 0);
+
+    mm_set_limits(0, 0);
+    mm_stop_maintenance();
+    CHECK(mm_check(0));
+    mem_deinit();
+    return failed;
+}
+
+/*
+ * compact_pinned - Free every other movable block, pin one in PIN_EVERY
+ *     of the others and compact until the pass is done. The pinned blocks
+ *     must stay where they were, some of the others must have moved, and
+ *     all of them must keep their contents.
+ */
+static int compact_pinned(void)
+{
+    mm_handle_t h[HANDLES];
+    unsigned char *addr[HANDLES], *p;
+    int failed = 0, moved = 0, i, j, passes;
+
+    mem_init();
+    CHECK(mm_init() == 0);
+    for (i = 0; i < HANDLES; i++) {
+        CHECK((h[i] = mm_halloc(HANDLE_SIZE)) != 0);
+        CHECK((p = mm_pin(h[i])) != NULL);
+        memset(p, i, HANDLE_SIZE);
+        mm_unpin(h[i]);
+    }
+    for (i = 0; i < HANDLES; i += 2)
+        mm_hfree(h[i]);
+    for (i = 1; i < HANDLES; i += 2)
+        addr[i] = mm_pin(h[i]);
+    for (i = 1; i < HANDLES; i += 2)
+        if (i % PIN_EVERY != 1)
+            mm_unpin(h[i]);
+
+    for (passes = 0; mm_compact(SIZE_MAX) && passes < HANDLES; passes++)
+        ;
+    CHECK(passes < HANDLES);
+    for (i = 1; i < HANDLES; i += 2) {
+        p = mm_pin(h[i]);
+        if (i % PIN_EVERY == 1)
+            CHECK(p == addr[i]);
+        else
+            moved += (p != addr[i]);
+        for (j = 0; j < HANDLE_SIZE && p[j] == (unsigned char) i; j++)
+            ;
+        CHECK(j == HANDLE_SIZE);
+        mm_unpin(h[i]);
+    }
+    CHECK(moved > 0);
+    CHECK(mm_check(0));
+
+    /* Handles that are not live are ignored, and so is freeing a pinned block */
+    CHECK(mm_pin(0) == NULL);
+    CHECK(mm_pin(h[0]) == NULL);
+    CHECK(mm_pin(HANDLES * HANDLES) == NULL);
+    mm_hfree(0);
+    mm_unpin(0);
+    mm_hfree(h[0]);
+    mm_hfree(h[1]);                                     /* still pinned */
+    CHECK(mm_pin(h[1]) == addr[1]);
+    mm_unpin(h[1]);
+    mm_unpin(h[1]);
+    mm_unpin(h[1]);                                     /* one too many */
+    mm_hfree(h[1]);
+    CHECK(mm_pin(h[1]) == NULL);
+    CHECK(mm_check(0));
+    mem_deinit();
+    return failed;
+}
+
+/*
+ * shared_fork - Fork a child that maps the shared heap again (at another
+ *     address), reads a block of the parent, frees it and hands back one
+ *     of its own by offset
+ */
+static int shared_fork(void)
+{
+    size_t off;
+    char *p;
+    int failed = 0, fd, status, pfd[2];
+    pid_t pid;
+
+    if ((fd = mem_init_shared()) < 0) {
+        CHECK(fd >= 0);
+        return failed;
+    }
+    CHECK(mm_init() == 0);
+    CHECK((p = mm_malloc(SHARED_SIZE)) != NULL);
+    strcpy(p, "parent");
+    off = mm_offset(p);
+    CHECK(pipe(pfd) == 0);
+
+    if ((pid = fork()) == 0) {
+        if (mem_attach(fd) < 0 || mm_init() < 0 || mm_address(off) == (void *) p)
+            _exit(1);
+        if (strcmp(mm_address(off), "parent") || (p = mm_malloc(SHARED_SIZE)) == NULL)
+            _exit(2);
+        strcpy(p, "child");
+        mm_free(mm_address(off));
+        off = mm_offset(p);
+        _exit(write(pfd[1], &off, sizeof(off)) == sizeof(off) && mm_check(0) ? 0 : 3);
+    }
+    CHECK(pid > 0);
+    CHECK(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    CHECK(read(pfd[0], &off, sizeof(off)) == sizeof(off));
+    CHECK(strcmp(mm_address(off), "child") == 0);
+    mm_free(mm_address(off));
+    CHECK(mm_check(0));
+    close(pfd[0]);
+    close(pfd[1]);
+    mem_deinit();
+    close(fd);
+    return failed;
+}
+
+/*
+ * file_reopen - Write a heap kept in a file of FILE_HEAP bytes, close it,
+ *     open it again without giving a size and find the blocks where they
+ *     were, with the room of the file left to grow into
+ */
+static int file_reopen(void)
+{
+    char path[64];
+    size_t off;
+    char *p;
+    int failed = 0;
+
+    snprintf(path, sizeof(path), "/tmp/mmtest-heap-%d", (int) getpid());
+    unlink(path);
+    CHECK(mem_init_file(path, FILE_HEAP) == 0);
+    CHECK(mm_init() == 0);
+    CHECK((p = mm_malloc(FILE_BLOCK)) != NULL);
+    CHECK((p = mm_malloc(SHARED_SIZE)) != NULL);
+    strcpy(p, "kept");
+    off = mm_offset(p);
+    CHECK(mm_checkpoint() == 0);
+    mem_deinit();
+
+    CHECK(mem_init_file(path, 0) == 0);
+    CHECK(mm_init() == 0);
+    CHECK(mem_heapleft() > FILE_HEAP - 2 * FILE_BLOCK);
+    CHECK(strcmp(mm_address(off), "kept") == 0);
+    mm_free(mm_address(off));
+    CHECK(mm_malloc(SHARED_SIZE) != NULL);
+    CHECK(mm_malloc(FILE_BLOCK) != NULL);
+    CHECK(mm_check(0));
+    mem_deinit();
+    unlink(path);
+    return failed;
+}
+
+static void usage(void)
+{
+    int i;
+
+    fprintf(stderr, "Usage: mmtest [-h] [<test>...]\n");
+    fprintf(stderr, "Tests (default all):");
+    for (i = 0; i < NUM_TESTS; i++)
+        fprintf(stderr, " %s", tests[i].name);
+    fprintf(stderr, "\n");
+}
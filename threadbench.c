@@ -0,0 +1,566 @@
+/*
+ * threadbench.c - Allocator stress benchmarks on 1 to n threads, run
+ *     against the mm package (built with -DMM_THREAD_SAFE) and the C
+ *     library's malloc from the same binary.
+ *
+ * larson         Server simulation: each thread frees a random one of its
+ *                blocks and allocates another of random size in its place,
+ *                and every LARSON_ROUNDS requests hands its blocks on to a
+ *                new thread and exits. The first blocks are allocated by
+ *                the main thread, so frees cross threads from the start.
+ * threadtest     Each thread allocates a batch of small objects and frees
+ *                them all, over and over.
+ * xmalloc        Producer/consumer: each thread allocates batches of
+ *                blocks and passes them to the next thread of a ring,
+ *                which frees them.
+ * cache-thrash   Active false sharing: each thread allocates a tiny object,
+ *                writes it many times and frees it, over and over. Objects
+ *                of different threads in one cache line bounce it between
+ *                their caches.
+ * cache-scratch  Passive false sharing: like cache-thrash, but each thread
+ *                starts by freeing a tiny object the main thread allocated
+ *                next to those of the others; an allocator that hands that
+ *                memory back to the thread shares the line from then on.
+ * realloc        Each thread grows a few buffers by small steps with
+ *                realloc, in turn, then frees them and starts over.
+ *
+ * Every thread does the same amount of work whatever their number, so the
+ * ops/sec of a perfectly scalable allocator grow linearly with the threads.
+ * An op is a call of malloc, free or realloc; the blocks the benchmarks
+ * start and end with are not counted. Each point is the fastest of RUNS
+ * runs, timed from letting the threads go until the last one is done.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define MAXTHREADS 64
+#define RUNS        3
+
+#define LARSON_SLOTS   500    /* blocks per thread */
+#define LARSON_MIN     10     /* smallest and largest block (bytes) */
+#define LARSON_MAX     500
+#define LARSON_ROUNDS  20000  /* requests per thread before it hands its blocks on */
+#define LARSON_EPOCHS  8      /* threads in a row that get the blocks */
+
+#define THREADTEST_OBJS   2000  /* objects per batch */
+#define THREADTEST_SIZE   64
+#define THREADTEST_ITERS  50
+
+#define XMALLOC_BATCH    64   /* blocks per batch */
+#define XMALLOC_MIN      16
+#define XMALLOC_MAX      256
+#define XMALLOC_BATCHES  1000 /* batches each thread produces */
+#define XMALLOC_PENDING  8    /* batches a thread may have waiting for it */
+
+#define CACHE_SIZE    8       /* bytes per object */
+#define CACHE_WRITES  200     /* writes of each byte of an object */
+#define CACHE_ITERS   20000
+
+#define REALLOC_BUFS   4      /* buffers grown in turn */
+#define REALLOC_MAX    16384  /* size a buffer grows to */
+#define REALLOC_STEP   64     /* largest step */
+#define REALLOC_ROUNDS 50
+
+/* An allocator under test */
+typedef struct {
+    const char *name;
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+} allocator_t;
+
+/* Blocks passed from one thread to the next by xmalloc */
+typedef struct batch_t {
+    struct batch_t *next;
+    void *blocks[XMALLOC_BATCH];
+} batch_t;
+
+/* A benchmark thread (and, for larson, the ones it hands its blocks on to); each gets its own cache line */
+typedef struct thread_t {
+    const allocator_t *a;
+    int id;
+    unsigned long rand;        /* xorshift64* state */
+    long ops;                  /* requests made, stored when done */
+    pthread_t prev;            /* thread to join: the one before in larson, else the last one */
+    int epoch;                 /* larson: number of threads that have had the blocks */
+    void **slots;              /* larson: the blocks; cache-scratch: the object from the main thread */
+    pthread_mutex_t lock;      /* xmalloc: protects the two below */
+    batch_t *inbox;            /* batches from the thread before in the ring */
+    int pending;               /* number of them */
+} __attribute__((aligned(64))) thread_t;
+
+/* A benchmark: its threads, and what the main thread does before and after them */
+typedef struct {
+    const char *name;
+    void *(*body)(void *arg);
+    void (*setup)(thread_t *t);
+    void (*teardown)(thread_t *t);
+} bench_t;
+
+static void *larson(void *arg);
+static void larson_setup(thread_t *t);
+static void larson_teardown(thread_t *t);
+static void *threadtest(void *arg);
+static void *xmalloc(void *arg);
+static void xmalloc_setup(thread_t *t);
+static void xmalloc_teardown(thread_t *t);
+static void *cache_thrash(void *arg);
+static void cache_scratch_setup(thread_t *t);
+static void *realloc_growth(void *arg);
+static double run(const bench_t *b, const allocator_t *a, int nthreads);
+static void start_wait(void);
+static void finish(thread_t *t, long ops);
+static unsigned long next_rand(thread_t *t);
+static void *xmalloc_checked(const allocator_t *a, size_t size);
+static void usage(void);
+
+static const allocator_t allocators[] = {
+    { "mm", mm_malloc, mm_free, mm_realloc },
+    { "libc", malloc, free, realloc },
+};
+#define NUM_ALLOCATORS (sizeof(allocators) / sizeof(allocators[0]))
+
+static const bench_t benches[] = {
+    { "larson", larson, larson_setup, larson_teardown },
+    { "threadtest", threadtest, NULL, NULL },
+    { "xmalloc", xmalloc, xmalloc_setup, xmalloc_teardown },
+    { "cache-thrash", cache_thrash, NULL, NULL },
+    { "cache-scratch", cache_thrash, cache_scratch_setup, NULL },
+    { "realloc", realloc_growth, NULL, NULL },
+};
+#define NUM_BENCHES (sizeof(benches) / sizeof(benches[0]))
+
+static thread_t threads[MAXTHREADS];
+static int num_threads;          /* threads of the current run */
+static int started;              /* set to let the threads go */
+static int finished;             /* threads (larson: chains of them) done */
+static int work = 1;             /* multiplier of the work per thread (-w) */
+
+int main(int argc, char **argv)
+{
+    const allocator_t *use[NUM_ALLOCATORS];
+    int num_use = 0, max_threads, i, j, k, c;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+    max_threads = (ncpu < 1) ? 1 : (ncpu > MAXTHREADS) ? MAXTHREADS : ncpu;
+    while ((c = getopt(argc, argv, "a:t:w:h")) != EOF) {
+        switch (c) {
+        case 'a':
+            for (i = 0; i < NUM_ALLOCATORS && strcmp(optarg, allocators[i].name); i++)
+                ;
+            if (i == NUM_ALLOCATORS) {
+                usage();
+                exit(1);
+            }
+            use[0] = &allocators[i];
+            num_use = 1;
+            break;
+        case 't':
+            max_threads = atoi(optarg);
+            break;
+        case 'w':
+            work = atoi(optarg);
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (max_threads < 1 || max_threads > MAXTHREADS || work < 1) {
+        usage();
+        exit(1);
+    }
+    if (num_use == 0)
+        for (i = 0; i < NUM_ALLOCATORS; i++)
+            use[num_use++] = &allocators[i];
+    for (i = optind; i < argc; i++) {
+        for (j = 0; j < NUM_BENCHES && strcmp(argv[i], benches[j].name); j++)
+            ;
+        if (j == NUM_BENCHES) {
+            fprintf(stderr, "threadbench: no benchmark %s\n", argv[i]);
+            exit(1);
+        }
+    }
+
+    mem_init();
+    for (j = 0; j < NUM_BENCHES; j++) {
+        if (optind < argc) {
+            for (i = optind; i < argc && strcmp(argv[i], benches[j].name); i++)
+                ;
+            if (i == argc)
+                continue;
+        }
+        printf("%s\n%7s", benches[j].name, "threads");
+        for (i = 0; i < num_use; i++)
+            printf("%*s Kops/s", 8, use[i]->name);
+        printf("\n");
+        for (k = 1; k <= max_threads; k++) {
+            printf("%7d", k);
+            fflush(stdout);
+            for (i = 0; i < num_use; i++)
+                printf("%15.0f", run(&benches[j], use[i], k) / 1e3);
+            printf("\n");
+        }
+        printf("\n");
+    }
+    mem_deinit();
+    exit(0);
+}
+
+/*
+ * run - Run a benchmark on nthreads threads RUNS times and return the ops/sec
+ *     of the fastest run
+ */
+static double run(const bench_t *b, const allocator_t *a, int nthreads)
+{
+    struct timespec t0, t1;
+    double secs, ops, best = 0;
+    int r, i;
+
+    for (r = 0; r < RUNS; r++) {
+        if (a->malloc == mm_malloc) {
+            mem_reset_brk();
+            if (mm_init() < 0) {
+                fprintf(stderr, "mm_init failed\n");
+                exit(1);
+            }
+        }
+        num_threads = nthreads;
+        started = finished = 0;
+        for (i = 0; i < nthreads; i++) {
+            memset(&threads[i], 0, sizeof(thread_t));
+            threads[i].a = a;
+            threads[i].id = i;
+            threads[i].rand = 0x9e3779b97f4a7c15UL * (i + 1);
+        }
+        for (i = 0; b->setup && i < nthreads; i++)
+            b->setup(&threads[i]);
+        for (i = 0; i < nthreads; i++)
+            if (pthread_create(&threads[i].prev, NULL, b->body, &threads[i]) != 0) {
+                fprintf(stderr, "pthread_create failed\n");
+                exit(1);
+            }
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        __atomic_store_n(&started, 1, __ATOMIC_RELEASE);
+        while (__atomic_load_n(&finished, __ATOMIC_ACQUIRE) < nthreads)
+            sched_yield();
+        for (i = 0; i < nthreads; i++)
+            pthread_join(threads[i].prev, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+
+        for (i = 0, ops = 0; i < nthreads; i++)
+            ops += threads[i].ops;
+        for (i = 0; b->teardown && i < nthreads; i++)
+            b->teardown(&threads[i]);
+        secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+        if (ops / secs > best)
+            best = ops / secs;
+    }
+    return best;
+}
+
+/*
+ * start_wait - Wait for the main thread to let the threads go
+ */
+static void start_wait(void)
+{
+    while (!__atomic_load_n(&started, __ATOMIC_ACQUIRE))
+        sched_yield();
+}
+
+/*
+ * finish - Record the ops of a thread that is done, for the main thread to
+ *     join it
+ */
+static void finish(thread_t *t, long ops)
+{
+    t->ops += ops;
+    t->prev = pthread_self();
+    __atomic_add_fetch(&finished, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * next_rand - xorshift64*
+ */
+static unsigned long next_rand(thread_t *t)
+{
+    t->rand ^= t->rand >> 12;
+    t->rand ^= t->rand << 25;
+    t->rand ^= t->rand >> 27;
+    return t->rand * 0x2545f4914f6cdd1dUL;
+}
+
+/*
+ * xmalloc_checked - Allocate size bytes or die
+ */
+static void *xmalloc_checked(const allocator_t *a, size_t size)
+{
+    void *p;
+
+    if ((p = a->malloc(size)) == NULL) {
+        fprintf(stderr, "%s malloc of %lu bytes failed\n", a->name, (unsigned long)size);
+        exit(1);
+    }
+    return p;
+}
+
+/*
+ * larson - One thread of the server simulation; the last request of an
+ *     epoch starts the next thread, which joins this one
+ */
+static void *larson(void *arg)
+{
+    thread_t *t = (thread_t *)arg;
+    const allocator_t *a = t->a;
+    pthread_t next;
+    long ops = 0;
+    int i, slot;
+
+    if (t->epoch == 0)
+        start_wait();
+    else
+        pthread_join(t->prev, NULL);
+
+    for (i = 0; i < LARSON_ROUNDS * work; i++) {
+        slot = next_rand(t) % LARSON_SLOTS;
+        a->free(t->slots[slot]);
+        t->slots[slot] = xmalloc_checked(a, LARSON_MIN + next_rand(t) % (LARSON_MAX - LARSON_MIN + 1));
+        ops += 2;
+    }
+
+    if (++t->epoch < LARSON_EPOCHS) {
+        t->ops += ops;
+        t->prev = pthread_self();
+        if (pthread_create(&next, NULL, larson, t) != 0) {
+            fprintf(stderr, "pthread_create failed\n");
+            exit(1);
+        }
+        return NULL;
+    }
+    finish(t, ops);
+    return NULL;
+}
+
+static void larson_setup(thread_t *t)
+{
+    int i;
+
+    if ((t->slots = malloc(LARSON_SLOTS * sizeof(void *))) == NULL) {
+        fprintf(stderr, "threadbench: out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < LARSON_SLOTS; i++)
+        t->slots[i] = xmalloc_checked(t->a, LARSON_MIN + next_rand(t) % (LARSON_MAX - LARSON_MIN + 1));
+}
+
+static void larson_teardown(thread_t *t)
+{
+    int i;
+
+    for (i = 0; i < LARSON_SLOTS; i++)
+        t->a->free(t->slots[i]);
+    free(t->slots);
+}
+
+/*
+ * threadtest - Allocate THREADTEST_OBJS objects and free them, THREADTEST_ITERS times
+ */
+static void *threadtest(void *arg)
+{
+    thread_t *t = (thread_t *)arg;
+    const allocator_t *a = t->a;
+    void *objs[THREADTEST_OBJS];
+    long ops = 0;
+    int i, j;
+
+    start_wait();
+    for (i = 0; i < THREADTEST_ITERS * work; i++) {
+        for (j = 0; j < THREADTEST_OBJS; j++)
+            objs[j] = xmalloc_checked(a, THREADTEST_SIZE);
+        for (j = 0; j < THREADTEST_OBJS; j++)
+            a->free(objs[j]);
+        ops += 2 * THREADTEST_OBJS;
+    }
+    finish(t, ops);
+    return NULL;
+}
+
+/*
+ * xmalloc_drain - Free the batches waiting for a thread of xmalloc and
+ *     return their number
+ */
+static int xmalloc_drain(thread_t *t, long *ops)
+{
+    batch_t *b, *next;
+    int i, n = 0;
+
+    pthread_mutex_lock(&t->lock);
+    b = t->inbox;
+    t->inbox = NULL;
+    __atomic_store_n(&t->pending, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&t->lock);
+
+    for (; b != NULL; b = next, n++) {
+        next = b->next;
+        for (i = 0; i < XMALLOC_BATCH; i++)
+            t->a->free(b->blocks[i]);
+        t->a->free(b);
+        *ops += XMALLOC_BATCH + 1;
+    }
+    return n;
+}
+
+/*
+ * xmalloc - Pass XMALLOC_BATCHES batches on to the next thread of the
+ *     ring, and free as many from the one before
+ */
+static void *xmalloc(void *arg)
+{
+    thread_t *t = (thread_t *)arg;
+    thread_t *to = &threads[(t->id + 1) % num_threads];
+    const allocator_t *a = t->a;
+    batch_t *b;
+    long ops = 0;
+    int made, freed = 0, i;
+
+    start_wait();
+    for (made = 0; made < XMALLOC_BATCHES * work; made++) {
+        b = xmalloc_checked(a, sizeof(batch_t));
+        for (i = 0; i < XMALLOC_BATCH; i++)
+            b->blocks[i] = xmalloc_checked(a, XMALLOC_MIN + next_rand(t) % (XMALLOC_MAX - XMALLOC_MIN + 1));
+        ops += XMALLOC_BATCH + 1;
+
+        /* Don't let the next thread fall too far behind; it may be this one */
+        while (__atomic_load_n(&to->pending, __ATOMIC_RELAXED) >= XMALLOC_PENDING) {
+            freed += xmalloc_drain(t, &ops);
+            if (to != t)
+                sched_yield();
+        }
+        pthread_mutex_lock(&to->lock);
+        b->next = to->inbox;
+        to->inbox = b;
+        __atomic_add_fetch(&to->pending, 1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&to->lock);
+        freed += xmalloc_drain(t, &ops);
+    }
+    while (freed < XMALLOC_BATCHES * work) {
+        freed += xmalloc_drain(t, &ops);
+        sched_yield();
+    }
+    finish(t, ops);
+    return NULL;
+}
+
+static void xmalloc_setup(thread_t *t)
+{
+    pthread_mutex_init(&t->lock, NULL);
+}
+
+static void xmalloc_teardown(thread_t *t)
+{
+    pthread_mutex_destroy(&t->lock);
+}
+
+/*
+ * cache_thrash - Allocate a tiny object, write it CACHE_WRITES times and
+ *     free it, CACHE_ITERS times; in cache-scratch, free the object from
+ *     the main thread first
+ */
+static void *cache_thrash(void *arg)
+{
+    thread_t *t = (thread_t *)arg;
+    const allocator_t *a = t->a;
+    volatile char *p;
+    long ops = 0;
+    int i, j, k;
+
+    start_wait();
+    if (t->slots != NULL) {
+        a->free(t->slots);
+        ops++;
+    }
+    for (i = 0; i < CACHE_ITERS * work; i++) {
+        p = xmalloc_checked(a, CACHE_SIZE);
+        for (j = 0; j < CACHE_WRITES; j++)
+            for (k = 0; k < CACHE_SIZE; k++)
+                p[k]++;
+        a->free((void *)p);
+        ops += 2;
+    }
+    finish(t, ops);
+    return NULL;
+}
+
+static void cache_scratch_setup(thread_t *t)
+{
+    t->slots = xmalloc_checked(t->a, CACHE_SIZE);
+}
+
+/*
+ * realloc_growth - Grow REALLOC_BUFS buffers in turn to REALLOC_MAX bytes,
+ *     writing the end of each after every step, then free them;
+ *     REALLOC_ROUNDS times
+ */
+static void *realloc_growth(void *arg)
+{
+    thread_t *t = (thread_t *)arg;
+    const allocator_t *a = t->a;
+    char *bufs[REALLOC_BUFS];
+    size_t sizes[REALLOC_BUFS];
+    long ops = 0;
+    int r, i, grown;
+
+    start_wait();
+    for (r = 0; r < REALLOC_ROUNDS * work; r++) {
+        memset(bufs, 0, sizeof(bufs));
+        memset(sizes, 0, sizeof(sizes));
+        do {
+            grown = 0;
+            for (i = 0; i < REALLOC_BUFS; i++) {
+                if (sizes[i] >= REALLOC_MAX)
+                    continue;
+                sizes[i] += 1 + next_rand(t) % REALLOC_STEP;
+                if ((bufs[i] = a->realloc(bufs[i], sizes[i])) == NULL) {
+                    fprintf(stderr, "%s realloc to %lu bytes failed\n", a->name, (unsigned long)sizes[i]);
+                    exit(1);
+                }
+                bufs[i][sizes[i] - 1] = (char)i;
+                ops++;
+                grown = 1;
+            }
+        } while (grown);
+        for (i = 0; i < REALLOC_BUFS; i++)
+            a->free(bufs[i]);
+        ops += REALLOC_BUFS;
+    }
+    finish(t, ops);
+    return NULL;
+}
+
+static void usage(void)
+{
+    int i;
+
+    fprintf(stderr, "Usage: threadbench [-h] [-a mm|libc] [-t <threads>] [-w <work>] [<benchmark>...]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-a <name>     Run only this allocator (default all).\n");
+    fprintf(stderr, "\t-t <threads>  Run on 1 to this many threads (default the number of CPUs).\n");
+    fprintf(stderr, "\t-w <work>     Multiply the work per thread by this (default 1).\n");
+    fprintf(stderr, "\t-h            Print this message.\n");
+    fprintf(stderr, "Benchmarks (default all):");
+    for (i = 0; i < NUM_BENCHES; i++)
+        fprintf(stderr, " %s", benches[i].name);
+    fprintf(stderr, "\n");
+}
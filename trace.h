@@ -0,0 +1,43 @@
+/*
+ * trace.h - The requests of a trace as mdriver replays them, and the
+ *     binary trace file that holds them in the same layout.
+ *
+ * A binary trace is a trace_header_t followed by its num_ops requests,
+ * 8 bytes each, so that mdriver can map the file and replay it in place
+ * rather than parse it. Its ids are dense: mktrace hands the id of a
+ * freed block out again, so num_ids is the most blocks ever live at once
+ * rather than the number of blocks allocated. The layout is that of the
+ * machine the file was written on; op_size guards against another one.
+ */
+#ifndef __TRACE_H_
+#define __TRACE_H_
+
+#include <stdint.h>
+
+/* Types of request */
+enum {ALLOC, FREE, REALLOC};
+
+#define TRACE_MAX_IDS       (1 << 24)   /* ids fit in traceop_t.index */
+#define TRACE_MAX_THREADS   64          /* thread ids fit in traceop_t.thread */
+
+/* Characterizes a single trace operation (allocator request) */
+typedef struct {
+    uint32_t size;                      /* byte size of alloc/realloc request */
+    uint32_t index : 24;                /* index for free() to use later */
+    uint32_t thread : 6;                /* thread that issues the request (0 if the trace has none) */
+    uint32_t type : 2;                  /* type of request: ALLOC, FREE or REALLOC */
+} traceop_t;
+
+#define TRACE_MAGIC "MMREQS01"
+
+typedef struct {
+    char magic[8];                      /* TRACE_MAGIC */
+    uint32_t op_size;                   /* sizeof(traceop_t) */
+    uint32_t weight;                    /* weight of the trace (unused) */
+    uint64_t sugg_heapsize;             /* suggested heap size */
+    uint64_t num_ids;                   /* ids of the requests are below this */
+    uint64_t num_ops;                   /* requests that follow */
+    uint64_t num_threads;               /* thread ids of the requests are below this */
+} trace_header_t;
+
+#endif /* __TRACE_H_ */